@@ -24,6 +24,8 @@
 
 static const char* TAG = "e12-e32spec";
 
+e12_esp32_node* e12_esp32_node::_rx_node = NULL;
+
 /**
  * @brief Constructor for e12_esp32_node.
  *
@@ -31,7 +33,11 @@ static const char* TAG = "e12-e32spec";
  * @param pid Product ID.
  */
 e12_esp32_node::e12_esp32_node(uint32_t vid, uint32_t pid) : e12(vid, pid) {
-  _bus = NULL;
+  _transport = NULL;
+  _rx_pos = 0;
+  _rx_len = 0;
+  // answer with whatever integrity check the VMCU uses
+  set_integrity(e12_integrity_t::INTEGRITY_XOR, true);
 }
 
 /**
@@ -48,7 +54,37 @@ e12_esp32_node::~e12_esp32_node() {}
  */
 int e12_esp32_node::begin(void* bus, uint8_t e12_addr) {
   ESP_LOGI(TAG, "begin(%x)", bus);
-  _bus = (TwoWire*)bus;
+  _i2c.attach((TwoWire*)bus);
+  _rx_ring.attach(&_i2c);
+  _rx_node = this;
+  ((TwoWire*)bus)->onReceive(on_i2c_receive);
+  return begin(&_rx_ring);
+}
+
+/**
+ * @brief Moves the bytes the VMCU wrote into the ring, from the I2C slave
+ * receive callback.
+ *
+ * @param len Number of bytes written.
+ */
+void e12_esp32_node::on_i2c_receive(int len) {
+  if (_rx_node && _rx_node->_rx_ring.pump() < len) {
+    ESP_LOGW(TAG, "rx ring full, %d bytes left on the bus", len);
+  }
+}
+
+/**
+ * @brief Initializes the node over the given transport.
+ *
+ * @param transport Pointer to the transport.
+ * @return int 0 on success, non-zero on failure.
+ */
+int e12_esp32_node::begin(e12_transport* transport) {
+  if (!transport || transport->begin() != 0) return -1;
+  _transport = transport;
+  flush_buffer(get_decode_buffer());
+  _rx_pos = 0;
+  _rx_len = 0;
   return 0;
 }
 
@@ -73,7 +109,7 @@ uint32_t e12_esp32_node::get_time_ms() {
  * @return int 0 on success, non-zero on failure.
  */
 int e12_esp32_node::send(e12_packet_t* buf, bool retry) {
-  if (!_bus) return -1;
+  if (!_transport) return -1;
   e12_onwire_t* p = encode(buf);
   if (!p) {
     ESP_LOGE(TAG, "Failed to encode buffer");
@@ -86,7 +122,7 @@ int e12_esp32_node::send(e12_packet_t* buf, bool retry) {
     // for (int i = 0; i < p->head.len; i++) {
     //   ESP_LOGI(TAG, "write (%d:%d:%c)\n", i, p->buf[i], (char)p->buf[i]);
     // }
-    _bus->slaveWrite(p->buf, p->head.len);
+    if (_transport->write(p->buf, p->head.len) < 0) return -1;
     return 0;
   }
   return -1;
@@ -206,21 +242,30 @@ int e12_esp32_node::print_buffer(e12_onwire_t* buf) {
  * @return e12_packet_t* Pointer to the read packet, or NULL on failure.
  */
 e12_packet_t* e12_esp32_node::read() {
-  if (!_bus) return NULL;
-
-  e12_onwire_t* f = get_decode_buffer();
-  flush_buffer(f);
-  while (_bus->available()) {
-    uint8_t c = _bus->read();
-    e12_packet_t* p = NULL;
-    if ((p = decode(f, (uint8_t)c))) {
-      ESP_LOGI(TAG, "**** Received full e12 FRAME (%d:%d:%d) ****\n",
-               p->msg.head.seq, p->msg.head.cmd, p->msg.head.len);
-      // for (int i = 0; i < p->msg.head.len; i++) {
-      //   ESP_LOGI(TAG, "Write %d:%d:%c\n", i, p->buf[i], (char)p->buf[i]);
-      // }
-      return p;
+  if (!_transport) return NULL;
+
+  if (!_transport->is_stream()) {
+    // a new write from the master always starts a new frame
+    flush_buffer(get_decode_buffer());
+    _rx_pos = 0;
+    _rx_len = 0;
+  }
+
+  while (true) {
+    if (_rx_pos < _rx_len) {
+      size_t used = 0;
+      e12_packet_t* p = decode_one(&_rx_buf[_rx_pos], _rx_len - _rx_pos, &used);
+      _rx_pos += used;
+      if (p) {
+        ESP_LOGI(TAG, "**** Received full e12 FRAME (%d:%d:%d) ****\n",
+                 p->msg.head.seq, p->msg.head.cmd, p->msg.head.len);
+        return p;
+      }
     }
+
+    int n = _transport->read(_rx_buf, sizeof(_rx_buf));
+    if (n <= 0) return NULL;
+    _rx_pos = 0;
+    _rx_len = n;
   }
-  return NULL;
 }
@@ -21,8 +21,19 @@
 
 #include <Wire.h>
 #include <e12_protocol.h>
+#include <e12_ring.h>
 #include <stdint.h>
 
+#include "esp32_e12_transport.h"
+
+/**
+ * @brief Bytes the VMCU may write over I2C before read() decodes them, a
+ * power of two. Frames are taken off the slave buffer in Wire.onReceive().
+ */
+#ifndef E12_NODE_RX_RING_SIZE
+#define E12_NODE_RX_RING_SIZE 512
+#endif
+
 /**
  * @class e12_esp32_node
  * @brief This class represents an ESP32 node for the e12 protocol.
@@ -30,11 +41,28 @@
  * The e12_esp32_node class provides methods for initializing the node,
  * handling communication, managing events, configuring the node, and
  * performing utility functions. It extends the base e12 class and
- * integrates with the TwoWire interface for I2C communication.
+ * talks to the VMCU through an e12_transport, by default the TwoWire
+ * interface as I2C slave. Bytes the VMCU writes are moved to a ring from
+ * Wire.onReceive(), so a write landing before read() ran does not replace
+ * the previous one.
  */
 class e12_esp32_node : public e12 {
  private:
-  TwoWire* _bus;  ///< Pointer to the I2C bus interface
+  e12_i2c_slave_transport _i2c;  ///< default I2C slave transport
+  e12_rx_ring_transport<E12_NODE_RX_RING_SIZE> _rx_ring;  ///< buffers _i2c
+  e12_transport* _transport;     ///< transport in use
+  uint8_t _rx_buf[E12_MAX_PKT_SIZE];  ///< bytes read but not decoded
+  uint8_t _rx_pos;                    ///< next byte to decode
+  uint8_t _rx_len;                    ///< valid bytes in _rx_buf
+
+  static e12_esp32_node* _rx_node;  ///< node Wire.onReceive() feeds
+
+  /**
+   * @brief Wire.onReceive() handler, moves the bytes the VMCU wrote into
+   * the ring of the node begin(bus) was called on.
+   * @param len number of bytes written
+   */
+  static void on_i2c_receive(int len);
 
  public:
   /**
@@ -52,13 +80,21 @@ class e12_esp32_node : public e12 {
   // Initialization
 
   /**
-   * @brief Initializes the node with the given bus and address.
+   * @brief Initializes the node with the given bus and address. Registers
+   * the Wire.onReceive() handler of the bus, one node per device.
    * @param bus Pointer to the I2C bus
    * @param e12_addr Address of the e12 node
    * @return 0 on success, non-zero on failure
    */
   virtual int begin(void* bus, uint8_t e12_addr = 0);
 
+  /**
+   * @brief Initializes the node over the given transport e.g UART.
+   * @param transport transport to the VMCU
+   * @return 0 on success, non-zero on failure
+   */
+  int begin(e12_transport* transport);
+
   // Time
 
   /**
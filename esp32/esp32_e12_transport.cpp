@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "esp32_e12_transport.h"
+
+#include <e12_protocol.h>
+#include <string.h>
+
+/**
+ * @brief Stages the segments in the slave tx buffer for the master to read.
+ * The frame is staged exactly (no padding) and in one go, so a master
+ * reading the 4 byte onwire head first finds the rest of the frame
+ * already staged behind it.
+ *
+ * @param iov Array of segments.
+ * @param cnt Number of segments.
+ * @return int number of bytes staged, negative on failure.
+ */
+int e12_i2c_slave_transport::writev(const e12_iovec_t* iov, uint8_t cnt) {
+  if (!_bus) return -1;
+  if (cnt == 1) return _bus->slaveWrite(iov[0].base, iov[0].len);
+
+  uint8_t frame[E12_MAX_PKT_SIZE];
+  size_t len = 0;
+  for (uint8_t i = 0; i < cnt; i++) {
+    if (len + iov[i].len > sizeof(frame)) return -1;
+    memcpy(&frame[len], iov[i].base, iov[i].len);
+    len += iov[i].len;
+  }
+  return _bus->slaveWrite(frame, len);
+}
+
+/**
+ * @brief Reads bytes written by the master.
+ *
+ * @param buf Destination buffer.
+ * @param len Size of buf.
+ * @return int number of bytes copied.
+ */
+int e12_i2c_slave_transport::read(uint8_t* buf, uint8_t len) {
+  if (!_bus) return -1;
+  uint8_t n = 0;
+  while (n < len && _bus->available()) {
+    buf[n++] = (uint8_t)_bus->read();
+  }
+  return n;
+}
+
+/**
+ * @brief Opens the serial port if a baud rate was given.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int e12_uart_node_transport::begin() {
+  if (!_port) return -1;
+  if (_baud) _port->begin(_baud);
+  return 0;
+}
+
+/**
+ * @brief Writes the segments to the serial port.
+ *
+ * @param iov Array of segments.
+ * @param cnt Number of segments.
+ * @return int number of bytes written.
+ */
+int e12_uart_node_transport::writev(const e12_iovec_t* iov, uint8_t cnt) {
+  int total = 0;
+  for (uint8_t i = 0; i < cnt; i++) {
+    total += _port->write(iov[i].base, iov[i].len);
+  }
+  return total;
+}
+
+/**
+ * @brief Reads already received bytes from the serial port.
+ *
+ * @param buf Destination buffer.
+ * @param len Size of buf.
+ * @return int number of bytes copied.
+ */
+int e12_uart_node_transport::read(uint8_t* buf, uint8_t len) {
+  uint8_t n = 0;
+  while (n < len && _port->available() > 0) {
+    buf[n++] = (uint8_t)_port->read();
+  }
+  return n;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_ESP32_E12_TRANSPORT
+#define H_ESP32_E12_TRANSPORT
+
+#include <Wire.h>
+#include <e12_transport.h>
+#include <stdint.h>
+
+/**
+ * @class e12_i2c_slave_transport
+ * @brief I2C slave transport of the e12 node. Outgoing frames are staged
+ * for the VMCU to clock out, incoming bytes are read from the slave buffer.
+ */
+class e12_i2c_slave_transport : public e12_transport {
+ private:
+  TwoWire* _bus;  ///< Pointer to the I2C bus interface
+
+ public:
+  /**
+   * @brief Constructor for the e12_i2c_slave_transport class.
+   * @param bus Pointer to the I2C bus
+   */
+  e12_i2c_slave_transport(TwoWire* bus = NULL) : _bus(bus) {}
+
+  /**
+   * @brief Sets the I2C bus, used before begin().
+   * @param bus Pointer to the I2C bus
+   */
+  void attach(TwoWire* bus) { _bus = bus; }
+
+  virtual int begin() { return _bus ? 0 : -1; }
+  virtual int writev(const e12_iovec_t* iov, uint8_t cnt);
+  virtual int read(uint8_t* buf, uint8_t len);
+  virtual bool is_stream() { return false; }
+};
+
+/**
+ * @class e12_uart_node_transport
+ * @brief UART transport of the e12 node.
+ */
+class e12_uart_node_transport : public e12_transport {
+ private:
+  HardwareSerial* _port;  ///< serial port
+  uint32_t _baud;         ///< baud rate, 0 if the port is set up by the caller
+
+ public:
+  /**
+   * @brief Constructor for the e12_uart_node_transport class.
+   * @param port Serial port e.g Serial1
+   * @param baud baud rate, 0 to leave the port configuration untouched
+   */
+  e12_uart_node_transport(HardwareSerial* port, uint32_t baud = 1000000UL)
+      : _port(port), _baud(baud) {}
+
+  virtual int begin();
+  virtual int writev(const e12_iovec_t* iov, uint8_t cnt);
+  virtual int read(uint8_t* buf, uint8_t len);
+};
+
+#endif
@@ -166,7 +166,8 @@ void loop() {
   }
 
   if (e12_read_msg) {
-    demo.on_receive(demo.read());
+    // read by e12_run() below
+    demo.notify_rx();
 #if 0
     digitalWrite(ledPin, false);
 #endif
@@ -196,6 +197,10 @@ void loop() {
     }
   }
 
+  // writes queued frames, reads and handles what the e12 node sent,
+  // expires requests and sends the log events queued by queue_log()
+  demo.e12_run();
+
   // here ideally in a real device you will
   // got to sleep waiting for events to happen
 }
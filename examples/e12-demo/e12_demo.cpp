@@ -24,18 +24,29 @@
 #include "Arduino.h"
 #include "e12_cmds.h"
 #include "e12_demo.h"
+#include "e12_json.h"
 #include "e12_variants.h"
 
-static long json_get_val(const char* s, const char* key) {
-  const char* ptr = strstr(s, key);
-  if (!ptr) return 0;
-  ptr += strlen(key);
-  while (*ptr && (*ptr == ':' || *ptr == ' ' || *ptr == '\"')) {
-    ptr++;
-  }
+typedef struct demo_config {
+  uint32_t on_ms;
+  uint32_t off_ms;
+} demo_config_t;
 
-  return atol(ptr);
-}
+typedef struct demo_state {
+  uint8_t count;
+  uint8_t on;
+} demo_state_t;
+
+static const e12_json_field_t config_fields[] = {
+    E12_JSON_FIELD("on_ms", demo_config_t, on_ms, e12_json_type_t::JSON_UINT),
+    E12_JSON_FIELD("off_ms", demo_config_t, off_ms,
+                   e12_json_type_t::JSON_UINT),
+};
+
+static const e12_json_field_t state_fields[] = {
+    E12_JSON_FIELD("count", demo_state_t, count, e12_json_type_t::JSON_UINT),
+    E12_JSON_FIELD("on", demo_state_t, on, e12_json_type_t::JSON_UINT),
+};
 
 e12_demo::e12_demo(uint32_t vid, uint32_t pid) : e12_client(vid, pid) {
   _on = false;
@@ -84,7 +95,7 @@ bool e12_demo::on_ctl_write(uint8_t pin, uint32_t val) {
   E12_PRINT_F("PIN WRITE (%d) : %d", pin, val);
   pinMode(pin, OUTPUT);
   digitalWrite(pin, val);
-  return val;
+  return true;
 }
 
 int e12_demo::on_config(const char* s, int len) {
@@ -92,8 +103,11 @@ int e12_demo::on_config(const char* s, int len) {
   E12_PRINTLN("**********ARDUINO GOT JSON CONFIG ***********");
   E12_PRINTLN(s);
 
-  _on_delay = json_get_val(s, "\"on_ms\"");
-  _off_delay = (uint8_t)json_get_val(s, "\"off_ms\"");
+  demo_config_t config = {_on_delay, _off_delay};
+  uint8_t n = sizeof(config_fields) / sizeof(config_fields[0]);
+  if (e12_json_parse(s, len, config_fields, n, &config) < 0) return false;
+  _on_delay = config.on_ms;
+  _off_delay = config.off_ms;
 
   return true;
 }
@@ -116,8 +130,11 @@ int e12_demo::on_restore_state(const char* s, int len) {
   E12_PRINTLN("**********ARDUINO RESTORE STATE ***********");
   E12_PRINTLN(s);
 
-  _count = json_get_val(s, "\"count\"");
-  _on = (uint8_t)json_get_val(s, "\"on\"");
+  demo_state_t state = {_count, _on};
+  uint8_t n = sizeof(state_fields) / sizeof(state_fields[0]);
+  if (e12_json_parse(s, len, state_fields, n, &state) < 0) return -1;
+  _count = state.count;
+  _on = state.on;
 
   return 0;
 }
@@ -148,9 +165,11 @@ int e12_demo::log(uint8_t type, uint8_t status, uint32_t ts, void* data) {
       evt->i_data = ctl_log->value;
     }
   }
-  send(get_request(e12_cmd_t::CMD_LOG, true, evt), true);
+  // plain CMD_LOG unless built with an E12_LOG_RING_SIZE, any e12 node
+  // decodes it
+  int ret = queue_log(evt);
   evt->in_use = false;
-  return 0;
+  return ret;
 };
 
 // demo loop to demonstrate the e12-protocol capabilities
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Cycles each integrity check takes over a full data payload, printed on
+// Serial once a second. Pick the set_integrity() mode from these numbers:
+// the CRC modes cost time on every frame sent and received.
+//
+// AVR counts Timer1 at the CPU clock, SAMD21 reads SysTick, ESP32 and
+// RP2040 read the cycle counter.
+
+#include <e12_protocol.h>
+
+#include "Arduino.h"
+
+#define BENCH_LEN E12_MAX_CMD_DATA_PAYLOAD
+#define BENCH_RUNS 16
+
+static uint8_t payload[BENCH_LEN];
+static volatile uint32_t sink;
+
+#if defined(__AVR__)
+static void cycles_begin() {
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);  // no prescaler, one count per cycle
+}
+static inline uint32_t cycles_now() { return TCNT1; }
+// Timer1 is 16 bit, one check over a payload stays well below 65536
+static inline uint32_t cycles_diff(uint32_t a, uint32_t b) {
+  return (uint16_t)(b - a);
+}
+#elif defined(ARDUINO_ARCH_SAMD)
+static void cycles_begin() {}
+// SysTick counts down from its reload value at the CPU clock
+static inline uint32_t cycles_now() { return SysTick->VAL; }
+static inline uint32_t cycles_diff(uint32_t a, uint32_t b) {
+  return a >= b ? a - b : a + SysTick->LOAD + 1 - b;
+}
+#elif defined(ESP_PLATFORM)
+static void cycles_begin() {}
+static inline uint32_t cycles_now() { return ESP.getCycleCount(); }
+static inline uint32_t cycles_diff(uint32_t a, uint32_t b) { return b - a; }
+#elif defined(ARDUINO_ARCH_RP2040)
+static void cycles_begin() {}
+static inline uint32_t cycles_now() { return rp2040.getCycleCount(); }
+static inline uint32_t cycles_diff(uint32_t a, uint32_t b) { return b - a; }
+#else
+#error "No cycle counter for this architecture"
+#endif
+
+static void bench(const __FlashStringHelper* name, e12_integrity_t mode) {
+  uint32_t best = 0xFFFFFFFF;
+  for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+    noInterrupts();
+    uint32_t start = cycles_now();
+    switch (mode) {
+      case e12_integrity_t::INTEGRITY_XOR:
+        sink = e12::get_checksum((const char*)payload, BENCH_LEN);
+        break;
+      case e12_integrity_t::INTEGRITY_CRC16:
+        sink = e12::get_crc16(payload, BENCH_LEN);
+        break;
+      case e12_integrity_t::INTEGRITY_CRC32:
+        sink = e12::get_crc32(payload, BENCH_LEN);
+        break;
+    }
+    uint32_t c = cycles_diff(start, cycles_now());
+    interrupts();
+    if (c < best) best = c;
+  }
+  Serial.print(name);
+  Serial.print(F(": "));
+  Serial.print(best);
+  Serial.print(F(" cycles, "));
+  Serial.print((best * 100 + BENCH_LEN / 2) / BENCH_LEN);
+  Serial.println(F(" cycles/100 bytes"));
+}
+
+void setup() {
+  Serial.begin(115200);
+  for (uint8_t i = 0; i < BENCH_LEN; i++) payload[i] = i * 37 + 11;
+  cycles_begin();
+}
+
+void loop() {
+  Serial.print(BENCH_LEN);
+  Serial.println(F(" byte payload"));
+  bench(F("XOR"), e12_integrity_t::INTEGRITY_XOR);
+  bench(F("CRC-16"), e12_integrity_t::INTEGRITY_CRC16);
+  bench(F("CRC-32"), e12_integrity_t::INTEGRITY_CRC32);
+  delay(1000);
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "posix_e12_delta.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Greedy matching: every 4 byte sequence of the base is hashed into chains,
+// at each image position the longest match is taken. Before searching, the
+// base is tried at the alignment of the previous copy, so code that only
+// changed a few bytes (a constant, a relocated call) costs an insert and a
+// copy with a small relative offset.
+
+#define DELTA_HASH_BITS 16
+#define DELTA_KEY 4
+#define DELTA_CHAIN 64       // candidates tried per position
+#define DELTA_MIN_MATCH 8    // shorter matches cost more than they save
+#define DELTA_MIN_CONT 4     // same, continuing the previous alignment
+#define DELTA_GOOD_MATCH 32  // long enough to not search further
+
+typedef struct {
+  uint8_t* buf;
+  size_t size;
+  size_t n;
+} patch_t;
+
+static bool put(patch_t* p, const void* data, size_t len) {
+  if (len > p->size - p->n) return false;
+  memcpy(&p->buf[p->n], data, len);
+  p->n += len;
+  return true;
+}
+
+static bool put_varint(patch_t* p, uint32_t v) {
+  uint8_t b[5];
+  return put(p, b, e12_put_varint(b, v));
+}
+
+static bool put_op(patch_t* p, e12_delta_op_t op, uint32_t len) {
+  uint8_t b = (uint8_t)op << 6;
+  if (len && len < 64) {
+    b |= len;
+    return put(p, &b, 1);
+  }
+  return put(p, &b, 1) && put_varint(p, len);
+}
+
+static uint32_t hash(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return (uint32_t)(v * 2654435761U) >> (32 - DELTA_HASH_BITS);
+}
+
+static uint32_t match_len(const uint8_t* a, uint32_t alen, const uint8_t* b,
+                          uint32_t blen) {
+  uint32_t n = alen < blen ? alen : blen;
+  uint32_t i = 0;
+  while (i < n && a[i] == b[i]) i++;
+  return i;
+}
+
+/**
+ * @brief Make a delta patch rebuilding image from base
+ *
+ * @param base Running firmware
+ * @param base_len Bytes of base
+ * @param base_version Version of base
+ * @param image New firmware
+ * @param len Bytes of image
+ * @param out Patch
+ * @param size Size of out
+ * @return long bytes of the patch, negative on failure
+ */
+long e12_delta_make(const uint8_t* base, uint32_t base_len,
+                    uint32_t base_version, const uint8_t* image, uint32_t len,
+                    uint8_t* out, size_t size) {
+  patch_t p = {out, size, 0};
+  e12_delta_header_t head;
+  e12_sha256_t sha;
+
+  memset(&head, 0, sizeof(head));
+  head.magic = E12_DELTA_MAGIC;
+  head.base_version = base_version;
+  head.base_size = base_len;
+  head.size = len;
+  e12::sha256_init(&sha);
+  e12::sha256_update(&sha, image, len);
+  e12::sha256_final(&sha, head.sha256);
+  if (!put(&p, &head, sizeof(head))) return -1;
+
+  int32_t* chains = (int32_t*)malloc(sizeof(int32_t) << DELTA_HASH_BITS);
+  int32_t* prev = (int32_t*)malloc(sizeof(int32_t) * (base_len + 1));
+  if (!chains || !prev) {
+    free(chains);
+    free(prev);
+    return -1;
+  }
+  memset(chains, 0xFF, sizeof(int32_t) << DELTA_HASH_BITS);
+  for (uint32_t i = 0; i + DELTA_KEY <= base_len; i++) {
+    uint32_t h = hash(&base[i]);
+    prev[i] = chains[h];
+    chains[h] = i;
+  }
+
+  bool ok = true;
+  uint32_t src = 0;  // end of the previous copy
+  uint32_t lit = 0;  // start of the bytes not yet in the patch
+  uint32_t i = 0;
+  while (ok && i < len) {
+    uint32_t best = 0;
+    uint32_t best_off = 0;
+    uint32_t cont = src + (i - lit);
+    if (cont < base_len) {
+      best = match_len(&base[cont], base_len - cont, &image[i], len - i);
+      best_off = cont;
+    }
+    if (best < DELTA_GOOD_MATCH && i + DELTA_KEY <= len) {
+      int32_t c = chains[hash(&image[i])];
+      for (uint8_t n = 0; c >= 0 && n < DELTA_CHAIN; c = prev[c], n++) {
+        uint32_t m = match_len(&base[c], base_len - c, &image[i], len - i);
+        if (m > best && m >= DELTA_MIN_MATCH) {
+          best = m;
+          best_off = c;
+        }
+      }
+    }
+
+    if (best < DELTA_MIN_MATCH &&
+        (best_off != cont || best < DELTA_MIN_CONT)) {
+      i++;
+      continue;
+    }
+    if (i > lit) {
+      ok = put_op(&p, e12_delta_op_t::DELTA_INSERT, i - lit) &&
+           put(&p, &image[lit], i - lit);
+    }
+    ok = ok && put_op(&p, e12_delta_op_t::DELTA_COPY, best) &&
+         put_varint(&p, e12_zigzag((int32_t)(best_off - src)));
+    src = best_off + best;
+    i += best;
+    lit = i;
+  }
+  if (ok && len > lit) {
+    ok = put_op(&p, e12_delta_op_t::DELTA_INSERT, len - lit) &&
+         put(&p, &image[lit], len - lit);
+  }
+  uint8_t end = (uint8_t)e12_delta_op_t::DELTA_END << 6;
+  ok = ok && put(&p, &end, 1);
+
+  free(chains);
+  free(prev);
+  return ok ? (long)p.n : -1;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_POSIX_E12_DELTA
+#define H_POSIX_E12_DELTA
+
+#include <e12_delta.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Makes an e12 delta patch that rebuilds image from base, to be
+ * applied on the device with e12_delta_feed() and sent with e12::fw_send()
+ * and E12_FW_DELTA.
+ *
+ * Runs on the host: base is indexed in memory, about 4 bytes per base byte
+ * plus 256 KiB.
+ *
+ * @param base running firmware
+ * @param base_len bytes of base
+ * @param base_version version of base, as given to e12::set_fwr_details()
+ * @param image new firmware
+ * @param len bytes of image
+ * @param out patch
+ * @param size size of out
+ * @return long bytes of the patch, negative if it does not fit in size or
+ * memory ran out
+ */
+long e12_delta_make(const uint8_t* base, uint32_t base_len,
+                    uint32_t base_version, const uint8_t* image, uint32_t len,
+                    uint8_t* out, size_t size);
+
+#endif
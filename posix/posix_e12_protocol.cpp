@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "posix_e12_protocol.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_RESP_TIMEOUT 5000
+
+/**
+ * @brief Constructor for e12_posix.
+ *
+ * @param vid Vendor ID.
+ * @param pid Product ID.
+ */
+e12_posix::e12_posix(uint32_t vid, uint32_t pid) : e12(vid, pid) {
+  _transport = NULL;
+  _rx_pos = 0;
+  _rx_len = 0;
+  _evt_count = 0;
+  memset(_log, 0, sizeof(_log));
+}
+
+/**
+ * @brief Destructor for e12_posix.
+ */
+e12_posix::~e12_posix() {}
+
+/**
+ * @brief Attaches to the descriptors given in an e12_posix_bus_t.
+ *
+ * @param bus Pointer to the e12_posix_bus_t.
+ * @param e12_addr unused.
+ * @return int 0 on success, non-zero on failure.
+ */
+int e12_posix::begin(void* bus, uint8_t e12_addr) {
+  e12_posix_bus_t* b = (e12_posix_bus_t*)bus;
+  if (!b) return -1;
+
+  _fd.attach(b->rx_fd, b->tx_fd);
+  return begin(&_fd);
+}
+
+/**
+ * @brief Attaches to the given transport.
+ *
+ * @param transport Pointer to the transport.
+ * @return int 0 on success, non-zero on failure.
+ */
+int e12_posix::begin(e12_transport* transport) {
+  if (!transport || transport->begin() != 0) return -1;
+
+  _transport = transport;
+  _rx_pos = 0;
+  _rx_len = 0;
+  _timeout = MAX_RESP_TIMEOUT;
+  _evt_count = 0;
+  flush_buffer(get_decode_buffer());
+  return 0;
+}
+
+/**
+ * @brief Detaches from the transport.
+ *
+ * @return int 0 on success.
+ */
+int e12_posix::close() {
+  if (_transport) _transport->end();
+  _transport = NULL;
+  return 0;
+}
+
+/**
+ * @brief Gets the monotonic time in milliseconds.
+ *
+ * @return uint32_t Current time in milliseconds.
+ */
+uint32_t e12_posix::get_time_ms() {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/**
+ * @brief Encodes the packet and writes the frame to the transport.
+ *
+ * @param buf Pointer to the packet buffer.
+ * @return int number of bytes written, negative on failure.
+ */
+int e12_posix::send(e12_packet_t* buf, bool retry) {
+  if (!buf) return 0;
+  if (!_transport) return -1;
+
+  e12_onwire_t* req = encode(buf);
+  if (!req) return -1;
+  req->resp_pending = req->data.msg.head.RESP_EXPECTED;
+  req->ts = get_time_ms();
+
+  if (_transport->write(req->buf, req->head.len) < 0) return -1;
+  if (buf->msg.head.RESP_EXPECTED && !buf->msg.head.IS_RESPONSE) {
+    add_pending(buf);
+  }
+  return req->head.len;
+}
+
+/**
+ * @brief Decodes buffered bytes, reading more from the transport
+ * when the buffer runs dry. Never blocks. Pending requests that timed
+ * out are expired, aged log events flushed, unacknowledged firmware
+ * chunks resent and subscribed pins sampled first.
+ *
+ * @return e12_packet_t* Pointer to the read packet, or NULL if no complete
+ * frame is available.
+ */
+e12_packet_t* e12_posix::read() {
+  if (!_transport) return NULL;
+  expire_pending();
+  flush_logs(false);
+  fw_poll();
+  pin_poll();
+
+  while (true) {
+    if (_rx_pos < _rx_len) {
+      size_t used = 0;
+      e12_packet_t* p = decode_one(&_rx_buf[_rx_pos], _rx_len - _rx_pos, &used);
+      _rx_pos += used;
+      if (p) return p;
+    }
+
+    int n = _transport->read(_rx_buf, sizeof(_rx_buf));
+    if (n <= 0) return NULL;
+    _rx_pos = 0;
+    _rx_len = (uint16_t)n;
+  }
+}
+
+/**
+ * @brief Gets a free log event.
+ *
+ * @return e12_log_evt_t* Pointer to the log event.
+ */
+e12_log_evt_t* e12_posix::get_log_evt() {
+  for (int i = 0; i < E12_MAX_LOG_BUFFERS; i++) {
+    if (!_log[i].in_use) {
+      memset(&_log[i], 0, sizeof(e12_log_evt_t));
+      _log[i].in_use = true;
+      _log[i].count = _evt_count++;
+      return &_log[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Logs an event to the peer, batched with others as CMD_LOG_BATCH.
+ *
+ * @param type Type of the event.
+ * @param status Status of the event.
+ * @param ts Timestamp of the event.
+ * @param data optional pointer to an int32_t event value.
+ * @return int 0 on success, non-zero on failure.
+ */
+int e12_posix::log(uint8_t type, uint8_t status, uint32_t ts, void* data) {
+  e12_log_evt_t* evt = get_log_evt();
+  if (!evt) return -1;
+
+  evt->type = type;
+  evt->status = status;
+  evt->ts = ts;
+  if (data) {
+    evt->i_data = *((int32_t*)data);
+    evt->i = true;
+  }
+  int ret = queue_log(evt);
+  evt->in_use = false;
+  return ret;
+}
+
+/**
+ * @brief Callback for configuring the node.
+ *
+ * @param s Pointer to the configuration string.
+ * @param len Length of the configuration string.
+ * @return int true when configured.
+ */
+int e12_posix::on_config(const char* s, int len) { return true; }
+
+/**
+ * @brief Callback for getting the state.
+ *
+ * @param s Pointer to the state string.
+ * @param len Length of the state string.
+ * @param ctx Context pointer.
+ * @return int length of the state written to s.
+ */
+int e12_posix::on_get_state(char* s, int len, void* ctx) {
+  if (len > 0) s[0] = 0;
+  return 0;
+}
+
+/**
+ * @brief Callback for restoring the state.
+ *
+ * @param s Pointer to the state string.
+ * @param len Length of the state string.
+ * @return int 0 on success, non-zero on failure.
+ */
+int e12_posix::on_restore_state(const char* s, int len) { return 0; }
+
+/**
+ * @brief Sends the authentication credentials to the peer.
+ *
+ * @param auth Pointer to the authentication data.
+ * @return int 0 on success, non-zero on failure.
+ */
+int e12_posix::set_node_auth_credentials(e12_auth_data_t* auth) {
+  if (!auth) return -1;
+  // NULL when built without E12_ENABLE_AUTH
+  e12_packet_t* p = get_request(e12_cmd_t::CMD_AUTH, true, (void*)auth);
+  if (!p) return -1;
+  send(p);
+  return 0;
+}
+
+/**
+ * @brief Callback for waking up the node.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int e12_posix::on_wakeup() { return 0; }
+
+/**
+ * @brief Asks the peer to schedule a wakeup, then sleeps for ms.
+ *
+ * @param ms Duration in milliseconds.
+ * @param data unused.
+ * @return int 0 on success, non-zero on failure.
+ */
+int e12_posix::sleep(uint32_t ms, void* data) {
+  if (ms) {
+    e12_wakeup_data_t wakeup = {0};
+    wakeup.ms = ms;
+    send(get_request(e12_cmd_t::CMD_SCHEDULE_WAKEUP, true, (void*)&wakeup));
+
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    while (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) == EINTR) {
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Prints the on-wire bytes of the buffer to stderr.
+ *
+ * @param buf Pointer to the buffer.
+ * @return int 0 on success, non-zero on failure.
+ */
+int e12_posix::print_buffer(e12_onwire_t* buf) {
+  if (!buf) return -1;
+  for (int i = 0; i < buf->head.len && i < E12_MAX_PKT_SIZE; i++) {
+    fprintf(stderr, "%02x%c", buf->buf[i], ((i & 0x0f) == 0x0f) ? '\n' : ' ');
+  }
+  fprintf(stderr, "\n");
+  return 0;
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_POSIX_E12_SPEC
+#define H_POSIX_E12_SPEC
+
+#include <e12_protocol.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "posix_e12_transport.h"
+
+/**
+ * @brief Size of the receive staging buffer used by e12_posix::read()
+ *
+ */
+#define E12_POSIX_RX_BUF_SIZE E12_MAX_PKT_SIZE
+
+/**
+ * @brief File descriptors used by e12_posix as the e12 link.
+ *
+ * For a bidirectional descriptor (socketpair, pty) set rx_fd and tx_fd to
+ * the same value. For pipes use the read end of one pipe and the write end
+ * of the other.
+ */
+typedef struct e12_posix_bus {
+  int rx_fd;  ///< descriptor frames are read from
+  int tx_fd;  ///< descriptor frames are written to
+} e12_posix_bus_t;
+
+/**
+ * @class e12_posix
+ * @brief Host (Linux/POSIX) backend of the e12 protocol.
+ *
+ * The e12_posix class runs the regular e12 encode/decode/request/response
+ * paths over plain file descriptors, using a monotonic clock for time. It
+ * is meant for simulation and benchmarking on a host, e.g two instances
+ * connected through a socketpair() or a pair of e12_loopback_transport
+ * can play VMCU and e12 node.
+ */
+class e12_posix : public e12 {
+ private:
+  e12_fd_transport _fd;                     ///< default descriptor transport
+  e12_transport* _transport;                ///< transport in use
+  uint8_t _rx_buf[E12_POSIX_RX_BUF_SIZE];   ///< bytes read but not decoded
+  uint16_t _rx_pos;                         ///< next byte to decode
+  uint16_t _rx_len;                         ///< valid bytes in _rx_buf
+  uint32_t _evt_count;                      ///< Event count
+  e12_log_evt_t _log[E12_MAX_LOG_BUFFERS];  ///< Log buffer
+
+ public:
+  /**
+   * @brief Constructor for the e12_posix class.
+   * @param vid Vendor ID
+   * @param pid Product ID
+   */
+  e12_posix(uint32_t vid, uint32_t pid);
+
+  /**
+   * @brief Destructor for the e12_posix class.
+   */
+  ~e12_posix();
+
+  // Initialization
+
+  /**
+   * @brief Initializes the link with the given descriptors.
+   * @param bus Pointer to an e12_posix_bus_t
+   * @param e12_addr unused
+   * @return 0 on success, non-zero on failure
+   */
+  virtual int begin(void* bus, uint8_t e12_addr = 0);
+
+  /**
+   * @brief Initializes the link over the given transport.
+   * @param transport e.g an e12_loopback_transport
+   * @return 0 on success, non-zero on failure
+   */
+  int begin(e12_transport* transport);
+
+  /**
+   * @brief Detaches from the transport. Descriptors are not closed.
+   * @return 0 on success
+   */
+  int close();
+
+  // Time
+
+  /**
+   * @brief Gets the monotonic time in milliseconds.
+   * @return Current time in milliseconds
+   */
+  virtual uint32_t get_time_ms();
+
+  // Communication
+
+  /**
+   * @brief Encodes and writes a packet to the transport.
+   * @param buf Pointer to the packet buffer
+   * @param retry unused
+   * @return number of bytes written, negative on failure
+   */
+  virtual int send(e12_packet_t* buf, bool retry = true);
+
+  /**
+   * @brief Reads a packet from the transport without blocking, expiring
+   * timed out pending requests and flushing aged log events first.
+   * @return Pointer to the received packet, or NULL if no complete
+   * frame is available yet
+   */
+  virtual e12_packet_t* read();
+
+  // Event handling
+
+  /**
+   * @brief Gets a free log event.
+   * @return Pointer to the log event, NULL if none available
+   */
+  virtual e12_log_evt_t* get_log_evt();
+
+  /**
+   * @brief Logs an event, see e12::queue_log().
+   * @param type Event type
+   * @param status Event status
+   * @param ts Timestamp
+   * @param data optional pointer to an int32_t event value
+   * @return 0 on success, non-zero on failure
+   */
+  virtual int log(uint8_t type, uint8_t status, uint32_t ts, void* data);
+
+  // Configuration
+
+  virtual int on_config(const char* s, int len);
+  virtual int on_get_state(char* s, int len, void* ctx);
+  virtual int on_restore_state(const char* s, int len);
+  virtual int set_node_auth_credentials(e12_auth_data_t* auth);
+
+  // Power management
+
+  virtual int on_wakeup();
+
+  /**
+   * @brief Schedules a wakeup with the peer and sleeps for ms.
+   * @param ms Sleep duration in milliseconds
+   * @param data unused
+   * @return 0 on success, non-zero on failure
+   */
+  virtual int sleep(uint32_t ms, void* data);
+
+  // Utility
+
+  /**
+   * @brief Dumps the on-wire bytes of the buffer to stderr.
+   * @param buf Pointer to the buffer
+   * @return 0 on success, non-zero on failure
+   */
+  virtual int print_buffer(e12_onwire_t* buf);
+};
+
+#endif
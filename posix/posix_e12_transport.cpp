@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "posix_e12_transport.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define E12_FD_MAX_IOV 8
+
+/**
+ * @brief Constructor for e12_fd_transport.
+ *
+ * @param rx_fd descriptor to read from.
+ * @param tx_fd descriptor to write to.
+ */
+e12_fd_transport::e12_fd_transport(int rx_fd, int tx_fd)
+    : _rx_fd(rx_fd), _tx_fd(tx_fd), _write_timeout(5000) {}
+
+/**
+ * @brief Checks the descriptors are set.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int e12_fd_transport::begin() {
+  return (_rx_fd < 0 || _tx_fd < 0) ? -1 : 0;
+}
+
+/**
+ * @brief Detaches from the descriptors. They are not closed.
+ *
+ * @return int 0 on success.
+ */
+int e12_fd_transport::end() {
+  _rx_fd = -1;
+  _tx_fd = -1;
+  return 0;
+}
+
+/**
+ * @brief Writes all segments with writev(2), retrying partial writes.
+ *
+ * @param iov Array of segments.
+ * @param cnt Number of segments.
+ * @return int number of bytes written, negative on failure.
+ */
+int e12_fd_transport::writev(const e12_iovec_t* iov, uint8_t cnt) {
+  if (_tx_fd < 0 || cnt > E12_FD_MAX_IOV) return -1;
+
+  struct iovec v[E12_FD_MAX_IOV];
+  size_t total = 0;
+  for (uint8_t i = 0; i < cnt; i++) {
+    v[i].iov_base = (void*)iov[i].base;
+    v[i].iov_len = iov[i].len;
+    total += iov[i].len;
+  }
+
+  struct iovec* cur = v;
+  int left = cnt;
+  size_t done = 0;
+  while (done < total) {
+    ssize_t n = ::writev(_tx_fd, cur, left);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        struct pollfd pfd = {_tx_fd, POLLOUT, 0};
+        if (poll(&pfd, 1, _write_timeout) <= 0) return -1;
+        continue;
+      }
+      return -1;
+    }
+    done += n;
+    // skip the segments already written
+    while (left && (size_t)n >= cur->iov_len) {
+      n -= cur->iov_len;
+      cur++;
+      left--;
+    }
+    if (left) {
+      cur->iov_base = (uint8_t*)cur->iov_base + n;
+      cur->iov_len -= n;
+    }
+  }
+  return (int)total;
+}
+
+/**
+ * @brief Reads whatever is pending on the rx descriptor. Never blocks.
+ *
+ * @param buf Destination buffer.
+ * @param len Size of buf.
+ * @return int number of bytes copied, negative on failure.
+ */
+int e12_fd_transport::read(uint8_t* buf, uint8_t len) {
+  if (_rx_fd < 0) return -1;
+
+  struct pollfd pfd = {_rx_fd, POLLIN, 0};
+  if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN)) return 0;
+
+  ssize_t n = ::read(_rx_fd, buf, len);
+  if (n < 0) return (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+  return (int)n;
+}
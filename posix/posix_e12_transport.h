@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_POSIX_E12_TRANSPORT
+#define H_POSIX_E12_TRANSPORT
+
+#include <e12_transport.h>
+#include <stdint.h>
+
+/**
+ * @class e12_fd_transport
+ * @brief Transport over POSIX file descriptors (socketpair, pipe, pty).
+ */
+class e12_fd_transport : public e12_transport {
+ private:
+  int _rx_fd;            ///< descriptor to read from
+  int _tx_fd;            ///< descriptor to write to
+  int _write_timeout;    ///< ms to wait for a full descriptor to drain
+
+ public:
+  /**
+   * @brief Constructor for the e12_fd_transport class.
+   * @param rx_fd descriptor to read from
+   * @param tx_fd descriptor to write to, same as rx_fd if bidirectional
+   */
+  e12_fd_transport(int rx_fd = -1, int tx_fd = -1);
+
+  /**
+   * @brief Sets the descriptors, used before begin().
+   * @param rx_fd descriptor to read from
+   * @param tx_fd descriptor to write to
+   */
+  void attach(int rx_fd, int tx_fd) {
+    _rx_fd = rx_fd;
+    _tx_fd = tx_fd;
+  }
+
+  /**
+   * @brief Sets how long writev() waits on a full descriptor.
+   * @param ms timeout in milliseconds
+   */
+  void set_write_timeout(int ms) { _write_timeout = ms; }
+
+  virtual int begin();
+  virtual int end();
+  virtual int writev(const e12_iovec_t* iov, uint8_t cnt);
+  virtual int read(uint8_t* buf, uint8_t len);
+};
+
+#endif
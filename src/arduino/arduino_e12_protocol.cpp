@@ -1,5 +1,6 @@
 #include "arduino_e12_protocol.h"
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "Arduino.h"
@@ -8,24 +9,36 @@
 #define MAX_RESP_TIMEOUT 5000
 #define DEBUG 1
 
-e12_arduino::e12_arduino(uint32_t vid, uint32_t pid) : e12(vid, pid) {}
+e12_arduino::e12_arduino(uint32_t vid, uint32_t pid) : e12(vid, pid) {
+  _transport = NULL;
+  _rx_pos = 0;
+  _rx_len = 0;
+  _blocking = true;
+  _rx_ready = false;
+  _split_read = E12_I2C_SPLIT_READ;
+#if E12_BATCH
+  _batch_cnt = 0;
+  _batching = false;
+#endif
+}
 
 e12_arduino::~e12_arduino() {}
 
 int e12_arduino::begin(void* bus, uint8_t e12_addr) {
-  _bus = (TwoWire*)bus;
-  _e12_addr = e12_addr;
+  _i2c.attach((TwoWire*)bus, e12_addr);
+  return begin(&_i2c);
+}
+
+int e12_arduino::begin(e12_transport* transport) {
+  if (!transport) return -1;
+  _transport = transport;
   _timeout = MAX_RESP_TIMEOUT;
   _evt_count = 0;
 
-#ifdef ARDUINO_RASPBERRY_PI_PICO
-  _bus->setSDA(20);
-  _bus->setSCL(21);
-#endif
-
-  _bus->begin();
-  _bus->setClock(400000UL); 
-  // _bus->setClock(1000000UL);  // experimenting with 1Mhz speed
+  if (_transport->begin() != 0) return -1;
+  flush_buffer(get_decode_buffer());
+  _rx_pos = 0;
+  _rx_len = 0;
 
   // good time to make sure that e12 node is awake
   set_node_status(e12_node_op_status_t::STATUS_ACTIVE, 0);
@@ -33,7 +46,8 @@ int e12_arduino::begin(void* bus, uint8_t e12_addr) {
 }
 
 int e12_arduino::close() {
-  _bus->end();
+  if (!_transport) return -1;
+  _transport->end();
   return 0;
 }
 
@@ -41,7 +55,10 @@ uint32_t e12_arduino::get_time_ms() { return millis(); }
 
 int e12_arduino::set_node_auth_credentials(e12_auth_data_t* auth) {
   if (!auth) return -1;
-  send(get_request(e12_cmd_t::CMD_AUTH, true, (void*)auth));
+  // NULL when built without E12_ENABLE_AUTH
+  e12_packet_t* p = get_request(e12_cmd_t::CMD_AUTH, true, (void*)auth);
+  if (!p) return -1;
+  send(p);
   return 0;
 }
 
@@ -67,26 +84,66 @@ int e12_arduino::sleep(uint32_t ms, void* data) {
 
 int e12_arduino::send(e12_packet_t* buf, bool retry) {
   if (!buf) return 0;
-  if (get_node_status() == e12_node_op_status_t::STATUS_SLEEP) {
-    if (retry) {
-      // TODO: based on available memory
-      // we could buffer these packets and send when
-      // the e12 node is awake.
-      
-      // typically e12-node should wake up and become
-      // operational in less than 300ms
-      wakeup_e12_node();
-      delay(250);
-    } else {
-      return (int)e12_err_t::ERR_RETRY_LATER;
+  bool asleep = get_node_status() == e12_node_op_status_t::STATUS_SLEEP;
+  if (asleep && !retry) {
+    return (int)e12_err_t::ERR_RETRY_LATER;
+  }
+
+#if E12_BATCH
+  e12_packet_t tmp;
+  if (_batching && buf != &_batch) {
+    bool added = batch_add(&_batch, buf);
+    if (!added) {
+      // full: the batch is written through the encode buffer, which
+      // typically holds buf, so keep a copy to retry in an empty batch
+      memcpy(&tmp, buf, buf->msg.head.len);
+      buf = &tmp;
+      flush_batch();
+      added = batch_add(&_batch, buf);
+    }
+    if (added) {
+      _batch_cnt++;
+      if (buf->msg.head.RESP_EXPECTED && !buf->msg.head.IS_RESPONSE) {
+        add_pending(buf);
+      }
+      return buf->msg.head.len;
     }
+    // too big to share a frame, it goes out on its own
   }
+#endif
 
   e12_onwire_t* req = encode(buf);
+  if (!req) return -1;
   req->resp_pending = req->data.msg.head.RESP_EXPECTED;
   req->ts = millis();
 
-  _bus->beginTransmission(_e12_addr);
+#if E12_TX_QUEUE_SIZE
+  // keep the order: anything queued goes out first
+  if (!asleep && !_tx_queue.empty() && flush_tx_queue() < 0) {
+    asleep = true;
+  }
+  if (asleep) {
+    if (queue_frame(req) == 0) {
+      if (buf->msg.head.RESP_EXPECTED && !buf->msg.head.IS_RESPONSE) {
+        // the timeout starts when flush_tx_queue() writes it
+        int seq = add_pending(buf);
+        if (seq >= 0) hold_pending(seq);
+      }
+      return req->head.len;
+    }
+  }
+#endif
+
+  if (get_node_status() == e12_node_op_status_t::STATUS_SLEEP) {
+    if (!_blocking) return (int)e12_err_t::ERR_RETRY_LATER;
+    // queue full (or disabled): typically e12-node should wake up
+    // and become operational in less than 300ms
+    wakeup_e12_node();
+    delay(250);
+#if E12_TX_QUEUE_SIZE
+    flush_tx_queue();
+#endif
+  }
 
 #if 0
   E12_PRINT_F("Sending Request cmd: %d", (int)buf->msg.head.cmd);
@@ -98,38 +155,257 @@ int e12_arduino::send(e12_packet_t* buf, bool retry) {
 
   E12_PRINT_F("Sending Request cmd/len: %d:%d", (int)(req->data.msg.head.cmd),
               req->head.len);
-  _bus->write(req->buf, req->head.len);
-  if (_bus->endTransmission() != 0) {
+  if (_transport->write(req->buf, req->head.len) < 0) {
     return -1;
   }
+  if (buf->msg.head.RESP_EXPECTED && !buf->msg.head.IS_RESPONSE) {
+    add_pending(buf);
+  }
   return req->head.len;
 }
 
-e12_packet_t* e12_arduino::read() {
-  int num = _bus->requestFrom(_e12_addr, (uint8_t)sizeof(e12_onwire_t));
-#if 0
-  E12_PRINT_F("e12_arduino::read(): %d", num);
+void e12_arduino::begin_batch() {
+#if E12_BATCH
+  if (!_batching) {
+    batch_init(&_batch);
+    _batch_cnt = 0;
+    _batching = true;
+  }
+#endif
+}
+
+int e12_arduino::end_batch() {
+  int ret = flush_batch();
+#if E12_BATCH
+  _batching = false;
+#endif
+  return ret;
+}
+
+int e12_arduino::flush_batch() {
+  int ret = 0;
+#if E12_BATCH
+  if (!_batching || !_batch_cnt) return 0;
+  if (_batch_cnt == 1) {
+    // a lone packet goes out as it is, no CMD_BATCH wrapper
+    e12_packet_t* p = (e12_packet_t*)&_batch.msg.data[0];
+    _batching = false;
+    ret = send(p);
+    _batching = true;
+  } else {
+    ret = send(&_batch);
+  }
+  batch_init(&_batch);
+  _batch_cnt = 0;
 #endif
-  if (!num) return NULL;
+  return ret;
+}
+
+int e12_arduino::send_async(e12_packet_t* buf, e12_resp_cb_t cb, void* ctx) {
+  if (!buf) return -1;
+  e12_onwire_t* req = encode(buf);
+  if (!req) return -1;
+  req->resp_pending = req->data.msg.head.RESP_EXPECTED;
+  req->ts = millis();
+
+  int seq = add_pending(buf, cb, ctx);
+  if (seq < 0) return (int)e12_err_t::ERR_RETRY_LATER;
+
+#if E12_TX_QUEUE_SIZE
+  if (queue_frame(req) != 0) {
+    cancel_pending(seq);
+    return (int)e12_err_t::ERR_RETRY_LATER;
+  }
+  hold_pending(seq);
+  // written by e12_run() unless the node is already awake
+  if (get_node_status() != e12_node_op_status_t::STATUS_SLEEP) {
+    flush_tx_queue();
+  }
+#else
+  if (get_node_status() == e12_node_op_status_t::STATUS_SLEEP) {
+    cancel_pending(seq);
+    return (int)e12_err_t::ERR_RETRY_LATER;
+  }
+  if (_transport->write(req->buf, req->head.len) < 0) {
+    cancel_pending(seq);
+    return (int)e12_err_t::ERR_BUS;
+  }
+  if (!buf->msg.head.RESP_EXPECTED) end_pending(seq, e12_err_t::ERR_NONE);
+#endif
+  return seq;
+}
+
+#if E12_TX_QUEUE_SIZE
+int e12_arduino::queue_frame(e12_onwire_t* req) {
+  bool was_empty = _tx_queue.empty();
+  if (!_tx_queue.push(req->buf, req->head.len)) return -1;
 
-  e12_onwire_t* f = get_decode_buffer();
-  flush_buffer(f);
-  e12_packet_t* p = NULL;
-  while (_bus->available()) {
-    uint8_t c = _bus->read();
+  E12_PRINT_F("Queued cmd/len: %d:%d", (int)(req->data.msg.head.cmd),
+              req->head.len);
+  // one wakeup pulse per sleep, CMD_NODE_AWAKE drains the queue
+  if (was_empty) wakeup_e12_node();
+  return 0;
+}
+#endif
+
+int e12_arduino::flush_tx_queue() {
+  int frames = 0;
+#if E12_TX_QUEUE_SIZE
+  while (!_tx_queue.empty()) {
+    // every queued entry is a complete frame, head.len is its third byte
+    uint8_t len = _tx_queue.peek(offsetof(e12_onwire_head_t, len));
+    e12_header_t head;
+    for (uint8_t i = 0; i < sizeof(head); i++) {
+      ((uint8_t*)&head)[i] = _tx_queue.peek(sizeof(e12_onwire_head_t) + i);
+    }
+
+    e12_iovec_t iov[2];
+    uint8_t cnt = _tx_queue.segments(iov, len);
+    int ret = _transport->writev(iov, cnt);
+    // a frame the bus refused is dropped, it would block the queue forever
+    _tx_queue.drop(len);
+    if (ret < 0) {
+      end_pending(head.seq, e12_err_t::ERR_BUS);
+      return -1;
+    }
+    if (!head.RESP_EXPECTED) {
+      end_pending(head.seq, e12_err_t::ERR_NONE);
+    } else {
+      start_pending(head.seq);
+    }
+    frames++;
+  }
+#endif
+  return frames;
+}
+
+uint16_t e12_arduino::get_tx_queued() {
+#if E12_TX_QUEUE_SIZE
+  return _tx_queue.count();
+#else
+  return 0;
+#endif
+}
+
+uint16_t e12_arduino::get_tx_room() {
+  bool asleep = get_node_status() == e12_node_op_status_t::STATUS_SLEEP;
+#if E12_TX_QUEUE_SIZE
+  // awake, send() writes what is queued and then the frame itself
+  if (asleep) return _tx_queue.space();
+#else
+  // send() fails instead of waiting for the node
+  if (asleep && !_blocking) return 0;
+#endif
+  return 0xFFFF;
+}
+
+int e12_arduino::on_receive(e12_packet_t* p) {
+  if (!p) return -1;
+  int ret = e12::on_receive(p);
+  if (p->msg.head.cmd == e12_cmd_t::CMD_NODE_AWAKE) {
+    flush_tx_queue();
+  }
+  return ret;
+}
+
+bool e12_arduino::read_split(e12_packet_t** p) {
+  e12_onwire_head_t head;
+  uint8_t* h = (uint8_t*)&head;
+  *p = NULL;
+  if (_transport->request(sizeof(head)) < (int)sizeof(head)) return true;
+  if (_transport->read(h, sizeof(head)) != (int)sizeof(head)) return true;
+
+  flush_buffer(get_decode_buffer());
+  _rx_pos = 0;
+  _rx_len = 0;
+
+  if (head.magic[0] != E12_MAGIC_MARKER_1 || head.len < E12_MIN_FRAME_LEN ||
+      head.len > E12_MAX_FRAME_LEN) {
+    // nothing staged, the idle node reads as 0xff
+    if (h[0] == h[1] && h[1] == h[2] && h[2] == h[3]) return true;
+    // the node holds the tail of a frame, a full read drains it
+    return false;
+  }
+
+  size_t used = 0;
+  decode_one(h, sizeof(head), &used);
+  uint8_t rest = head.len - sizeof(head);
+  if (_transport->request(rest) < rest) return true;
+
+  while (rest) {
+    int n = _transport->read(_rx_buf, rest < sizeof(_rx_buf)
+                                          ? rest : sizeof(_rx_buf));
+    if (n <= 0) break;
+    rest -= n;
+    *p = decode_one(_rx_buf, n, &used);
+    if (*p) break;
+  }
+  return true;
+}
+
+e12_packet_t* e12_arduino::read() {
+  if (!_transport->is_stream()) {
+    e12_packet_t* p = NULL;
+    if (_split_read && read_split(&p)) return p;
+
+    // every request clocks in a new frame
+    int num = _transport->request((uint8_t)sizeof(e12_onwire_t));
 #if 0
-    Serial.print((uint8_t)c);
+    E12_PRINT_F("e12_arduino::read(): %d", num);
 #endif
-    if ((p = decode(f, c))) {
-      //while (_bus->available()) _bus->read();
-      return p;
+    if (num <= 0) return NULL;
+    flush_buffer(get_decode_buffer());
+    _rx_pos = 0;
+    _rx_len = 0;
+  }
+
+  while (true) {
+    if (_rx_pos < _rx_len) {
+      size_t used = 0;
+      e12_packet_t* p = decode_one(&_rx_buf[_rx_pos], _rx_len - _rx_pos, &used);
+      _rx_pos += used;
+      if (p) return p;
     }
+
+    int n = _transport->read(_rx_buf, sizeof(_rx_buf));
+    if (n <= 0) return NULL;
+    _rx_pos = 0;
+    _rx_len = n;
+  }
+}
+
+void e12_arduino::handle(e12_packet_t* p) {
+  if (!p) return;
+  on_receive(p);
+  // with E12_HALF_DUPLEX a request sent while handling p may have taken
+  // its buffer, the peer then times out
+  if (!p->msg.head.IS_RESPONSE && !rx_overwritten(p)) {
+    send(get_response(p), true);
   }
-  return NULL;
 }
 
 void e12_arduino::e12_run() {
-  if (!is_configured()) {
+  if (!_transport) return;
+  if (get_node_status() != e12_node_op_status_t::STATUS_SLEEP &&
+      get_tx_queued()) {
+    flush_tx_queue();
+  }
+
+  if (_transport->is_stream()) {
+    e12_packet_t* p;
+    while ((p = read()) != NULL) handle(p);
+  } else if (_rx_ready) {
+    // every read clocks a full transaction, one per notification
+    _rx_ready = false;
+    handle(read());
+  }
+
+  expire_pending();
+  flush_logs(false);
+  fw_poll();
+  pin_poll();
+  // one CONFIG request at a time, not one per call
+  if (!is_configured() && !is_pending(e12_cmd_t::CMD_CONFIG)) {
     send(get_request(e12_cmd_t::CMD_CONFIG));
   }
 }
@@ -21,12 +21,48 @@
 
 #include <Wire.h>
 #include <e12_protocol.h>
+#include <e12_ring.h>
 #include <stdint.h>
 
+#include "arduino_e12_transport.h"
+
 #if !defined(__AVR__)
 using namespace arduino;
 #endif
 
+/**
+ * @brief Bytes pulled from the transport per read
+ */
+#define E12_RX_CHUNK_SIZE 16
+
+/**
+ * @brief Read I2C frames in two transactions: the onwire head first, then
+ * only the head.len - 4 bytes of the frame instead of a full 128 bytes.
+ */
+#ifndef E12_I2C_SPLIT_READ
+#define E12_I2C_SPLIT_READ 1
+#endif
+
+/**
+ * @brief Enables begin_batch()/end_batch(), costs one e12_packet_t of RAM
+ */
+#ifndef E12_BATCH
+#if defined(__AVR__)
+#define E12_BATCH 0
+#else
+#define E12_BATCH 1
+#endif
+#endif
+
+/**
+ * @brief Bytes of encoded frames held while the e12 node sleeps, a power
+ * of two, e.g 128 on AVR. 0 disables the queue, sends then wake the node
+ * and wait for it.
+ */
+#ifndef E12_TX_QUEUE_SIZE
+#define E12_TX_QUEUE_SIZE 0
+#endif
+
 /**
  * @brief Structure to hold event data.
  */
@@ -39,10 +75,46 @@ typedef struct e12_event {
  */
 class e12_arduino : public e12 {
  private:
-  uint8_t _e12_addr;      ///< e12 device address
-  TwoWire* _bus;  ///< I2C bus
+  e12_i2c_transport _i2c;     ///< default I2C transport
+  e12_transport* _transport;  ///< transport in use
+  uint8_t _rx_buf[E12_RX_CHUNK_SIZE];  ///< bytes read but not decoded
+  uint8_t _rx_pos;                     ///< next byte to decode
+  uint8_t _rx_len;                     ///< valid bytes in _rx_buf
   uint32_t _evt_count;                      ///< Event count
   e12_log_evt_t _log[E12_MAX_LOG_BUFFERS];  ///< Log buffer
+  bool _blocking;             ///< send() may wait for the node to wake up
+  bool _split_read;           ///< clock the head, then the rest of a frame
+  volatile bool _rx_ready;    ///< a frame is waiting on the transport
+  /**
+   * @brief Read one frame over a master clocked bus, the onwire head
+   * first and then exactly the rest of the frame.
+   * @param p Set to the packet, NULL if none was staged
+   * @return bool false if the node is out of step and a full read is needed
+   */
+  bool read_split(e12_packet_t** p);
+
+  /**
+   * @brief Handle a received frame and answer it if it is a request.
+   * @param p Packet read, NULL for none
+   */
+  void handle(e12_packet_t* p);
+
+#if E12_BATCH
+  e12_packet_t _batch;  ///< CMD_BATCH being filled
+  uint8_t _batch_cnt;   ///< packets in _batch
+  bool _batching;       ///< send() appends to _batch
+#endif
+
+#if E12_TX_QUEUE_SIZE
+  e12_ring<E12_TX_QUEUE_SIZE> _tx_queue;  ///< frames sent while node sleeps
+
+  /**
+   * @brief Queue the encoded frame until the e12 node is awake.
+   * @param req encoded frame
+   * @return int 0 if queued, -1 if the queue is full
+   */
+  int queue_frame(e12_onwire_t* req);
+#endif
 
  public:
   /**
@@ -66,10 +138,41 @@ class e12_arduino : public e12 {
   virtual int begin(void* bus, uint8_t e12_addr = 0);
 
   /**
-   * @brief Run the e12 protocol.
+   * @brief Initialize the e12 device over the given transport e.g UART.
+   * @param transport transport to the e12 node
+   * @return int Status of initialization
+   */
+  int begin(e12_transport* transport);
+
+  /**
+   * @brief Run the e12 protocol: writes queued frames, reads and handles
+   * received frames, answers received requests, expires requests that timed out and flushes log
+   * events that waited too long. Response, timeout
+   * and bus error callbacks are called from here.
    */
   void e12_run();
 
+  /**
+   * @brief Tell e12_run() a frame is waiting, e.g from the e12 node
+   * interrupt handler. Streams (UART) are polled without it.
+   */
+  void notify_rx() { _rx_ready = true; }
+
+  /**
+   * @brief Choose what send() does while the e12 node sleeps and the
+   * transmit queue is full.
+   * @param blocking true (default) to wake the node and wait for it,
+   * false to return ERR_RETRY_LATER right away
+   */
+  void set_blocking(bool blocking) { _blocking = blocking; }
+
+  /**
+   * @brief Choose how frames are read over I2C.
+   * @param split true (default) to read the 4 byte onwire head and then
+   * head.len - 4 bytes, false to always clock a full e12_onwire_t
+   */
+  void set_split_read(bool split) { _split_read = split; }
+
   /**
    * @brief Close the e12 device.
    * @return int Status of close operation
@@ -89,12 +192,70 @@ class e12_arduino : public e12 {
    */
   virtual int send(e12_packet_t* buf, bool retry = true);
 
+  /**
+   * @brief Collect the following sends into CMD_BATCH super-frames, each
+   * one written as a single bus transaction. A full batch is written and a
+   * new one started, end_batch() writes the last one. The node answers
+   * the batched requests in one CMD_BATCH response.
+   */
+  void begin_batch();
+
+  /**
+   * @brief Write the pending batch and go back to one frame per send.
+   * @return int Status of the send operation, 0 if nothing was batched
+   */
+  int end_batch();
+
+  /**
+   * @brief Write the pending batch, batching stays on.
+   * @return int Status of the send operation, 0 if nothing was batched
+   */
+  int flush_batch();
+
+  /**
+   * @brief Send a packet without blocking. The result is reported to cb
+   * from e12_run(): the response, ERR_TIMEOUT or ERR_BUS. Requests that
+   * expect no response complete with ERR_NONE once written.
+   * @param buf Packet buffer
+   * @param cb Completion callback
+   * @param ctx Passed to cb
+   * @return int request handle (head.seq), negative e12_err_t on failure
+   */
+  int send_async(e12_packet_t* buf, e12_resp_cb_t cb, void* ctx = 0);
+
   /**
    * @brief Read a packet from the e12 device.
    * @return e12_packet_t* Pointer to the packet
    */
   virtual e12_packet_t* read();
 
+  /**
+   * @brief Handle the received packet, drains the transmit queue once the
+   * e12 node reports it is awake.
+   * @param p Received packet
+   * @return int 0 on success, non-zero on failure
+   */
+  virtual int on_receive(e12_packet_t* p);
+
+  /**
+   * @brief Write the frames queued while the e12 node was asleep.
+   * @return int number of frames written, negative on failure
+   */
+  int flush_tx_queue();
+
+  /**
+   * @brief Get the number of queued bytes.
+   * @return uint16_t bytes waiting for the e12 node to wake up
+   */
+  uint16_t get_tx_queued();
+
+  /**
+   * @brief Get the bytes send() takes without blocking: the free queue
+   * while the e12 node sleeps, unlimited otherwise.
+   * @return uint16_t free bytes, 0xFFFF if frames go straight to the bus
+   */
+  virtual uint16_t get_tx_room();
+
   /**
    * @brief Get the log event.
    * @return e12_log_evt_t* Pointer to the log event
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "arduino_e12_transport.h"
+
+#include <stdint.h>
+
+e12_i2c_transport::e12_i2c_transport(TwoWire* bus, uint8_t addr,
+                                     uint32_t clock)
+    : _bus(bus), _addr(addr), _clock(clock) {}
+
+int e12_i2c_transport::begin() {
+  if (!_bus) return -1;
+
+#ifdef ARDUINO_RASPBERRY_PI_PICO
+  _bus->setSDA(20);
+  _bus->setSCL(21);
+#endif
+
+  _bus->begin();
+  _bus->setClock(_clock);
+  // _bus->setClock(1000000UL);  // experimenting with 1Mhz speed
+  return 0;
+}
+
+int e12_i2c_transport::end() {
+  _bus->end();
+  return 0;
+}
+
+int e12_i2c_transport::writev(const e12_iovec_t* iov, uint8_t cnt) {
+  int total = 0;
+  _bus->beginTransmission(_addr);
+  for (uint8_t i = 0; i < cnt; i++) {
+    total += _bus->write(iov[i].base, iov[i].len);
+  }
+  if (_bus->endTransmission() != 0) {
+    return -1;
+  }
+  return total;
+}
+
+int e12_i2c_transport::request(uint8_t len) {
+  return _bus->requestFrom(_addr, len);
+}
+
+int e12_i2c_transport::read(uint8_t* buf, uint8_t len) {
+  uint8_t n = 0;
+  while (n < len && _bus->available()) {
+    buf[n++] = (uint8_t)_bus->read();
+  }
+  return n;
+}
+
+e12_uart_transport::e12_uart_transport(HardwareSerial* port, uint32_t baud)
+    : _port(port), _baud(baud) {}
+
+int e12_uart_transport::begin() {
+  if (!_port) return -1;
+  if (_baud) _port->begin(_baud);
+  return 0;
+}
+
+int e12_uart_transport::end() {
+  if (_baud) _port->end();
+  return 0;
+}
+
+int e12_uart_transport::writev(const e12_iovec_t* iov, uint8_t cnt) {
+  int total = 0;
+  for (uint8_t i = 0; i < cnt; i++) {
+    total += _port->write(iov[i].base, iov[i].len);
+  }
+  return total;
+}
+
+int e12_uart_transport::read(uint8_t* buf, uint8_t len) {
+  uint8_t n = 0;
+  while (n < len && _port->available() > 0) {
+    buf[n++] = (uint8_t)_port->read();
+  }
+  return n;
+}
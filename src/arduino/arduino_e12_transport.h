@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARDUINO_E12_TRANSPORT_H
+#define ARDUINO_E12_TRANSPORT_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <e12_transport.h>
+#include <stdint.h>
+
+#if !defined(__AVR__)
+using namespace arduino;
+#endif
+
+#define E12_I2C_CLOCK 400000UL
+#define E12_UART_BAUD 1000000UL
+
+/**
+ * @brief I2C master transport, the VMCU clocks frames from the e12 node.
+ */
+class e12_i2c_transport : public e12_transport {
+ private:
+  TwoWire* _bus;      ///< I2C bus
+  uint8_t _addr;      ///< e12 node address
+  uint32_t _clock;    ///< bus clock in Hz
+
+ public:
+  /**
+   * @brief Constructor for e12_i2c_transport.
+   * @param bus I2C bus
+   * @param addr e12 node address
+   * @param clock bus clock in Hz
+   */
+  e12_i2c_transport(TwoWire* bus = NULL, uint8_t addr = 0,
+                    uint32_t clock = E12_I2C_CLOCK);
+
+  /**
+   * @brief Set the bus and address, used before begin().
+   * @param bus I2C bus
+   * @param addr e12 node address
+   */
+  void attach(TwoWire* bus, uint8_t addr) {
+    _bus = bus;
+    _addr = addr;
+  }
+
+  virtual int begin();
+  virtual int end();
+  virtual int writev(const e12_iovec_t* iov, uint8_t cnt);
+  virtual int request(uint8_t len);
+  virtual int read(uint8_t* buf, uint8_t len);
+  virtual bool is_stream() { return false; }
+};
+
+/**
+ * @brief UART transport, frames are sent as a plain byte stream.
+ */
+class e12_uart_transport : public e12_transport {
+ private:
+  HardwareSerial* _port;  ///< serial port
+  uint32_t _baud;         ///< baud rate, 0 if the port is set up by the caller
+
+ public:
+  /**
+   * @brief Constructor for e12_uart_transport.
+   * @param port Serial port e.g Serial1
+   * @param baud baud rate, 0 to leave the port configuration untouched
+   */
+  e12_uart_transport(HardwareSerial* port, uint32_t baud = E12_UART_BAUD);
+
+  virtual int begin();
+  virtual int end();
+  virtual int writev(const e12_iovec_t* iov, uint8_t cnt);
+  virtual int read(uint8_t* buf, uint8_t len);
+};
+
+#endif
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "e12_delta.h"
+
+#include <string.h>
+
+// The patch may be split anywhere, so every field is read a byte at a time
+// through the states below and resumed on the next e12_delta_feed().
+
+enum delta_state_t : uint8_t {
+  S_HEAD = 0,  // reading e12_delta_header_t
+  S_OP,        // expecting an op byte
+  S_LEN,       // reading the varint length of op
+  S_OFF,       // reading the varint offset of a DELTA_COPY
+  S_INSERT,    // passing len bytes through
+  S_DONE,
+  S_ERROR
+};
+
+static int fail(e12_delta_t* d) {
+  d->state = S_ERROR;
+  return -1;
+}
+
+static int emit(e12_delta_t* d, const uint8_t* buf, uint8_t len) {
+  if (len > d->head.size - d->out) return -1;
+  if (d->write(d->out, buf, len, d->ctx) < 0) return -1;
+  e12::sha256_update(&d->sha, buf, len);
+  d->out += len;
+  return 0;
+}
+
+static int copy(e12_delta_t* d, int32_t rel) {
+  uint32_t off = d->src + (uint32_t)rel;
+  if (off > d->base_size || d->len > d->base_size - off) return -1;
+  uint8_t buf[E12_DELTA_COPY_BUF];
+  while (d->len) {
+    uint8_t n = d->len < sizeof(buf) ? d->len : sizeof(buf);
+    if (d->read(off, buf, n, d->ctx) < 0 || emit(d, buf, n) < 0) return -1;
+    off += n;
+    d->len -= n;
+  }
+  d->src = off;
+  return 0;
+}
+
+// the length of op is known
+static void start_op(e12_delta_t* d) {
+  if (d->op == (uint8_t)e12_delta_op_t::DELTA_COPY) {
+    d->v = 0;
+    d->shift = 0;
+    d->state = S_OFF;
+  } else {
+    d->state = d->len ? S_INSERT : S_OP;
+  }
+}
+
+static int finish(e12_delta_t* d) {
+  uint8_t digest[E12_SHA256_LEN];
+  if (d->out != d->head.size) return fail(d);
+  e12::sha256_final(&d->sha, digest);
+  if (memcmp(digest, d->head.sha256, E12_SHA256_LEN)) return fail(d);
+  d->state = S_DONE;
+  return 1;
+}
+
+/**
+ * @brief Prepare to apply a delta patch
+ *
+ * @param d State to initialise
+ * @param base_version Version of the running firmware, 0 to not check
+ * @param base_size Bytes of the running firmware
+ * @param read Reads the running firmware
+ * @param write Writes the rebuilt image
+ * @param ctx Passed to read and write
+ */
+void e12_delta_begin(e12_delta_t* d, uint32_t base_version,
+                     uint32_t base_size, e12_delta_read_t read,
+                     e12_delta_write_t write, void* ctx) {
+  memset(d, 0, sizeof(e12_delta_t));
+  d->read = read;
+  d->write = write;
+  d->ctx = ctx;
+  d->base_version = base_version;
+  d->base_size = base_size;
+  d->state = S_HEAD;
+  e12::sha256_init(&d->sha);
+}
+
+/**
+ * @brief Apply the next bytes of a delta patch
+ *
+ * @param d State from e12_delta_begin()
+ * @param buf Patch bytes
+ * @param len Number of bytes
+ * @return int 0 if more is needed, 1 when done, negative on failure
+ */
+int e12_delta_feed(e12_delta_t* d, const uint8_t* buf, uint32_t len) {
+  while (len) {
+    switch (d->state) {
+      case S_HEAD: {
+        uint8_t n = sizeof(d->head) - d->pos;
+        if (n > len) n = len;
+        memcpy((uint8_t*)&d->head + d->pos, buf, n);
+        d->pos += n;
+        buf += n;
+        len -= n;
+        if (d->pos < sizeof(d->head)) break;
+        if (d->head.magic != E12_DELTA_MAGIC ||
+            d->head.base_size != d->base_size ||
+            (d->base_version && d->head.base_version != d->base_version)) {
+          return fail(d);
+        }
+        d->state = S_OP;
+      } break;
+      case S_OP: {
+        uint8_t b = *buf++;
+        len--;
+        d->op = b >> 6;
+        if (d->op == (uint8_t)e12_delta_op_t::DELTA_END) return finish(d);
+        if (d->op > (uint8_t)e12_delta_op_t::DELTA_END) return fail(d);
+        d->len = b & 0x3F;
+        if (d->len) {
+          start_op(d);
+        } else {
+          d->v = 0;
+          d->shift = 0;
+          d->state = S_LEN;
+        }
+      } break;
+      case S_LEN:
+      case S_OFF: {
+        uint8_t b = *buf++;
+        len--;
+        if (d->shift > 28) return fail(d);
+        d->v |= (uint32_t)(b & 0x7F) << d->shift;
+        d->shift += 7;
+        if (b & 0x80) break;
+        if (d->state == S_LEN) {
+          d->len = d->v;
+          start_op(d);
+        } else {
+          if (copy(d, e12_unzigzag(d->v)) < 0) return fail(d);
+          d->state = S_OP;
+        }
+      } break;
+      case S_INSERT: {
+        uint32_t n = d->len < len ? d->len : len;
+        if (n > 0xFF) n = 0xFF;
+        if (emit(d, buf, n) < 0) return fail(d);
+        buf += n;
+        len -= n;
+        d->len -= n;
+        if (!d->len) d->state = S_OP;
+      } break;
+      case S_DONE:
+        return 1;
+      default:
+        return -1;
+    }
+  }
+  return d->state == S_DONE ? 1 : (d->state == S_ERROR ? -1 : 0);
+}
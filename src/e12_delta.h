@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_E12_DELTA
+#define H_E12_DELTA
+
+#include <stdint.h>
+
+#include "e12_protocol.h"
+
+// An e12 delta patch rebuilds a firmware image from the running one:
+//
+//   e12_delta_header_t
+//   ops       until DELTA_END
+//
+// An op is one byte, the type in the top 2 bits and the length in the low
+// 6 bits, 0 meaning a varint length follows.
+//
+//   DELTA_COPY    zigzag varint offset in the base, relative to the end of
+//                 the previous copy, then len bytes are copied from there
+//   DELTA_INSERT  len bytes of the image follow
+//   DELTA_END     no length, the image is complete
+
+#define E12_DELTA_MAGIC 0x44323145UL  ///< "E12D" little endian
+
+/**
+ * @brief stack bytes e12_delta_feed() copies the base through at a time
+ *
+ */
+#ifndef E12_DELTA_COPY_BUF
+#define E12_DELTA_COPY_BUF 32
+#endif
+
+enum class e12_delta_op_t : uint8_t {
+  DELTA_COPY = 0,
+  DELTA_INSERT,
+  DELTA_END
+};
+
+/**
+ * @brief Start of a delta patch
+ *
+ */
+typedef struct __attribute__((packed, aligned(4))) e12_delta_header {
+  uint32_t magic;         ///< E12_DELTA_MAGIC
+  uint32_t base_version;  ///< firmware the patch applies to
+  uint32_t base_size;     ///< bytes of that firmware
+  uint32_t size;          ///< bytes of the rebuilt image
+  uint8_t sha256[E12_SHA256_LEN];  ///< of the rebuilt image
+} e12_delta_header_t;
+
+/**
+ * @brief Reads the base firmware
+ *
+ * @param off offset in the base
+ * @param buf bytes read
+ * @param len bytes to read
+ * @param ctx context given to e12_delta_begin()
+ * @return int 0 on success, negative on failure
+ */
+typedef int (*e12_delta_read_t)(uint32_t off, uint8_t* buf, uint8_t len,
+                                void* ctx);
+
+/**
+ * @brief Writes the rebuilt image, in order
+ *
+ * @param off offset in the image
+ * @param buf bytes to write
+ * @param len number of bytes
+ * @param ctx context given to e12_delta_begin()
+ * @return int 0 on success, negative on failure
+ */
+typedef int (*e12_delta_write_t)(uint32_t off, const uint8_t* buf,
+                                 uint8_t len, void* ctx);
+
+/**
+ * @brief State of a patch being applied. Its size does not depend on the
+ * images, the patch is fed in pieces of any size.
+ *
+ */
+typedef struct e12_delta {
+  e12_delta_header_t head;
+  e12_delta_read_t read;
+  e12_delta_write_t write;
+  void* ctx;
+  uint32_t base_version;  ///< expected, 0 for any
+  uint32_t base_size;     ///< expected
+  uint32_t out;           ///< bytes of the image written
+  uint32_t src;           ///< base offset the next copy is relative to
+  uint32_t len;           ///< bytes left of the current op
+  uint32_t v;             ///< varint being read
+  uint8_t shift;          ///< of the next varint byte
+  uint8_t state;
+  uint8_t op;
+  uint8_t pos;            ///< header bytes read
+  e12_sha256_t sha;       ///< over the image written
+} e12_delta_t;
+
+/**
+ * @brief Prepares to apply a patch to the running firmware.
+ *
+ * The base is read while the image is written, so the image must not
+ * overwrite the base in place, e.g keep a copy of the running firmware.
+ *
+ * @param d state to initialise
+ * @param base_version version of the running firmware, 0 to not check
+ * @param base_size bytes of the running firmware
+ * @param read reads the running firmware
+ * @param write writes the rebuilt image
+ * @param ctx passed to read and write
+ */
+void e12_delta_begin(e12_delta_t* d, uint32_t base_version,
+                     uint32_t base_size, e12_delta_read_t read,
+                     e12_delta_write_t write, void* ctx);
+
+/**
+ * @brief Applies the next bytes of the patch.
+ *
+ * @param d state from e12_delta_begin()
+ * @param buf patch bytes, following the previous ones
+ * @param len number of bytes
+ * @return int 0 if more is needed, 1 once the image is rebuilt and its
+ * SHA-256 matches, negative if the patch is malformed, for another base,
+ * or read/write failed
+ */
+int e12_delta_feed(e12_delta_t* d, const uint8_t* buf, uint32_t len);
+
+#endif
@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "e12_json.h"
+
+#include <string.h>
+
+// Every function below takes the current position and the end of the text
+// and returns the position after what it consumed, or NULL on malformed
+// input. The end is either len or the first 0.
+
+static const char* skip_ws(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+    p++;
+  }
+  return p;
+}
+
+// p at the opening quote. With out, the decoded string is copied, cut to
+// size - 1 and terminated.
+static const char* scan_string(const char* p, const char* end, char* out,
+                               uint8_t size) {
+  uint8_t n = 0;
+  for (p++; p < end; p++) {
+    char c = *p;
+    if (c == '"') {
+      if (out) out[n] = 0;
+      return p + 1;
+    }
+    if (c == '\\') {
+      if (++p >= end) return NULL;
+      switch (*p) {
+        case 'b':
+          c = '\b';
+          break;
+        case 'f':
+          c = '\f';
+          break;
+        case 'n':
+          c = '\n';
+          break;
+        case 'r':
+          c = '\r';
+          break;
+        case 't':
+          c = '\t';
+          break;
+        case 'u': {
+          uint16_t u = 0;
+          for (uint8_t i = 0; i < 4; i++) {
+            if (++p >= end) return NULL;
+            char h = *p;
+            u <<= 4;
+            if (h >= '0' && h <= '9') {
+              u |= h - '0';
+            } else if ((h | 0x20) >= 'a' && (h | 0x20) <= 'f') {
+              u |= (h | 0x20) - 'a' + 10;
+            } else {
+              return NULL;
+            }
+          }
+          // no UTF-8 encoding, non ASCII becomes '?'
+          c = u < 0x80 ? (char)u : '?';
+        } break;
+        default:
+          c = *p;
+          break;
+      }
+    }
+    if (out && n + 1 < size) out[n++] = c;
+  }
+  return NULL;
+}
+
+// u is the magnitude, saturated at 0xFFFFFFFF
+static const char* scan_number(const char* p, const char* end, uint32_t* u,
+                               bool* neg, float* f) {
+  bool digits = false;
+  float v = 0;
+
+  *u = 0;
+  *neg = false;
+  if (p < end && (*p == '-' || *p == '+')) *neg = *p++ == '-';
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    uint8_t d = *p - '0';
+    *u = *u > (0xFFFFFFFFUL - d) / 10 ? 0xFFFFFFFFUL : *u * 10 + d;
+    v = v * 10 + d;
+    digits = true;
+  }
+  if (p < end && *p == '.') {
+    float scale = 0.1f;
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+      v += (*p - '0') * scale;
+      scale *= 0.1f;
+      digits = true;
+    }
+  }
+  if (!digits) return NULL;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    bool eneg = false;
+    int16_t e = 0;
+    p++;
+    if (p < end && (*p == '-' || *p == '+')) eneg = *p++ == '-';
+    if (p >= end || *p < '0' || *p > '9') return NULL;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+      if (e < 100) e = e * 10 + (*p - '0');
+    }
+    while (e--) v = eneg ? v / 10 : v * 10;
+    *u = v < 4294967295.0f ? (uint32_t)v : 0xFFFFFFFFUL;
+  }
+  *f = *neg ? -v : v;
+  return p;
+}
+
+static const char* scan_literal(const char* p, const char* end,
+                                const char* lit) {
+  size_t n = strlen(lit);
+  if ((size_t)(end - p) < n || strncmp(p, lit, n)) return NULL;
+  return p + n;
+}
+
+// skips an object or array, p at the opening bracket
+static const char* skip_container(const char* p, const char* end) {
+  uint8_t depth = 0;
+  while (p < end) {
+    switch (*p) {
+      case '"':
+        p = scan_string(p, end, NULL, 0);
+        if (!p) return NULL;
+        continue;
+      case '{':
+      case '[':
+        depth++;
+        break;
+      case '}':
+      case ']':
+        if (!--depth) return p + 1;
+        break;
+    }
+    p++;
+  }
+  return NULL;
+}
+
+// integers out of range of the member saturate to its min or max
+static void store_value(const e12_json_field_t* field, void* out, uint32_t u,
+                        bool neg, float f) {
+  uint8_t* dst = (uint8_t*)out + field->offset;
+  switch (field->type) {
+    case e12_json_type_t::JSON_INT:
+    case e12_json_type_t::JSON_UINT: {
+      uint8_t n = field->size < sizeof(u) ? field->size : sizeof(u);
+      uint32_t max = n < sizeof(u) ? (1UL << (8 * n)) - 1 : 0xFFFFFFFFUL;
+      if (field->type == e12_json_type_t::JSON_UINT) {
+        if (neg) u = 0;
+        if (u > max) u = max;
+      } else {
+        max >>= 1;
+        if (u > max + neg) u = max + neg;
+        if (neg) u = 0 - u;
+      }
+      // little endian, the low bytes hold the value
+      memcpy(dst, &u, n);
+    } break;
+    case e12_json_type_t::JSON_BOOL: {
+      bool b = f != 0;
+      memcpy(dst, &b, sizeof(b));
+    } break;
+    case e12_json_type_t::JSON_FLOAT: {
+      memcpy(dst, &f, sizeof(f));
+    } break;
+    default:
+      break;
+  }
+}
+
+static const e12_json_field_t* find_field(const e12_json_field_t* fields,
+                                          uint8_t count, const char* key,
+                                          size_t len) {
+  for (uint8_t i = 0; i < count; i++) {
+    if (!strncmp(fields[i].key, key, len) && !fields[i].key[len]) {
+      return &fields[i];
+    }
+  }
+  return NULL;
+}
+
+// parses the value of field, NULL field to skip it
+static const char* parse_value(const char* p, const char* end,
+                               const e12_json_field_t* field, void* out,
+                               int* set) {
+  uint32_t u;
+  bool neg;
+  float f;
+
+  if (p >= end) return NULL;
+  switch (*p) {
+    case '"': {
+      if (field && field->type == e12_json_type_t::JSON_STR) {
+        p = scan_string(p, end, (char*)out + field->offset, field->size);
+        if (p) (*set)++;
+        return p;
+      }
+      const char* q = scan_string(p, end, NULL, 0);
+      // a number given as a string
+      if (q && field && scan_number(p + 1, q - 1, &u, &neg, &f) == q - 1) {
+        store_value(field, out, u, neg, f);
+        (*set)++;
+      }
+      return q;
+    }
+    case '{':
+    case '[':
+      return skip_container(p, end);
+    case 't':
+    case 'f': {
+      bool b = *p == 't';
+      p = scan_literal(p, end, b ? "true" : "false");
+      if (p && field && field->type != e12_json_type_t::JSON_STR) {
+        store_value(field, out, b, false, b);
+        (*set)++;
+      }
+      return p;
+    }
+    case 'n':
+      return scan_literal(p, end, "null");
+    default: {
+      p = scan_number(p, end, &u, &neg, &f);
+      if (p && field && field->type != e12_json_type_t::JSON_STR) {
+        store_value(field, out, u, neg, f);
+        (*set)++;
+      }
+      return p;
+    }
+  }
+}
+
+/**
+ * @brief Fill a struct from a JSON object
+ *
+ * @param s JSON text
+ * @param len max length of s
+ * @param fields field table
+ * @param count number of entries in fields
+ * @param out struct to fill
+ * @return int number of members set, negative on malformed JSON
+ */
+int e12_json_parse(const char* s, int len, const e12_json_field_t* fields,
+                   uint8_t count, void* out) {
+  if (!s || len <= 0) return -1;
+  const char* end = (const char*)memchr(s, 0, len);
+  if (!end) end = s + len;
+
+  int set = 0;
+  const char* p = skip_ws(s, end);
+  if (p >= end || *p != '{') return -1;
+  p = skip_ws(p + 1, end);
+  if (p < end && *p == '}') return 0;
+
+  while (p < end) {
+    if (*p != '"') return -1;
+    const char* key = p + 1;
+    p = scan_string(p, end, NULL, 0);
+    if (!p) return -1;
+    const e12_json_field_t* field = find_field(fields, count, key, p - 1 - key);
+
+    p = skip_ws(p, end);
+    if (p >= end || *p != ':') return -1;
+    p = parse_value(skip_ws(p + 1, end), end, field, out, &set);
+    if (!p) return -1;
+
+    p = skip_ws(p, end);
+    if (p >= end) break;
+    if (*p == '}') return set;
+    if (*p != ',') return -1;
+    p = skip_ws(p + 1, end);
+  }
+  return -1;
+}
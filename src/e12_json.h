@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_E12_JSON
+#define H_E12_JSON
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Type of the struct member an e12_json_field_t fills
+ *
+ */
+enum class e12_json_type_t : uint8_t {
+  /// signed integer of 1, 2 or 4 bytes
+  JSON_INT = 0,
+  /// unsigned integer of 1, 2 or 4 bytes
+  JSON_UINT,
+  /// bool
+  JSON_BOOL,
+  /// float
+  JSON_FLOAT,
+  /// char array, always terminated, cut to fit
+  JSON_STR
+};
+
+/**
+ * @brief Maps a top level JSON key to a struct member
+ *
+ */
+typedef struct e12_json_field {
+  const char* key;
+  e12_json_type_t type;
+  uint16_t offset;  ///< of the member in the struct
+  uint8_t size;     ///< of the member in bytes
+} e12_json_field_t;
+
+/**
+ * @brief Declares an e12_json_field_t for member of struct T
+ *
+ * Example:
+ *   static const e12_json_field_t fields[] = {
+ *       E12_JSON_FIELD("on_ms", config_t, on_ms, e12_json_type_t::JSON_UINT),
+ *       E12_JSON_FIELD("name", config_t, name, e12_json_type_t::JSON_STR),
+ *   };
+ */
+#define E12_JSON_FIELD(key, T, member, type) \
+  { key, type, offsetof(T, member), sizeof(((T*)0)->member) }
+
+/**
+ * @brief Fills a struct from a JSON object in one pass, without allocating.
+ *
+ * Only keys of the outer object are matched, nested objects and arrays are
+ * skipped. Numbers may also be given as strings, e.g "on_ms":"1000".
+ * Integers out of range of their member saturate to its min or max.
+ * Members whose key is missing are left untouched. Parsing stops at len or
+ * at a terminating 0, whichever comes first.
+ *
+ * @param s JSON text
+ * @param len max length of s
+ * @param fields field table
+ * @param count number of entries in fields
+ * @param out struct to fill
+ * @return number of members set, negative if s is not a valid JSON object
+ * (members set up to the error are kept)
+ */
+int e12_json_parse(const char* s, int len, const e12_json_field_t* fields,
+                   uint8_t count, void* out);
+
+#endif
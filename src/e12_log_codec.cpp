@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "e12_protocol.h"
+#include "e12_tlv.h"
+
+// LOG_FMT_COMPACT event layout:
+//
+//   flags     1 byte, LOG_* below
+//   type      varint
+//   src       varint, src | src_index << 8
+//   status    1 byte, if LOG_STATUS
+//   count     varint, if LOG_COUNT
+//   ts        zigzag varint, delta to the previous event
+//   s_data    length byte and chars, if LOG_S
+//   f_data    if LOG_F, encoded as LOG_F_ENC
+//   i_data    zigzag varint, if LOG_I or LOG_I_DATA
+//
+// The s, f and i flags of the event are kept as is. i_data is also sent
+// without the i flag when it is not 0, some events carry a value untagged.
+
+#define LOG_S 0x01
+#define LOG_F 0x02
+#define LOG_I 0x04
+#define LOG_F_ENC_SHIFT 3
+#define LOG_F_ENC_MASK (0x03 << LOG_F_ENC_SHIFT)
+#define LOG_STATUS 0x20
+#define LOG_COUNT 0x40
+#define LOG_I_DATA 0x80
+
+enum log_f_enc_t : uint8_t {
+  F_HALF = 0,   // IEEE 754 binary16
+  F_CENTI = 1,  // zigzag varint of f * 100
+  F_FLOAT = 2   // IEEE 754 binary32
+};
+
+// true if f is exactly representable as a half
+static bool float_to_half(float f, uint16_t* h) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000;
+  int16_t exp = (bits >> 23) & 0xFF;
+  uint32_t mant = bits & 0x7FFFFF;
+
+  if (exp == 0 && mant == 0) {
+    *h = sign;
+    return true;
+  }
+  if (exp == 0xFF) {
+    // infinity, NaN goes out as float to keep its payload
+    *h = sign | 0x7C00;
+    return mant == 0;
+  }
+  exp = exp - 127 + 15;
+  if (exp >= 0x1F) return false;
+  if (exp <= 0) {
+    // subnormal half
+    if (exp < -10) return false;
+    mant |= 0x800000;
+    uint8_t shift = 14 - exp;
+    if (mant & ((1UL << shift) - 1)) return false;
+    *h = sign | (uint16_t)(mant >> shift);
+    return true;
+  }
+  if (mant & 0x1FFF) return false;
+  *h = sign | (uint16_t)(exp << 10) | (uint16_t)(mant >> 13);
+  return true;
+}
+
+static float half_to_float(uint16_t h) {
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint8_t exp = (h >> 10) & 0x1F;
+  uint32_t mant = h & 0x3FF;
+  uint32_t bits;
+  float f;
+
+  if (exp == 0) {
+    // zero or subnormal: mant * 2^-24
+    f = (float)mant / 16777216.0f;
+    return sign ? -f : f;
+  }
+  if (exp == 0x1F) {
+    bits = sign | 0x7F800000 | (mant << 13);
+  } else {
+    bits = sign | ((uint32_t)(exp - 15 + 127) << 23) | (mant << 13);
+  }
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// true if f is exactly a multiple of 1/100 that fits
+static bool float_to_centi(float f, int32_t* v) {
+  if (!(f > -2e7f && f < 2e7f)) return false;
+  float c = f * 100.0f;
+  *v = (int32_t)(c < 0 ? c - 0.5f : c + 0.5f);
+  return (float)*v / 100.0f == f;
+}
+
+/**
+ * @brief Encode a log event as LOG_FMT_COMPACT
+ *
+ * @param evt Event to encode
+ * @param prev_ts ts of the previous event, updated
+ * @param buf Buffer to write to
+ * @param len Space left in buf
+ * @return uint8_t bytes written, 0 if the event does not fit
+ */
+uint8_t e12::log_encode(const e12_log_evt_t* evt, uint32_t* prev_ts,
+                        uint8_t* buf, uint8_t len) {
+  uint8_t tmp[E12_LOG_COMPACT_MAX];
+  uint8_t n = 1;
+  uint8_t flags = 0;
+
+  n += e12_put_varint(&tmp[n], evt->type);
+  n += e12_put_varint(&tmp[n], evt->src | (uint32_t)evt->src_index << 8);
+  if (evt->status) {
+    flags |= LOG_STATUS;
+    tmp[n++] = evt->status;
+  }
+  if (evt->count) {
+    flags |= LOG_COUNT;
+    n += e12_put_varint(&tmp[n], evt->count);
+  }
+  n += e12_put_varint(&tmp[n], e12_zigzag((int32_t)(evt->ts - *prev_ts)));
+
+  if (evt->s) {
+    // s_data overlays the numeric values
+    flags |= LOG_S;
+    uint8_t slen = strnlen(evt->s_data, MAX_S_LOG_DATA);
+    tmp[n++] = slen;
+    memcpy(&tmp[n], evt->s_data, slen);
+    n += slen;
+  } else {
+    if (evt->f) {
+      flags |= LOG_F;
+      uint16_t h;
+      int32_t c;
+      bool half = float_to_half(evt->f_data, &h);
+      bool centi = float_to_centi(evt->f_data, &c);
+      uint8_t centi_len = centi ? e12_varint_len(e12_zigzag(c)) : 0xFF;
+      if (centi && centi_len < 2) {
+        flags |= F_CENTI << LOG_F_ENC_SHIFT;
+        n += e12_put_varint(&tmp[n], e12_zigzag(c));
+      } else if (half) {
+        flags |= F_HALF << LOG_F_ENC_SHIFT;
+        tmp[n++] = h & 0xFF;
+        tmp[n++] = h >> 8;
+      } else if (centi && centi_len < sizeof(float)) {
+        flags |= F_CENTI << LOG_F_ENC_SHIFT;
+        n += e12_put_varint(&tmp[n], e12_zigzag(c));
+      } else {
+        flags |= F_FLOAT << LOG_F_ENC_SHIFT;
+        memcpy(&tmp[n], &evt->f_data, sizeof(float));
+        n += sizeof(float);
+      }
+    }
+    if (evt->i || evt->i_data) {
+      if (evt->i) flags |= LOG_I;
+      if (!evt->i) flags |= LOG_I_DATA;
+      n += e12_put_varint(&tmp[n], e12_zigzag(evt->i_data));
+    }
+  }
+
+  if (n > len) return 0;
+  tmp[0] = flags;
+  memcpy(buf, tmp, n);
+  *prev_ts = evt->ts;
+  return n;
+}
+
+/**
+ * @brief Decode a LOG_FMT_COMPACT log event
+ *
+ * @param buf Buffer to read from
+ * @param len Bytes left in buf
+ * @param prev_ts ts of the previous event, updated
+ * @param evt Event to fill
+ * @return uint8_t bytes read, 0 if the event is malformed
+ */
+uint8_t e12::log_decode(const uint8_t* buf, uint8_t len, uint32_t* prev_ts,
+                        e12_log_evt_t* evt) {
+  uint8_t n = 1;
+  uint8_t r;
+  uint32_t v;
+
+  if (!len) return 0;
+  uint8_t flags = buf[0];
+  memset(evt, 0, sizeof(e12_log_evt_t));
+
+  if (!(r = e12_get_varint(&buf[n], len - n, &v)) || v > 0xFF) return 0;
+  evt->type = v;
+  n += r;
+  if (!(r = e12_get_varint(&buf[n], len - n, &v)) || v > 0xFFFF) return 0;
+  evt->src = v & 0xFF;
+  evt->src_index = v >> 8;
+  n += r;
+  if (flags & LOG_STATUS) {
+    if (n >= len) return 0;
+    evt->status = buf[n++];
+  }
+  if (flags & LOG_COUNT) {
+    if (!(r = e12_get_varint(&buf[n], len - n, &v))) return 0;
+    evt->count = v;
+    n += r;
+  }
+  if (!(r = e12_get_varint(&buf[n], len - n, &v))) return 0;
+  evt->ts = *prev_ts + (uint32_t)e12_unzigzag(v);
+  n += r;
+
+  if (flags & LOG_S) {
+    if (n >= len) return 0;
+    uint8_t slen = buf[n++];
+    if (slen > MAX_S_LOG_DATA || slen > len - n) return 0;
+    memcpy(evt->s_data, &buf[n], slen);
+    n += slen;
+    evt->s = true;
+  }
+  if (flags & LOG_F) {
+    switch ((flags & LOG_F_ENC_MASK) >> LOG_F_ENC_SHIFT) {
+      case F_HALF: {
+        if (len - n < 2) return 0;
+        evt->f_data = half_to_float(buf[n] | (uint16_t)buf[n + 1] << 8);
+        n += 2;
+      } break;
+      case F_CENTI: {
+        if (!(r = e12_get_varint(&buf[n], len - n, &v))) return 0;
+        evt->f_data = (float)e12_unzigzag(v) / 100.0f;
+        n += r;
+      } break;
+      case F_FLOAT: {
+        if (len - n < (int)sizeof(float)) return 0;
+        memcpy(&evt->f_data, &buf[n], sizeof(float));
+        n += sizeof(float);
+      } break;
+      default:
+        return 0;
+    }
+    evt->f = true;
+  }
+  if (flags & (LOG_I | LOG_I_DATA)) {
+    if (!(r = e12_get_varint(&buf[n], len - n, &v))) return 0;
+    evt->i_data = e12_unzigzag(v);
+    n += r;
+    evt->i = (flags & LOG_I) != 0;
+  }
+
+  *prev_ts = evt->ts;
+  return n;
+}
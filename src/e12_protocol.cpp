@@ -18,6 +18,7 @@
 
 #include "e12_protocol.h"
 
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -43,6 +44,43 @@ e12::e12(uint32_t vid, uint32_t pid) {
   _pin_io_mask = 0;
   _mcu_flashing_enabled = false;
   _status.CONFIGURED = false;
+  _integrity = e12_integrity_t::INTEGRITY_XOR;
+  _rx_integrity = e12_integrity_t::INTEGRITY_XOR;
+  _integrity_follow = false;
+  _timeout = E12_RESP_TIMEOUT;
+  _seq = 0;
+  _resp_cb = 0;
+  _resp_ctx = 0;
+  memset(_pending, 0, sizeof(_pending));
+  memset(&_frag, 0, sizeof(_frag));
+#if E12_FW_MAX_CHUNKS
+  memset(&_fw_rx, 0, sizeof(_fw_rx));
+#endif
+#if E12_FW_SENDER
+  memset(&_fw_tx, 0, sizeof(_fw_tx));
+#endif
+  _vendor_cmds = NULL;
+  _vendor_cmds_count = 0;
+#if E12_ENABLE_PIN_CTL
+  _pin_batch_seq = 0;
+  _pin_batch_failed = 0;
+  _pin_ctl_seq = 0;
+  _pin_ctl_value = -1;
+#endif
+#if E12_PIN_SUBS
+  memset(_pin_subs, 0, sizeof(_pin_subs));
+  memset(_pin_last, 0, sizeof(_pin_last));
+  _pin_levels = 0;
+  _pin_dirty = false;
+#endif
+#if E12_LOG_RING_SIZE
+  _log_head = 0;
+  _log_count = 0;
+  _log_first_ts = 0;
+  _log_flush_due = false;
+  set_log_flush(0);
+#endif
+  _log_fmt = e12_log_fmt_t::LOG_FMT_FIXED;
 }
 
 /**
@@ -68,24 +106,36 @@ int e12::publish_profile() { return send(get_request(e12_cmd_t::CMD_PROFILE)); }
  * @brief Encode the given data into an on-wire packet
  *
  * @param data Pointer to the data packet to encode
- * @return e12_onwire_t* Pointer to the encoded on-wire packet
+ * @return e12_onwire_t* Pointer to the encoded on-wire packet, NULL if the
+ * packet does not fit in a frame
  */
 e12_onwire_t* e12::encode(e12_packet_t* data) {
-  e12_onwire_t* pkt = get_encode_buffer();
-  pkt->head.magic[0] = E12_MAGIC_MARKER_1;
-  pkt->head.magic[1] = E12_MAGIC_MARKER_2;
-  pkt->head.len =
-      sizeof(e12_onwire_head_t) + data->msg.head.len;
-
-  if ((uint8_t*)data != (uint8_t*)&pkt->data) {
-    memcpy(&pkt->data, data, data->msg.head.len);
+  e12_onwire_t* pkt = encode_frame(get_encode_buffer(), data, _integrity);
+#if ESP32_E12_SPEC
+  if (!pkt) {
+    ESP_LOGE(TAG, "Packet too large to encode (%d)", data->msg.head.len);
   }
-
-  pkt->head.checksum = get_checksum((const char*)&pkt->data,
-                                    data->msg.head.len);
+#endif
   return pkt;
 }
 
+/**
+ * @brief Get the number of CRC bytes trailing the payload
+ *
+ * @param mode integrity check
+ * @return uint8_t number of bytes
+ */
+uint8_t e12::get_trailer_len(e12_integrity_t mode) {
+  switch (mode) {
+    case e12_integrity_t::INTEGRITY_CRC16:
+      return E12_CRC16_LEN;
+    case e12_integrity_t::INTEGRITY_CRC32:
+      return E12_CRC32_LEN;
+    default:
+      return 0;
+  }
+}
+
 bool e12::set_pin_in(uint8_t pin_number, bool is_analog) {
   if (pin_number > 15) return false;
 
@@ -162,6 +212,17 @@ e12_packet_t* e12::get_request(e12_cmd_t cmd, bool response, void* data) {
   p->msg.head.cmd = cmd;
   p->msg.head.RESP_EXPECTED = response;
   p->msg.head.len = sizeof(e12_header_t);
+  if (!e12_cmd_enabled(cmd)) return NULL;
+  const e12_cmd_def_t* def = get_vendor_cmd((uint8_t)cmd);
+  if (def) {
+    if (data) {
+      memcpy(p->msg.data, data, def->size);
+    } else {
+      memset(p->msg.data, 0, def->size);
+    }
+    p->msg.head.len += def->size;
+    return p;
+  }
   switch (cmd) {
     case e12_cmd_t::CMD_PING: {
       size_t string_len = strlen(STR_PING) + 1;
@@ -182,9 +243,13 @@ e12_packet_t* e12::get_request(e12_cmd_t cmd, bool response, void* data) {
       p->msg.head.len += sizeof(e12_node_properties_t);
     } break;
     case e12_cmd_t::CMD_LOG: {
-      e12_log_evt_t* log = (e12_log_evt_t*)data;
-      p->msg.head.len += sizeof(e12_log_evt_t);
-      memcpy(p->msg.data, data, p->msg.head.len);
+      // NULL data: the caller writes the event in place
+      e12_log_evt_t* evt = e12_view<e12_log_evt_t>(p).reserve();
+      if (!data) {
+        memset(evt, 0, sizeof(e12_log_evt_t));
+      } else if (data != evt) {
+        memcpy(evt, data, sizeof(e12_log_evt_t));
+      }
     } break;
     case e12_cmd_t::CMD_NODE_SLEEP: {
       p->msg_sleep.ms = *(uint32_t*)data;
@@ -195,38 +260,64 @@ e12_packet_t* e12::get_request(e12_cmd_t cmd, bool response, void* data) {
       p->msg_wakeup.ms = wakeup->ms;
       p->msg.head.len = sizeof(p->msg_wakeup);
     } break;
+#if E12_ENABLE_AUTH
     case e12_cmd_t::CMD_AUTH: {
-      e12_auth_data_t* auth = (e12_auth_data_t*)data;
-      p->msg.head.len += sizeof(e12_auth_data_t);
-      memcpy(p->msg.data, data, p->msg.head.len);
+      // NULL data: the caller writes the credentials in place
+      e12_auth_data_t* auth = e12_view<e12_auth_data_t>(p).reserve();
+      if (!data) {
+        memset(auth, 0, sizeof(e12_auth_data_t));
+      } else if (data != auth) {
+        memcpy(auth, data, sizeof(e12_auth_data_t));
+      }
     } break;
+#endif
     case e12_cmd_t::CMD_STATE: {
       e12_data_t* s = (e12_data_t*)p->msg.data;
+      memset(s, 0, offsetof(e12_data_t, data));
       s->IS_JSON = true;
       p->msg.head.len += (1 + 4);  // IS_JSON + ts_ms
       if (data) {
         s->STORE = true;
+        // leave room for the trailer like put_data()
+        e12_tlv_writer w(s->data, E12_MAX_DATA_PAYLOAD - p->msg.head.len -
+                                      get_trailer_len(_integrity));
+        if (on_get_state_bin(&w, data) == 0) {
+          if (!w.ok()) return NULL;
+          s->IS_JSON = false;
+          p->msg.head.len += w.len();
+          break;
+        }
         int len =
             on_get_state((char*)s->data, MAX_JSON_STATE_BUFFER_SIZE, data);
         if (len < MAX_JSON_STATE_BUFFER_SIZE) {
           p->msg.head.len += len;
         } else {
-          // error, state messages can not be more than 96 bytes
+          // error, state messages can not be more than 96 bytes, larger
+          // ones go through send_fragmented()
           return NULL;
         }
       } else {
         s->FETCH = true;
       }
     } break;
+#if E12_ENABLE_OTA
     case e12_cmd_t::CMD_OTA: {
+      p->msg.head.len = sizeof(p->msg_ota);
+      if (data) {
+        memcpy(&p->msg_ota.release_type, data, sizeof(e12_ota_t));
+        p->msg_ota.version[sizeof(p->msg_ota.version) - 1] = 0;
+        break;
+      }
       p->msg_ota.release_type = (uint32_t)e12_release_t::STABLE;
       // example: set the version to e.g f7f66fa_1761208916_main.bin
       // size : 1143296 bytes
       p->msg_ota.size = 1139696;
       strncpy(p->msg_ota.version, "7b1ce59_1763659810_stable.bin",
               sizeof(p->msg_ota.version) - 1);
+      p->msg_ota.version[sizeof(p->msg_ota.version) - 1] = 0;
       p->msg.head.len = sizeof(p->msg_ota);
     } break;
+#endif
     case e12_cmd_t::CMD_INFO: {
       p->msg_info.version = _mcu_fwr_version;
       p->msg_info.arch = _arch;
@@ -234,6 +325,7 @@ e12_packet_t* e12::get_request(e12_cmd_t cmd, bool response, void* data) {
       p->msg_info.flashing_enabled = _mcu_flashing_enabled;
       p->msg.head.len = sizeof(p->msg_info);
     } break;
+#if E12_ENABLE_OTA
     case e12_cmd_t::CMD_VMCU_OTA: {
       if (_mcu_flashing_enabled) {
         p->msg.head.len = sizeof(p->msg_vmcu_ota);
@@ -241,13 +333,45 @@ e12_packet_t* e12::get_request(e12_cmd_t cmd, bool response, void* data) {
         return NULL;
       }
     } break;
+#endif
     case e12_cmd_t::CMD_PROFILE: {
       p->msg_dev_profile.pins.all = get_pin_mask();
       p->msg_dev_profile.mask.all = get_pin_io_mask();
       p->msg.head.len = sizeof(p->msg_dev_profile);
     } break;
+#if E12_ENABLE_PIN_CTL
     case e12_cmd_t::CMD_PIN_CTL: {
       // payload will be filled by the caller
+      p->msg_ctl.data = 0;
+    } break;
+    case e12_cmd_t::CMD_PIN_BATCH: {
+      e12_pin_batch_t* b = e12_view<e12_pin_batch_t>(p).reserve();
+      if (data) {
+        memcpy(b, data, sizeof(e12_pin_batch_t));
+        if (b->count > E12_PIN_BATCH_MAX) b->count = E12_PIN_BATCH_MAX;
+      } else {
+        memset(b, 0, sizeof(e12_pin_batch_t));
+      }
+      p->msg.head.len = sizeof(e12_header_t) +
+                        offsetof(e12_pin_batch_t, writes) +
+                        b->count * sizeof(e12_pin_write_t);
+    } break;
+    case e12_cmd_t::CMD_PIN_SUBSCRIBE: {
+      e12_pin_sub_t* sub = e12_view<e12_pin_sub_t>(p).reserve();
+      if (data) {
+        memcpy(sub, data, sizeof(e12_pin_sub_t));
+      } else {
+        memset(sub, 0, sizeof(e12_pin_sub_t));
+      }
+    } break;
+#endif
+    case e12_cmd_t::CMD_LOG_BATCH: {
+      // events will be appended by the caller
+      e12_log_batch_t* batch = (e12_log_batch_t*)p->msg.data;
+      batch->format = _log_fmt;
+      batch->count = 0;
+      batch->resv = 0;
+      p->msg.head.len += offsetof(e12_log_batch_t, data);
     } break;
     case e12_cmd_t::CMD_NODE_AWAKE:
     case e12_cmd_t::CMD_TIME:
@@ -258,21 +382,6 @@ e12_packet_t* e12::get_request(e12_cmd_t cmd, bool response, void* data) {
   return p;
 }
 
-/**
- * @brief Get the checksum for the given data
- *
- * @param data Pointer to the data
- * @param len Length of the data
- * @return uint8_t Checksum value
- */
-uint8_t e12::get_checksum(const char* data, uint8_t len) {
-  uint8_t checksum = 0;
-  for (uint8_t i = 0; i < len; i++) {
-    checksum ^= data[i];
-  }
-  return checksum;
-}
-
 /**
  * @brief Get the message from the on-wire packet
  *
@@ -282,12 +391,14 @@ uint8_t e12::get_checksum(const char* data, uint8_t len) {
  */
 bool e12::get_message(e12_packet_t* data) {
   e12_onwire_t* pkt = get_decode_buffer();
-  if (!memcpy(data, &pkt->data, sizeof(e12_packet_t))) {
+  uint8_t len = pkt->data.msg.head.len;
+  if (len < sizeof(e12_header_t) || len > sizeof(e12_packet_t)) {
 #if ESP32_E12_SPEC
     ESP_LOGE(TAG, "Failed to copy message data");
 #endif
     return false;
   }
+  memcpy(data, &pkt->data, len);
   return true;
 }
 
@@ -305,27 +416,82 @@ void e12::flush_buffer(e12_onwire_t* buf) {
   }
 }
 
+#if E12_ENABLE_PIN_CTL
+// a CMD_PIN_BATCH request holds its count writes
+static bool e12_pin_batch_valid(const e12_packet_t* p) {
+  const e12_pin_batch_t* b = (const e12_pin_batch_t*)p->msg.data;
+  uint8_t head = sizeof(e12_header_t) + offsetof(e12_pin_batch_t, writes);
+  return p->msg.head.len >= head && b->count <= E12_PIN_BATCH_MAX &&
+         p->msg.head.len >= head + b->count * sizeof(e12_pin_write_t);
+}
+#endif
+
 /**
- * @brief Get a response packet for the given request packet
+ * @brief Get a response packet for the given request packet, on_receive()
+ * having handled it
  *
  * @param p Pointer to the request packet
  * @return e12_packet_t* Pointer to the response packet
  */
 e12_packet_t* e12::get_response(e12_packet_t* p) {
+  if (p->msg.head.cmd == e12_cmd_t::CMD_BATCH) return get_batch_response(p);
   if (!p->msg.head.RESP_EXPECTED) return NULL;
 
-  e12_packet_t* resp = e12_get_packet();
+  // requests on_receive() refused as malformed are not answered, checked
+  // before the response may overwrite them
+  const e12_cmd_def_t* def = get_vendor_cmd((uint8_t)p->msg.head.cmd);
+  if (def && p->msg.head.len < sizeof(e12_header_t) + def->size) return NULL;
+#if E12_ENABLE_PIN_CTL
+  if (p->msg.head.cmd == e12_cmd_t::CMD_PIN_BATCH && !e12_pin_batch_valid(p)) {
+    return NULL;
+  }
+#endif
+#if E12_PIN_SUBS
+  if (p->msg.head.cmd == e12_cmd_t::CMD_PIN_SUBSCRIBE &&
+      !e12_view<e12_pin_sub_t>(p).valid()) {
+    return NULL;
+  }
+#endif
+
+  e12_header_t head = p->msg.head;
+  e12_packet_t* resp = NULL;
+#if E12_HALF_DUPLEX
+  e12_onwire_t* pkt = get_encode_buffer();
+  if (p == &pkt->data) {
+    // in place: the request payload stays until the response overwrites it
+    pkt->recv_len = 0;
+    pkt->rx_done = false;
+    memset(&p->msg.head, 0, sizeof(e12_header_t));
+    resp = p;
+  }
+#endif
+  if (!resp) resp = e12_get_packet();
   if (!resp) {
 #if ESP32_E12_SPEC
     ESP_LOGE(TAG, "Failed to get response packet");
 #endif
     return NULL;
   }
-  resp->msg.head.seq = p->msg.head.seq;
+  resp->msg.head.seq = head.seq;
   resp->msg.head.IS_RESPONSE = true;
-  resp->msg.head.cmd = p->msg.head.cmd;
+  resp->msg.head.cmd = head.cmd;
   resp->msg.head.len = sizeof(e12_header_t);
-  switch (p->msg.head.cmd) {
+  if (head.FRAGMENT) {
+    // the payload was handled by on_reassembled(), acknowledge it or
+    // report it dropped: out of order, too large or refused
+    resp->msg_err.head.len = sizeof(resp->msg_err);
+    resp->msg_err.err = head.seq == _frag.ack_seq && _frag.ack_err;
+    return resp;
+  }
+  if (def) {
+    if (def->on_response) {
+      return def->on_response(this, p, resp) < 0 ? NULL : resp;
+    }
+    resp->msg_err.head.len = sizeof(resp->msg_err);
+    resp->msg_err.err = 0;
+    return resp;
+  }
+  switch (head.cmd) {
     case e12_cmd_t::CMD_PING: {
       resp->msg.head.len += strlen(STR_PONG) + 1;
       strcpy(resp->msg.data, STR_PONG);
@@ -335,9 +501,7 @@ e12_packet_t* e12::get_response(e12_packet_t* p) {
       resp->msg.head.len = sizeof(resp->msg_time);
     } break;
     case e12_cmd_t::CMD_CONFIG: {
-      resp->msg.head.len += sizeof(_dev_ptr->config);
-      if (!memcpy(resp->msg.data, &_dev_ptr->config,
-                  sizeof(_dev_ptr->config))) {
+      if (!_dev_ptr || !put_data(resp, &_dev_ptr->config)) {
 #if ESP32_E12_SPEC
         ESP_LOGE(TAG, "Failed to copy config data");
 #endif
@@ -347,7 +511,7 @@ e12_packet_t* e12::get_response(e12_packet_t* p) {
     case e12_cmd_t::CMD_STATE: {
       e12_data_t* state = (e12_data_t*)p->msg.data;
       if (state->FETCH) {
-        if (!memcpy(resp->msg.data, &_dev_ptr->state, sizeof(e12_data_t))) {
+        if (!_dev_ptr || !put_data(resp, &_dev_ptr->state)) {
 #if ESP32_E12_SPEC
           ESP_LOGE(TAG, "Failed to copy state data");
 #endif
@@ -355,9 +519,43 @@ e12_packet_t* e12::get_response(e12_packet_t* p) {
         }
         state = (e12_data_t*)resp->msg.data;
         state->STORE = true;
-        resp->msg.head.len += sizeof(e12_data_t);
       }
     } break;
+#if E12_ENABLE_PIN_CTL
+    case e12_cmd_t::CMD_PIN_CTL: {
+      // the pin as read back, an error if on_ctl() refused it
+      uint32_t data = p->msg_ctl.data;
+      if (head.seq != _pin_ctl_seq || _pin_ctl_value < 0) {
+        resp->msg_err.head.len = sizeof(resp->msg_err);
+        resp->msg_err.err = 1;
+        break;
+      }
+      resp->msg_ctl.data = data;
+      resp->msg_ctl.op = (uint8_t)ctl_op_t::READ;
+      resp->msg_ctl.response = true;
+      resp->msg_ctl.value = _pin_ctl_value;
+      resp->msg.head.len = sizeof(resp->msg_ctl);
+    } break;
+    case e12_cmd_t::CMD_PIN_BATCH: {
+      uint32_t mask = ((e12_pin_batch_t*)p->msg.data)->read & _pin_mask;
+      e12_pin_state_t* st = (e12_pin_state_t*)resp->msg.data;
+      resp->msg.head.len = sizeof(e12_header_t) + read_pins(mask, st);
+      if (head.seq == _pin_batch_seq) st->failed = _pin_batch_failed;
+    } break;
+#endif
+#if E12_PIN_SUBS
+    case e12_cmd_t::CMD_PIN_SUBSCRIBE: {
+      // the pins of the request now subscribed, at their current values
+      e12_pin_sub_t* sub = (e12_pin_sub_t*)p->msg.data;
+      uint32_t mask = 0;
+      if (!sub->off) {
+        for (uint8_t i = 0; i < E12_PIN_SUBS; i++) mask |= _pin_subs[i].mask;
+        mask &= sub->mask;
+      }
+      e12_pin_state_t* st = (e12_pin_state_t*)resp->msg.data;
+      resp->msg.head.len = sizeof(e12_header_t) + read_pins(mask, st);
+    } break;
+#endif
     default: {
       // just send OK response.
       resp->msg_err.head.len = sizeof(resp->msg_err);
@@ -367,6 +565,48 @@ e12_packet_t* e12::get_response(e12_packet_t* p) {
   return resp;
 }
 
+// bytes of e12_data_t::data in use: the JSON string and its terminator,
+// or the e12_tlv fields up to TLV_END
+static uint8_t e12_data_used(const e12_data_t* d) {
+  const uint8_t size = sizeof(d->data);
+  if (d->IS_JSON) {
+    uint8_t n = strnlen((const char*)d->data, size);
+    return n < size ? n + 1 : n;
+  }
+  e12_tlv_reader r(d->data, size);
+  uint8_t used = 0;
+  while (r.next()) used = r.pos();
+  return used;
+}
+
+/**
+ * @brief Appends the used part of a state or config to a response, so the
+ * frame leaves room for the integrity trailer
+ *
+ * @param resp Response packet, head.len set to the header
+ * @param d State or config to copy
+ * @return true if it fits the frame
+ */
+bool e12::put_data(e12_packet_t* resp, const e12_data_t* d) {
+  uint8_t len = offsetof(e12_data_t, data) + e12_data_used(d);
+  if (sizeof(e12_onwire_head_t) + resp->msg.head.len + len +
+          get_trailer_len(_integrity) >
+      E12_MAX_FRAME_LEN) {
+    return false;
+  }
+  memcpy(resp->msg.data, d, len);
+  resp->msg.head.len += len;
+  return true;
+}
+
+// bytes of e12_data_t::data carried by the packet
+static uint8_t e12_data_len(const e12_packet_t* p) {
+  uint8_t head = sizeof(e12_header_t) + offsetof(e12_data_t, data);
+  if (p->msg.head.len <= head) return 0;
+  uint8_t len = p->msg.head.len - head;
+  return len < sizeof(e12_data_t::data) ? len : sizeof(e12_data_t::data);
+}
+
 /**
  * @brief Handle the received packet
  *
@@ -374,6 +614,19 @@ e12_packet_t* e12::get_response(e12_packet_t* p) {
  * @return int Status code
  */
 int e12::on_receive(e12_packet_t* p) {
+  if (!p) return -1;
+  if (p->msg.head.FRAGMENT) {
+    // kept for get_response() to acknowledge
+    int ret = on_receive_fragment(p);
+    _frag.ack_seq = p->msg.head.seq;
+    _frag.ack_err = ret < 0;
+    return ret;
+  }
+  if (p->msg.head.IS_RESPONSE) {
+    complete_pending(p);
+  }
+  if ((uint8_t)p->msg.head.cmd >= E12_CMD_VENDOR) return on_receive_vendor(p);
+  if (!e12_cmd_enabled(p->msg.head.cmd)) return -1;
   switch (p->msg.head.cmd) {
     case e12_cmd_t::CMD_CONFIG: {
       e12_data_t* config = (e12_data_t*)p->msg.data;
@@ -382,6 +635,9 @@ int e12::on_receive(e12_packet_t* p) {
             on_config((const char*)config->data, sizeof(config->data));
         return 0;
       }
+      e12_tlv_reader r(config->data, e12_data_len(p));
+      _status.CONFIGURED = on_config_bin(&r) != 0;
+      return 0;
     } break;
     case e12_cmd_t::CMD_STATE: {
       e12_data_t* state = (e12_data_t*)p->msg.data;
@@ -389,9 +645,18 @@ int e12::on_receive(e12_packet_t* p) {
         on_restore_state((const char*)state->data, sizeof(state->data));
         return 0;
       }
+      if (state->STORE) {
+        e12_tlv_reader r(state->data, e12_data_len(p));
+        on_restore_state_bin(&r);
+        return 0;
+      }
     } break;
     case e12_cmd_t::CMD_NODE_AWAKE: {
       set_node_status(e12_node_op_status_t::STATUS_ACTIVE, 0);
+#if E12_LOG_RING_SIZE
+      // not sent from here, the next flush_logs(false) sends everything
+      _log_flush_due = true;
+#endif
     } break;
     case e12_cmd_t::CMD_NODE_SLEEP: {
       uint32_t ms = p->msg_sleep.ms;
@@ -399,8 +664,113 @@ int e12::on_receive(e12_packet_t* p) {
         set_node_status(e12_node_op_status_t::STATUS_SLEEP, ms);
       }
     } break;
+#if E12_ENABLE_PIN_CTL
     case e12_cmd_t::CMD_PIN_CTL: {
-      return on_ctl((ctl_op_t)p->msg_ctl.op, p->msg_ctl.pin, p->msg_ctl.value);
+      if (p->msg.head.IS_RESPONSE) break;
+      _pin_ctl_seq = p->msg.head.seq;
+      _pin_ctl_value =
+          on_ctl((ctl_op_t)p->msg_ctl.op, p->msg_ctl.pin, p->msg_ctl.value);
+      return _pin_ctl_value < 0 ? -1 : 0;
+    } break;
+    case e12_cmd_t::CMD_PIN_BATCH: {
+      if (!p->msg.head.IS_RESPONSE) return on_pin_batch(p);
+    } break;
+    case e12_cmd_t::CMD_PIN_SUBSCRIBE: {
+#if E12_PIN_SUBS
+      if (!p->msg.head.IS_RESPONSE) return on_pin_subscribe(p);
+#endif
+    } break;
+    case e12_cmd_t::CMD_PIN_EVENT: {
+      uint8_t head = sizeof(e12_header_t) + offsetof(e12_pin_state_t, analog);
+      if (p->msg.head.len >= head) {
+        on_pin_event((const e12_pin_state_t*)p->msg.data);
+      }
+    } break;
+#endif
+    case e12_cmd_t::CMD_LOG_BATCH: {
+      e12_log_batch_t* batch = (e12_log_batch_t*)p->msg.data;
+      uint8_t head = sizeof(e12_header_t) + offsetof(e12_log_batch_t, data);
+      if (p->msg.head.len < head ||
+          (batch->format == e12_log_fmt_t::LOG_FMT_FIXED &&
+           batch->count * sizeof(e12_log_evt_t) >
+               (uint8_t)(p->msg.head.len - head)) ||
+          (batch->format != e12_log_fmt_t::LOG_FMT_FIXED &&
+           batch->format != e12_log_fmt_t::LOG_FMT_COMPACT)) {
+#if ESP32_E12_SPEC
+        ESP_LOGE(TAG, "Malformed log batch");
+#endif
+        return -1;
+      }
+      // every event is handed on as the CMD_LOG it replaces
+      e12_packet_t sub;
+      memcpy(&sub.msg.head, &p->msg.head, sizeof(e12_header_t));
+      sub.msg.head.cmd = e12_cmd_t::CMD_LOG;
+      sub.msg.head.len = sizeof(e12_header_t) + sizeof(e12_log_evt_t);
+      uint8_t end = p->msg.head.len - head;
+      uint8_t off = 0;
+      uint32_t prev_ts = 0;
+      for (uint8_t i = 0; i < batch->count; i++) {
+        if (batch->format == e12_log_fmt_t::LOG_FMT_FIXED) {
+          memcpy(sub.msg.data, &batch->data[i * sizeof(e12_log_evt_t)],
+                 sizeof(e12_log_evt_t));
+        } else {
+          uint8_t n = log_decode(&batch->data[off], end - off, &prev_ts,
+                                 (e12_log_evt_t*)sub.msg.data);
+          if (!n) {
+#if ESP32_E12_SPEC
+            ESP_LOGE(TAG, "Malformed log event %d", i);
+#endif
+            return -1;
+          }
+          off += n;
+        }
+        on_receive(&sub);
+        if (rx_overwritten(p)) return -1;
+      }
+    } break;
+    case e12_cmd_t::CMD_FW_BEGIN: {
+#if E12_FW_MAX_CHUNKS
+      if (p->msg.head.len >= sizeof(e12_header_t) + sizeof(e12_fw_info_t)) {
+        fw_rx_begin((const e12_fw_info_t*)p->msg.data);
+      }
+#endif
+    } break;
+    case e12_cmd_t::CMD_FW_CHUNK: {
+#if E12_FW_MAX_CHUNKS
+      uint8_t head = sizeof(e12_header_t) + offsetof(e12_fw_chunk_t, data);
+      if (p->msg.head.len > head) {
+        fw_rx_chunk((const e12_fw_chunk_t*)p->msg.data,
+                    p->msg.head.len - head);
+      }
+#endif
+    } break;
+    case e12_cmd_t::CMD_FW_ACK: {
+#if E12_FW_SENDER
+      if (p->msg.head.len >= sizeof(e12_header_t) + sizeof(e12_fw_ack_t)) {
+        fw_tx_ack((const e12_fw_ack_t*)p->msg.data);
+      }
+#endif
+    } break;
+    case e12_cmd_t::CMD_BATCH: {
+      uint8_t end = p->msg.head.len - sizeof(e12_header_t);
+      uint8_t off = 0;
+      while (off + sizeof(e12_header_t) <= end) {
+        const e12_header_t* h = (const e12_header_t*)&p->msg.data[off];
+        if (h->len < sizeof(e12_header_t) || off + h->len > end ||
+            h->cmd == e12_cmd_t::CMD_BATCH) {
+#if ESP32_E12_SPEC
+          ESP_LOGE(TAG, "Malformed batch at offset %d", off);
+#endif
+          return -1;
+        }
+        // handlers expect a whole packet, hand each one a zero padded copy
+        e12_packet_t sub;
+        memcpy(&sub, h, h->len);
+        memset(&sub.buf[h->len], 0, sizeof(sub) - h->len);
+        on_receive(&sub);
+        if (rx_overwritten(p)) return -1;
+        off += E12_BATCH_ALIGN(h->len);
+      }
     } break;
     default:
       break;
@@ -408,141 +778,1485 @@ int e12::on_receive(e12_packet_t* p) {
   return 0;
 }
 
-bool e12::on_ctl(ctl_op_t op, uint8_t pin, uint32_t val) {
-  int16_t ret = 0;
-  switch (op) {
-    case ctl_op_t::READ: {
-      ret = e12::on_ctl_read(pin);
-      if (!ret) {
-        ret = on_ctl_read(pin);
-      }
+/**
+ * @brief Queue a log event to be sent with others as CMD_LOG_BATCH
+ *
+ * @param evt Event to queue
+ * @return int 0 on success, negative on failure
+ */
+int e12::queue_log(const e12_log_evt_t* evt) {
+  if (!evt) return -1;
+#if E12_LOG_RING_SIZE
+  if (_log_count == E12_LOG_RING_SIZE && flush_logs() < 0) {
+    // still full, the oldest event makes room
+    _log_head = (_log_head + 1) % E12_LOG_RING_SIZE;
+    _log_count--;
+  }
+  if (!_log_count) _log_first_ts = get_time_ms();
+  uint8_t i = (_log_head + _log_count) % E12_LOG_RING_SIZE;
+  memcpy(&_log_ring[i], evt, sizeof(e12_log_evt_t));
+  _log_count++;
+  return flush_logs(false) < 0 ? -1 : 0;
+#else
+  int ret = send(get_request(e12_cmd_t::CMD_LOG, true, (void*)evt), true);
+  return ret < 0 ? ret : 0;
+#endif
+}
 
-    } break;
-    case ctl_op_t::WRITE: {
-      ret = e12::on_ctl_write(pin, val);
-      if (ret) {
-        ret = on_ctl_write(pin, val);
-      }
+/**
+ * @brief Send queued log events as CMD_LOG_BATCH
+ *
+ * @param force true to send everything, false to only send once the flush
+ * count or the max age is reached, or the node reported it is awake
+ * @return int number of events sent, negative on failure
+ */
+int e12::flush_logs(bool force) {
+#if E12_LOG_RING_SIZE
+  if (!_log_count) {
+    _log_flush_due = false;
+    return 0;
+  }
+  bool fixed = _log_fmt == e12_log_fmt_t::LOG_FMT_FIXED;
+  uint8_t flush_at = _log_flush_at ? _log_flush_at : E12_LOG_RING_SIZE;
+  if (fixed && flush_at > E12_LOG_BATCH_MAX_FIXED) {
+    flush_at = E12_LOG_BATCH_MAX_FIXED;
+  }
+  if (flush_at > E12_LOG_RING_SIZE) flush_at = E12_LOG_RING_SIZE;
+  if (!force && !_log_flush_due && _log_count < flush_at &&
+      (uint32_t)(get_time_ms() - _log_first_ts) < _log_max_age) {
+    return 0;
+  }
 
-    } break;
-    default:
-      return false;
+  int sent = 0;
+  while (_log_count) {
+    e12_packet_t* p;
+    uint8_t n;
+    if (_log_count == 1 && fixed) {
+      // a lone event goes out as plain CMD_LOG
+      p = get_request(e12_cmd_t::CMD_LOG, true, &_log_ring[_log_head]);
+      n = 1;
+    } else {
+      p = get_request(e12_cmd_t::CMD_LOG_BATCH, true, NULL);
+      if (!p) return -1;
+      e12_log_batch_t* batch = (e12_log_batch_t*)p->msg.data;
+      // leave room for the trailer like put_data()
+      uint8_t room = sizeof(batch->data) - get_trailer_len(_integrity);
+      uint8_t off = 0;
+      uint32_t prev_ts = 0;
+      while (batch->count < _log_count) {
+        e12_log_evt_t* evt =
+            &_log_ring[(_log_head + batch->count) % E12_LOG_RING_SIZE];
+        uint8_t len;
+        if (fixed) {
+          len = sizeof(e12_log_evt_t);
+          if (off + len > room) break;
+          memcpy(&batch->data[off], evt, len);
+        } else {
+          len = log_encode(evt, &prev_ts, &batch->data[off], room - off);
+          if (!len) break;
+        }
+        off += len;
+        batch->count++;
+        p->msg.head.len += len;
+      }
+      n = batch->count;
+      if (!n) {
+        // the event does not fit an empty batch and never will, drop it
+#if ESP32_E12_SPEC
+        ESP_LOGW(TAG, "Log event too large, dropped");
+#endif
+        _log_head = (_log_head + 1) % E12_LOG_RING_SIZE;
+        _log_count--;
+        continue;
+      }
+    }
+    if (send(p, true) < 0) return -1;
+    _log_head = (_log_head + n) % E12_LOG_RING_SIZE;
+    _log_count -= n;
+    sent += n;
   }
+  _log_first_ts = get_time_ms();
+  _log_flush_due = false;
+  return sent;
+#else
+  return 0;
+#endif
+}
 
-  // get response packet we send as a read
-  e12_packet_t* p = get_request(e12_cmd_t::CMD_PIN_CTL, true, (void*)NULL);
-  p->msg_ctl.op = (uint8_t) 0; // read
-  p->msg_ctl.response = true;
-  p->msg_ctl.pin = pin;
-  p->msg_ctl.value = (uint16_t)val;
-  p->msg_ctl.head.len = sizeof(p->msg_ctl);
-  send(p, true);
+/**
+ * @brief Set when queued log events are flushed
+ *
+ * @param count flush once this many events are queued, 0 for a full frame
+ * @param max_age_ms flush once the oldest event is this old
+ */
+void e12::set_log_flush(uint8_t count, uint32_t max_age_ms) {
+#if E12_LOG_RING_SIZE
+  // capped to what fits when flushing, the format may still change
+  _log_flush_at = count;
+  _log_max_age = max_age_ms;
+#endif
+}
 
-  return ret;
+/**
+ * @brief Get the number of queued log events
+ *
+ * @return uint8_t number of events
+ */
+uint8_t e12::get_logs_queued() {
+#if E12_LOG_RING_SIZE
+  return _log_count;
+#else
+  return 0;
+#endif
 }
 
 /**
- * @brief Decode the given data into a packet
+ * @brief Set the encoding of the CMD_LOG_BATCH sent
  *
- * @param pkt Pointer to the on-wire packet
- * @param data Data byte to decode
- * @return e12_packet_t* Pointer to the decoded packet
+ * @param fmt encoding
  */
-e12_packet_t* e12::decode(e12_onwire_t* pkt, uint8_t data) {
-  pkt->buf[pkt->recv_len++] = data;
+void e12::set_log_format(e12_log_fmt_t fmt) { _log_fmt = fmt; }
 
-  // 1. Check Magic Markers as soon as we have 2 bytes
-  if (pkt->recv_len == 2) {
-    if (pkt->head.magic[0] != E12_MAGIC_MARKER_1 ||
-        pkt->head.magic[1] != E12_MAGIC_MARKER_2) {
-      pkt->recv_len = 0;  // Reset, this isn't our packet
-      return NULL;
-    }
+/**
+ * @brief Start an empty CMD_BATCH packet
+ *
+ * @param batch Packet to hold the batch
+ */
+void e12::batch_init(e12_packet_t* batch) {
+  memset(&batch->msg.head, 0, sizeof(e12_header_t));
+  batch->msg.head.seq = ++_seq;
+  batch->msg.head.cmd = e12_cmd_t::CMD_BATCH;
+  batch->msg.head.len = sizeof(e12_header_t);
+}
+
+/**
+ * @brief Append a packet to a CMD_BATCH packet
+ *
+ * @param batch Packet started with batch_init()
+ * @param p Packet to append
+ * @return true if appended, false if it does not fit
+ */
+bool e12::batch_add(e12_packet_t* batch, const e12_packet_t* p) {
+  uint8_t len = p->msg.head.len;
+  if (len < sizeof(e12_header_t) || p->msg.head.cmd == e12_cmd_t::CMD_BATCH) {
+    return false;
   }
+  uint8_t off = E12_BATCH_ALIGN(batch->msg.head.len);
+  uint8_t max = E12_MAX_DATA_PAYLOAD - get_trailer_len(_integrity);
+  if (off + len > max) return false;
+
+  memset(&batch->buf[batch->msg.head.len], 0, off - batch->msg.head.len);
+  memcpy(&batch->buf[off], p, len);
+  batch->msg.head.len = off + len;
+  return true;
+}
 
-  // 2. Once we have the full header, we know how long to wait
-  if (pkt->recv_len >= sizeof(e12_onwire_head_t)) {
-    if (pkt->recv_len == pkt->head.len) {
-      uint8_t expected = pkt->head.checksum;
-      uint8_t actual = get_checksum((const char*)&pkt->data,
-                                    pkt->head.len - sizeof(e12_onwire_head_t));
-      pkt->recv_len = 0;  // Reset for next packet
+/**
+ * @brief Get the responses to the sub-packets of a CMD_BATCH request,
+ * batched in one CMD_BATCH response with the seq of the request
+ *
+ * @param p Pointer to the CMD_BATCH request
+ * @return e12_packet_t* Pointer to the response, NULL if no sub-packet
+ * expects one
+ */
+e12_packet_t* e12::get_batch_response(e12_packet_t* p) {
+#if E12_HALF_DUPLEX
+  // every sub-response is built in the buffer holding the request
+  e12_packet_t req;
+  memcpy(&req, p, p->msg.head.len);
+  p = &req;
+#endif
+  e12_packet_t batch;
+  memset(&batch.msg.head, 0, sizeof(e12_header_t));
+  batch.msg.head.seq = p->msg.head.seq;
+  batch.msg.head.IS_RESPONSE = true;
+  batch.msg.head.cmd = e12_cmd_t::CMD_BATCH;
+  batch.msg.head.len = sizeof(e12_header_t);
 
-      if (actual != expected) {
+  uint8_t cnt = 0;
+  uint8_t end = p->msg.head.len - sizeof(e12_header_t);
+  uint8_t off = 0;
+  while (off + sizeof(e12_header_t) <= end) {
+    const e12_header_t* h = (const e12_header_t*)&p->msg.data[off];
+    if (h->len < sizeof(e12_header_t) || off + h->len > end ||
+        h->cmd == e12_cmd_t::CMD_BATCH) {
+      break;
+    }
+    if (h->RESP_EXPECTED) {
+      e12_packet_t sub;
+      memcpy(&sub, h, h->len);
+      memset(&sub.buf[h->len], 0, sizeof(sub) - h->len);
+      e12_packet_t* resp = get_response(&sub);
+      if (resp && batch_add(&batch, resp)) {
+        cnt++;
+      } else if (resp) {
+        // does not fit, the request times out on the requester
 #if ESP32_E12_SPEC
-        ESP_LOGE(TAG, "Checksum Fail! Got %02x, Exp %02x", actual, expected);
+        ESP_LOGW(TAG, "Batch full, response %d dropped", resp->msg.head.seq);
 #endif
-        return NULL;
       }
-      return &pkt->data;
     }
+    off += E12_BATCH_ALIGN(h->len);
   }
+  if (!cnt) return NULL;
 
-  // 3. Safety: Don't overflow if len is garbage
-  if (pkt->recv_len >= sizeof(e12_onwire_t)) {
-    pkt->recv_len = 0;
-  }
+  e12_packet_t* resp = e12_get_packet();
+  memcpy(resp, &batch, batch.msg.head.len);
+  return resp;
+}
 
-  return NULL;
+// e12_frag_src_t over a payload in memory
+static int e12_frag_copy(uint8_t* buf, uint16_t off, uint8_t len, void* ctx) {
+  memcpy(buf, (const uint8_t*)ctx + off, len);
+  return 0;
 }
 
 /**
- * @brief Get a new packet for encoding
+ * @brief Send a payload larger than a frame as fragments
  *
- * @return e12_packet_t* Pointer to the new packet
+ * @param cmd Command of the payload
+ * @param total Payload bytes
+ * @param src Fills each fragment
+ * @param ctx Passed to src
+ * @param response true if the last fragment expects a response
+ * @return int sequence number of the fragments, ERR_RETRY_LATER if they do
+ * not fit get_tx_room(), negative on failure
  */
-e12_packet_t* e12::e12_get_packet() {
-  e12_onwire_t* pkt = get_encode_buffer();
-  memset(pkt, 0, sizeof(e12_onwire_t));
-  pkt->data.msg.head.seq = ++_seq;
-  return &pkt->data;
+int e12::send_fragmented(e12_cmd_t cmd, uint16_t total, e12_frag_src_t src,
+                         void* ctx, bool response) {
+  uint8_t chunk = sizeof(((e12_frag_t*)0)->data) - get_trailer_len(_integrity);
+  uint16_t count = total ? (total + chunk - 1) / chunk : 1;
+  if (!src || count > 0xFF) return -1;
+
+  // all or nothing, a payload cut short is dropped by the receiver anyway
+  uint8_t frame = sizeof(e12_onwire_head_t) + sizeof(e12_header_t) +
+                  offsetof(e12_frag_t, data) + get_trailer_len(_integrity);
+  if ((uint32_t)count * frame + total > get_tx_room()) {
+    return (int)e12_err_t::ERR_RETRY_LATER;
+  }
+
+  uint8_t seq = 0;
+  uint16_t off = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    e12_packet_t* p = e12_get_packet();
+    if (!p) return -1;
+    // every fragment carries the seq of the first
+    if (i == 0) {
+      seq = p->msg.head.seq;
+    } else {
+      p->msg.head.seq = seq;
+      _seq = seq;
+    }
+    p->msg.head.cmd = cmd;
+    p->msg.head.FRAGMENT = true;
+    p->msg.head.RESP_EXPECTED = response && i == count - 1;
+
+    e12_frag_t* f = (e12_frag_t*)p->msg.data;
+    uint8_t len = (total - off < chunk) ? total - off : chunk;
+    f->index = i;
+    f->count = count;
+    f->total = total;
+    if (len && src(f->data, off, len, ctx) < 0) return -1;
+    p->msg.head.len = sizeof(e12_header_t) + offsetof(e12_frag_t, data) + len;
+    if (send(p, true) < 0) return -1;
+    off += len;
+  }
+  return seq;
 }
 
 /**
- * @brief Gets the status of the e12 node.
- * @return Status of the e12 node
+ * @brief Send a payload in memory as fragments
+ *
+ * @param cmd Command of the payload
+ * @param data Payload
+ * @param len Payload bytes
+ * @param response true if the last fragment expects a response
+ * @return int sequence number of the fragments, negative on failure
  */
-e12_node_op_status_t e12::get_node_status() { return _status.op_status; }
+int e12::send_fragmented(e12_cmd_t cmd, const void* data, uint16_t len,
+                         bool response) {
+  if (!data && len) return -1;
+  return send_fragmented(cmd, len, e12_frag_copy, (void*)data, response);
+}
 
 /**
- * @brief Sets the status of the e12 node.
- * @param status Status to be set
- * @param data uint32_t size data to be stored relevant to the status e.g for
- * SLEEP this is ms till the e12_node is in sleep mode
- * @return Status of the e12 node
+ * @brief Check a fragment follows the previous one and pass it on
+ *
+ * @param p Pointer to the fragment
+ * @return int on_fragment() result, negative if the payload was dropped
  */
-e12_node_op_status_t e12::set_node_status(e12_node_op_status_t status,
-                                          uint32_t data) {
-  _status.op_status = status;
-  switch (status) {
-    case e12_node_op_status_t::STATUS_ACTIVE:
-      _status.node_wake_up_ms = 0;
-      on_wakeup();
-      break;
-    case e12_node_op_status_t::STATUS_SLEEP:
-      _status.node_wake_up_ms = data + get_time_ms();
-      break;
-    default:
-      break;
+int e12::on_receive_fragment(e12_packet_t* p) {
+  e12_frag_t* f = (e12_frag_t*)p->msg.data;
+  uint8_t head = sizeof(e12_header_t) + offsetof(e12_frag_t, data);
+  if (p->msg.head.len < head || f->index >= f->count) {
+#if ESP32_E12_SPEC
+    ESP_LOGE(TAG, "Malformed fragment");
+#endif
+    return -1;
   }
-  return _status.op_status;
+  uint8_t len = p->msg.head.len - head;
+  bool last = f->index == f->count - 1;
+
+  if (f->index == 0) {
+    // a new payload replaces an unfinished one
+    drop_fragments();
+    _frag.seq = p->msg.head.seq;
+    _frag.cmd = p->msg.head.cmd;
+    _frag.count = f->count;
+    _frag.total = f->total;
+    _frag.next = 0;
+    _frag.off = 0;
+    _frag.in_use = true;
+  } else if (!_frag.in_use || _frag.seq != p->msg.head.seq ||
+             _frag.cmd != p->msg.head.cmd || _frag.next != f->index ||
+             _frag.count != f->count) {
+#if ESP32_E12_SPEC
+    ESP_LOGW(TAG, "Fragment %d of seq %d out of order", f->index,
+             p->msg.head.seq);
+#endif
+    drop_fragments();
+    return -1;
+  }
+  if (_frag.off + len > _frag.total ||
+      (last && _frag.off + len != _frag.total)) {
+    drop_fragments();
+    return -1;
+  }
+
+  _frag.ts = get_time_ms();
+  int ret = on_fragment(_frag.cmd, _frag.off, f->data, len, _frag.total);
+  if (ret < 0) {
+    // refused by on_fragment(), it already knows
+    _frag.in_use = false;
+    return ret;
+  }
+  _frag.off += len;
+  _frag.next++;
+  if (last) {
+    _frag.in_use = false;
+    if (p->msg.head.IS_RESPONSE) complete_pending(p);
+  }
+  return ret;
 }
 
 /**
- * @brief Validates a READ request (Any configured pin is readable)
+ * @brief Drop the payload being reassembled
  */
-int e12::on_ctl_read(uint8_t pin) {
-  if (pin > 31) return -1;
+void e12::drop_fragments() {
+  if (!_frag.in_use) return;
+  _frag.in_use = false;
+  on_fragment(_frag.cmd, _frag.off, NULL, 0, _frag.total);
+}
 
-  uint32_t bit = (1UL << pin);
-  return ((_pin_mask & bit) != 0) ? 0 : -1;
+/**
+ * @brief Reassemble fragments into E12_FRAG_BUF_SIZE
+ *
+ * @param cmd Command of the payload
+ * @param off Offset of data in the payload
+ * @param data Fragment bytes, NULL if the payload was dropped
+ * @param len Fragment bytes
+ * @param total Payload bytes
+ * @return int negative to drop the rest of the payload
+ */
+int e12::on_fragment(e12_cmd_t cmd, uint16_t off, const uint8_t* data,
+                     uint8_t len, uint16_t total) {
+#if E12_FRAG_BUF_SIZE
+  if (!data || total > E12_FRAG_BUF_SIZE) return -1;
+  memcpy(&_frag_buf[off], data, len);
+  if (off + len < total) return 0;
+  // JSON handlers may expect a terminated string
+  if (total < E12_FRAG_BUF_SIZE) _frag_buf[total] = 0;
+  return on_reassembled(cmd, _frag_buf, total);
+#else
+  return -1;
+#endif
 }
 
 /**
- * @brief Validates a WRITE request (PIN <- IN only)
+ * @brief Handle a reassembled payload
+ *
+ * @param cmd Command of the payload
+ * @param data Payload
+ * @param len Payload bytes
+ * @return int 0 on success, negative on failure
  */
-bool e12::on_ctl_write(uint8_t pin, uint32_t val) {
-  if (pin > 31) return false;
+int e12::on_reassembled(e12_cmd_t cmd, const uint8_t* data, uint16_t len) {
+  if (cmd != e12_cmd_t::CMD_CONFIG && cmd != e12_cmd_t::CMD_STATE) return 0;
+  uint8_t head = offsetof(e12_data_t, data);
+  if (len < head) return -1;
+  const e12_data_t* d = (const e12_data_t*)data;
+  const uint8_t* body = data + head;
+  len -= head;
+
+  if (cmd == e12_cmd_t::CMD_CONFIG) {
+    if (d->IS_JSON) {
+      _status.CONFIGURED = on_config((const char*)body, len);
+    } else {
+      e12_tlv_reader r(body, len);
+      _status.CONFIGURED = on_config_bin(&r) != 0;
+    }
+  } else if (d->STORE) {
+    if (d->IS_JSON) {
+      return on_restore_state((const char*)body, len);
+    }
+    e12_tlv_reader r(body, len);
+    return on_restore_state_bin(&r);
+  }
+  return 0;
+}
+
+#if E12_FW_MAX_CHUNKS
+#define FW_BIT(rx, i) ((rx).bitmap[(i) >> 3] & (1 << ((i) & 7)))
+#define FW_SET(rx, i) ((rx).bitmap[(i) >> 3] |= (1 << ((i) & 7)))
+#define FW_CLR(rx, i) ((rx).bitmap[(i) >> 3] &= ~(1 << ((i) & 7)))
+
+/**
+ * @brief Start or resume receiving the offered firmware
+ *
+ * @param info Offered image
+ */
+void e12::fw_rx_begin(const e12_fw_info_t* info) {
+  uint16_t cs = info->chunk_size;
+  uint32_t chunks = cs ? (info->size + cs - 1) / cs : 0;
+  if (!cs || cs > sizeof(((e12_fw_chunk_t*)0)->data) || !chunks ||
+      chunks > E12_FW_MAX_CHUNKS) {
+    _fw_rx.in_use = false;
+    _fw_rx.chunks = 0;
+    fw_rx_ack(e12_fw_status_t::FW_REFUSED);
+    return;
+  }
+
+  // the same image, in RAM or saved before a reset, is resumed
+  if (!_fw_rx.in_use && on_fw_load(&_fw_rx) < 0) _fw_rx.in_use = false;
+  if (_fw_rx.in_use && _fw_rx.info.size == info->size &&
+      _fw_rx.info.chunk_size == cs &&
+      !memcmp(_fw_rx.info.sha256, info->sha256, E12_SHA256_LEN)) {
+    _fw_rx.info.window = info->window;
+    fw_rx_ack(e12_fw_status_t::FW_RECEIVING);
+    return;
+  }
+
+  _fw_rx.in_use = false;
+  _fw_rx.chunks = 0;
+  if (on_fw_begin(info) < 0) {
+    fw_rx_ack(e12_fw_status_t::FW_REFUSED);
+    return;
+  }
+  memcpy(&_fw_rx.info, info, sizeof(e12_fw_info_t));
+  _fw_rx.chunks = chunks;
+  _fw_rx.hashed = 0;
+  _fw_rx.received = 0;
+  _fw_rx.since_ack = 0;
+  _fw_rx.status = e12_fw_status_t::FW_RECEIVING;
+  memset(_fw_rx.bitmap, 0, (chunks + 7) / 8);
+  sha256_init(&_fw_rx.sha);
+  _fw_rx.in_use = true;
+  fw_rx_ack(e12_fw_status_t::FW_RECEIVING);
+}
+
+/**
+ * @brief Write a firmware chunk and hash what became contiguous
+ *
+ * @param c Chunk
+ * @param len Chunk bytes
+ */
+void e12::fw_rx_chunk(const e12_fw_chunk_t* c, uint8_t len) {
+  // after a reset chunks keep coming, pick up where the saved state was
+  if (!_fw_rx.in_use && _fw_rx.status == e12_fw_status_t::FW_RECEIVING &&
+      on_fw_load(&_fw_rx) < 0) {
+    _fw_rx.in_use = false;
+    _fw_rx.chunks = 0;
+  }
+  if (c->index >= _fw_rx.chunks) return;
+  if (!_fw_rx.in_use) {
+    // the sender missed how the transfer ended
+    if (_fw_rx.status != e12_fw_status_t::FW_RECEIVING) {
+      fw_rx_ack(_fw_rx.status);
+    }
+    return;
+  }
+  uint16_t cs = _fw_rx.info.chunk_size;
+  uint32_t off = (uint32_t)c->index * cs;
+  uint8_t want = (_fw_rx.info.size - off < cs) ? _fw_rx.info.size - off : cs;
+  if (len != want) return;
+
+  if (FW_BIT(_fw_rx, c->index)) {
+    // the sender missed an ack, tell it again
+    fw_rx_ack(e12_fw_status_t::FW_RECEIVING);
+    return;
+  }
+  if (on_fw_write(off, c->data, len) < 0) {
+    _fw_rx.in_use = false;
+    _fw_rx.status = e12_fw_status_t::FW_WRITE_ERR;
+    on_fw_save(&_fw_rx);
+    fw_rx_ack(e12_fw_status_t::FW_WRITE_ERR);
+    return;
+  }
+  FW_SET(_fw_rx, c->index);
+  _fw_rx.received++;
+  _fw_rx.since_ack++;
+
+  bool gap = c->index != _fw_rx.hashed;
+  if (!gap) {
+    sha256_update(&_fw_rx.sha, c->data, len);
+    _fw_rx.hashed++;
+    // chunks that came early are read back to be hashed in order
+    uint8_t buf[E12_FW_READ_PIECE];
+    while (_fw_rx.hashed < _fw_rx.chunks && FW_BIT(_fw_rx, _fw_rx.hashed)) {
+      off = (uint32_t)_fw_rx.hashed * cs;
+      uint8_t n = (_fw_rx.info.size - off < cs) ? _fw_rx.info.size - off : cs;
+      uint8_t done = 0;
+      while (done < n) {
+        uint8_t piece = (uint8_t)(n - done) < sizeof(buf) ? n - done : sizeof(buf);
+        if (on_fw_read(off + done, buf, piece) < 0) break;
+        sha256_update(&_fw_rx.sha, buf, piece);
+        done += piece;
+      }
+      if (!done) {
+        // nothing hashed yet, ask for it again
+        FW_CLR(_fw_rx, _fw_rx.hashed);
+        _fw_rx.received--;
+        break;
+      }
+      if (done < n) {
+        _fw_rx.in_use = false;
+        _fw_rx.status = e12_fw_status_t::FW_WRITE_ERR;
+        on_fw_save(&_fw_rx);
+        fw_rx_ack(e12_fw_status_t::FW_WRITE_ERR);
+        return;
+      }
+      _fw_rx.hashed++;
+    }
+  }
+
+  if (_fw_rx.hashed == _fw_rx.chunks) {
+    uint8_t digest[E12_SHA256_LEN];
+    sha256_final(&_fw_rx.sha, digest);
+    bool ok = !memcmp(digest, _fw_rx.info.sha256, E12_SHA256_LEN);
+    _fw_rx.in_use = false;
+    _fw_rx.status =
+        ok ? e12_fw_status_t::FW_DONE : e12_fw_status_t::FW_BAD_HASH;
+    on_fw_save(&_fw_rx);
+    on_fw_done(&_fw_rx.info, ok);
+    fw_rx_ack(_fw_rx.status);
+    return;
+  }
+  uint8_t every = _fw_rx.info.window / 2 ? _fw_rx.info.window / 2 : 1;
+  if (gap || _fw_rx.since_ack >= every) {
+    on_fw_save(&_fw_rx);
+    fw_rx_ack(e12_fw_status_t::FW_RECEIVING);
+  }
+}
+
+/**
+ * @brief Send CMD_FW_ACK with the chunks received so far
+ *
+ * @param status State of the transfer
+ */
+void e12::fw_rx_ack(e12_fw_status_t status) {
+  e12_packet_t* p = e12_get_packet();
+  if (!p) return;
+  p->msg.head.cmd = e12_cmd_t::CMD_FW_ACK;
+  e12_fw_ack_t* ack = e12_view<e12_fw_ack_t>(p).reserve();
+  memset(ack, 0, sizeof(e12_fw_ack_t));
+  ack->status = status;
+  if (status == e12_fw_status_t::FW_RECEIVING ||
+      status == e12_fw_status_t::FW_DONE) {
+    ack->base = _fw_rx.hashed;
+    for (uint8_t i = 0; i < 32 && _fw_rx.hashed + i < _fw_rx.chunks; i++) {
+      if (FW_BIT(_fw_rx, _fw_rx.hashed + i)) ack->mask |= 1UL << i;
+    }
+  }
+  _fw_rx.since_ack = 0;
+  send(p, true);
+}
+#endif
+
+/**
+ * @brief Stream a firmware image to the peer
+ *
+ * @param info Image size, version and SHA-256
+ * @param src Reads the image
+ * @param ctx Passed to src
+ * @return int 0 on success, negative on failure
+ */
+int e12::fw_send(const e12_fw_info_t* info, e12_fw_src_t src, void* ctx) {
+#if E12_FW_SENDER
+  if (!info || !src || !info->size) return -1;
+  e12_fw_info_t* fi = &_fw_tx.info;
+  memcpy(fi, info, sizeof(e12_fw_info_t));
+  if (!fi->chunk_size) {
+    // as much as fits with the integrity trailer, 4 byte aligned
+    fi->chunk_size = (sizeof(((e12_fw_chunk_t*)0)->data) -
+                      get_trailer_len(_integrity)) & ~3;
+  }
+  if (!fi->window) fi->window = E12_FW_WINDOW;
+  if (fi->window > 32) fi->window = 32;
+  uint32_t chunks = (fi->size + fi->chunk_size - 1) / fi->chunk_size;
+  if (chunks > 0xFFFF) return -1;
+
+  _fw_tx.chunks = chunks;
+  _fw_tx.base = 0;
+  _fw_tx.acked = 0;
+  _fw_tx.sent = 0;
+  _fw_tx.retries = 0;
+  _fw_tx.src = src;
+  _fw_tx.ctx = ctx;
+  _fw_tx.acked_begin = false;
+  _fw_tx.in_use = true;
+  _fw_tx.ts = get_time_ms();
+
+  e12_packet_t* p = e12_get_packet();
+  if (!p) return -1;
+  p->msg.head.cmd = e12_cmd_t::CMD_FW_BEGIN;
+  memcpy(e12_view<e12_fw_info_t>(p).reserve(), fi, sizeof(e12_fw_info_t));
+  return send(p, true) < 0 ? -1 : 0;
+#else
+  return -1;
+#endif
+}
+
+/**
+ * @brief Resend unacknowledged firmware chunks after the timeout
+ */
+void e12::fw_poll() {
+#if E12_FW_SENDER
+  if (!_fw_tx.in_use || (uint32_t)(get_time_ms() - _fw_tx.ts) < _timeout) {
+    return;
+  }
+  if (++_fw_tx.retries > E12_FW_RETRIES) {
+    _fw_tx.in_use = false;
+    on_fw_sent(e12_fw_status_t::FW_TIMEOUT);
+    return;
+  }
+  _fw_tx.ts = get_time_ms();
+  if (!_fw_tx.acked_begin) {
+    e12_packet_t* p = e12_get_packet();
+    if (!p) return;
+    p->msg.head.cmd = e12_cmd_t::CMD_FW_BEGIN;
+    memcpy(e12_view<e12_fw_info_t>(p).reserve(), &_fw_tx.info,
+           sizeof(e12_fw_info_t));
+    send(p, true);
+    return;
+  }
+  // whatever was in flight is presumed lost
+  _fw_tx.sent = 0;
+  fw_tx_window();
+#endif
+}
+
+/**
+ * @brief Check a firmware image is being sent
+ *
+ * @return true until on_fw_sent() was called
+ */
+bool e12::fw_sending() {
+#if E12_FW_SENDER
+  return _fw_tx.in_use;
+#else
+  return false;
+#endif
+}
+
+#if E12_FW_SENDER
+/**
+ * @brief Apply a CMD_FW_ACK and send the next chunks
+ *
+ * @param ack Acknowledgement from the receiver
+ */
+void e12::fw_tx_ack(const e12_fw_ack_t* ack) {
+  if (!_fw_tx.in_use) return;
+  if (ack->status != e12_fw_status_t::FW_RECEIVING) {
+    _fw_tx.in_use = false;
+    on_fw_sent(ack->status);
+    return;
+  }
+  // chunks sent before the window slid stay in flight
+  uint16_t d = ack->base - _fw_tx.base;
+  if (ack->base < _fw_tx.base) {
+    _fw_tx.sent = 0;
+  } else {
+    _fw_tx.sent = d < 32 ? _fw_tx.sent >> d : 0;
+  }
+  _fw_tx.base = ack->base;
+  _fw_tx.acked = ack->mask;
+  _fw_tx.acked_begin = true;
+  _fw_tx.retries = 0;
+  _fw_tx.ts = get_time_ms();
+  fw_tx_window();
+}
+
+/**
+ * @brief Send the chunks of the window neither acknowledged nor in flight
+ *
+ * @return int number of chunks sent, negative on failure
+ */
+int e12::fw_tx_window() {
+  uint16_t cs = _fw_tx.info.chunk_size;
+  int n = 0;
+  for (uint8_t i = 0; i < _fw_tx.info.window; i++) {
+    uint16_t index = _fw_tx.base + i;
+    if (index >= _fw_tx.chunks) break;
+    if ((_fw_tx.acked | _fw_tx.sent) & (1UL << i)) continue;
+
+    uint32_t off = (uint32_t)index * cs;
+    uint8_t len = (_fw_tx.info.size - off < cs) ? _fw_tx.info.size - off : cs;
+    e12_packet_t* p = e12_get_packet();
+    if (!p) return -1;
+    p->msg.head.cmd = e12_cmd_t::CMD_FW_CHUNK;
+    e12_fw_chunk_t* c = (e12_fw_chunk_t*)p->msg.data;
+    c->index = index;
+    c->resv = 0;
+    if (_fw_tx.src(c->data, off, len, _fw_tx.ctx) < 0) {
+      _fw_tx.in_use = false;
+      on_fw_sent(e12_fw_status_t::FW_REFUSED);
+      return -1;
+    }
+    p->msg.head.len = sizeof(e12_header_t) + offsetof(e12_fw_chunk_t, data) +
+                      len;
+    if (send(p, true) < 0) return -1;
+    _fw_tx.sent |= 1UL << i;
+    n++;
+  }
+  return n;
+}
+#endif
+
+/**
+ * @brief Track a request until its response arrives or it times out
+ *
+ * @param p Pointer to the request
+ * @param cb Completion callback, NULL for the one set by set_response_cb()
+ * @param ctx Passed to cb
+ * @return int sequence number, -1 if the table is full
+ */
+int e12::add_pending(e12_packet_t* p, e12_resp_cb_t cb, void* ctx) {
+  if (!p) return -1;
+  uint8_t seq = p->msg.head.seq;
+  e12_pending_t* e = get_pending(seq);
+  if (e) {
+    // sent after being tracked, keep the callback and restart the clock
+    if (e->cmd == p->msg.head.cmd) {
+      if (cb) {
+        e->cb = cb;
+        e->ctx = ctx;
+      }
+      e->ts = get_time_ms();
+      e->held = false;
+      e->done = false;
+      return seq;
+    }
+    // the seq wrapped around, the old request is long gone
+    e->in_use = false;
+  }
+
+  for (int i = 0; i < E12_MAX_PENDING; i++) {
+    e = &_pending[i];
+    if (!e->in_use) {
+      e->seq = seq;
+      e->cmd = p->msg.head.cmd;
+      e->ts = get_time_ms();
+      e->cb = cb;
+      e->ctx = ctx;
+      e->held = false;
+      e->done = false;
+      e->in_use = true;
+      return seq;
+    }
+  }
+#if ESP32_E12_SPEC
+  ESP_LOGW(TAG, "No free pending slot for seq %d", seq);
+#endif
+  return -1;
+}
+
+/**
+ * @brief Get the pending request with the given sequence number
+ *
+ * @param seq Sequence number
+ * @return e12_pending_t* Pointer to the entry, NULL if not pending
+ */
+e12_pending_t* e12::get_pending(uint8_t seq) {
+  for (int i = 0; i < E12_MAX_PENDING; i++) {
+    if (_pending[i].in_use && _pending[i].seq == seq) return &_pending[i];
+  }
+  return NULL;
+}
+
+/**
+ * @brief Check if a request for the command waits for a response
+ *
+ * @param cmd Command
+ * @return true if one is pending
+ */
+bool e12::is_pending(e12_cmd_t cmd) {
+  for (int i = 0; i < E12_MAX_PENDING; i++) {
+    if (_pending[i].in_use && _pending[i].cmd == cmd) return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Get the number of requests waiting for a response
+ *
+ * @return uint8_t number of pending requests
+ */
+uint8_t e12::get_pending_count() {
+  uint8_t n = 0;
+  for (int i = 0; i < E12_MAX_PENDING; i++) {
+    if (_pending[i].in_use) n++;
+  }
+  return n;
+}
+
+/**
+ * @brief Drop a pending request without calling its callback
+ *
+ * @param seq Sequence number
+ */
+void e12::cancel_pending(uint8_t seq) {
+  e12_pending_t* e = get_pending(seq);
+  if (e) e->in_use = false;
+}
+
+/**
+ * @brief Hold the timeout of a request that is not written yet
+ *
+ * @param seq Sequence number
+ */
+void e12::hold_pending(uint8_t seq) {
+  e12_pending_t* e = get_pending(seq);
+  if (e) e->held = true;
+}
+
+/**
+ * @brief Start the timeout of a held request, it was just written
+ *
+ * @param seq Sequence number
+ */
+void e12::start_pending(uint8_t seq) {
+  e12_pending_t* e = get_pending(seq);
+  if (e && e->held) {
+    e->held = false;
+    e->ts = get_time_ms();
+  }
+}
+
+/**
+ * @brief End a pending request without a response packet
+ *
+ * @param seq Sequence number
+ * @param err Passed to the callback
+ * @return true if the request was pending
+ */
+bool e12::end_pending(uint8_t seq, e12_err_t err) {
+  e12_pending_t* e = get_pending(seq);
+  if (!e || e->done) return false;
+  // the caller may still be inside send_async(), report it later
+  e->done = true;
+  e->err = err;
+  return true;
+}
+
+/**
+ * @brief Complete the pending request answered by the response. The entry
+ * is freed before the callback so it can send the next request.
+ *
+ * @param p Pointer to the response
+ * @return true if a pending request matched
+ */
+bool e12::complete_pending(e12_packet_t* p) {
+  e12_pending_t* e = get_pending(p->msg.head.seq);
+  if (!e || e->cmd != p->msg.head.cmd) return false;
+
+  e12_resp_cb_t cb = e->cb ? e->cb : _resp_cb;
+  void* ctx = e->cb ? e->ctx : _resp_ctx;
+  e->in_use = false;
+  if (cb) cb(p->msg.head.seq, e12_err_t::ERR_NONE, p, ctx);
+  return true;
+}
+
+/**
+ * @brief Report requests ended by end_pending(), expire requests that got
+ * no response within the timeout, and a payload whose next fragment is
+ * overdue
+ *
+ * @return int number of expired requests
+ */
+int e12::expire_pending() {
+  uint32_t now = get_time_ms();
+  if (_frag.in_use && (uint32_t)(now - _frag.ts) >= E12_FRAG_TIMEOUT) {
+#if ESP32_E12_SPEC
+    ESP_LOGW(TAG, "Fragments of seq %d timed out", _frag.seq);
+#endif
+    drop_fragments();
+  }
+  int n = 0;
+  for (int i = 0; i < E12_MAX_PENDING; i++) {
+    e12_pending_t* e = &_pending[i];
+    if (!e->in_use) continue;
+    e12_err_t err = e->err;
+    if (!e->done) {
+      if (e->held || (uint32_t)(now - e->ts) < _timeout) continue;
+      err = e12_err_t::ERR_TIMEOUT;
+      n++;
+#if ESP32_E12_SPEC
+      ESP_LOGW(TAG, "Request %d (cmd %d) timed out", e->seq, (int)e->cmd);
+#endif
+    }
+
+    e12_resp_cb_t cb = e->cb ? e->cb : _resp_cb;
+    void* ctx = e->cb ? e->ctx : _resp_ctx;
+    e->in_use = false;
+    if (cb) cb(e->seq, err, NULL, ctx);
+  }
+  return n;
+}
+
+#if E12_ENABLE_PIN_CTL
+int16_t e12::on_ctl(ctl_op_t op, uint8_t pin, uint32_t val) {
+  switch (op) {
+    case ctl_op_t::READ: {
+      if (e12::on_ctl_read(pin) < 0) return -1;
+      return on_ctl_read(pin);
+    }
+    case ctl_op_t::WRITE: {
+      if (!e12::on_ctl_write(pin, val) || !on_ctl_write(pin, val)) return -1;
+      return val;
+    }
+    default:
+      return -1;
+  }
+}
+#endif
+
+/**
+ * @brief Drop the first byte of the buffer and everything up to the next
+ * possible magic marker
+ *
+ * @param pkt Pointer to the receive buffer
+ */
+static void e12_resync(e12_onwire_t* pkt) {
+  const uint8_t* m = (const uint8_t*)memchr(&pkt->buf[1], E12_MAGIC_MARKER_1,
+                                            pkt->recv_len - 1);
+  if (!m) {
+    pkt->recv_len = 0;
+    return;
+  }
+  uint8_t skip = m - pkt->buf;
+  pkt->recv_len -= skip;
+  memmove(pkt->buf, m, pkt->recv_len);
+}
+
+/**
+ * @brief Map the second magic marker to the integrity check it announces
+ *
+ * @param marker second magic marker
+ * @param mode set to the integrity check
+ * @return true if the marker is valid
+ */
+static bool e12_marker_integrity(uint8_t marker, e12_integrity_t* mode) {
+  switch (marker) {
+    case E12_MAGIC_MARKER_2:
+      *mode = e12_integrity_t::INTEGRITY_XOR;
+      return true;
+    case E12_MAGIC_MARKER_2_CRC16:
+      *mode = e12_integrity_t::INTEGRITY_CRC16;
+      return true;
+    case E12_MAGIC_MARKER_2_CRC32:
+      *mode = e12_integrity_t::INTEGRITY_CRC32;
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Verify the integrity check of a complete frame
+ *
+ * @param pkt Pointer to the receive buffer
+ * @param mode integrity check announced by the frame
+ * @return true if the frame is intact
+ */
+static bool e12_frame_intact(e12_onwire_t* pkt, e12_integrity_t mode) {
+  uint8_t len = pkt->head.len - sizeof(e12_onwire_head_t) -
+                e12::get_trailer_len(mode);
+  const uint8_t* data = (const uint8_t*)&pkt->data;
+  const uint8_t* crc = data + len;
+  switch (mode) {
+    case e12_integrity_t::INTEGRITY_CRC16: {
+      uint16_t v = e12::get_crc16(data, len);
+      return crc[0] == (uint8_t)v && crc[1] == (uint8_t)(v >> 8);
+    }
+    case e12_integrity_t::INTEGRITY_CRC32: {
+      uint32_t v = e12::get_crc32(data, len);
+      return crc[0] == (uint8_t)v && crc[1] == (uint8_t)(v >> 8) &&
+             crc[2] == (uint8_t)(v >> 16) && crc[3] == (uint8_t)(v >> 24);
+    }
+    default: {
+      uint8_t actual = e12::get_checksum((const char*)data, len);
+#if ESP32_E12_SPEC
+      if (actual != pkt->head.checksum) {
+        ESP_LOGE(TAG, "Checksum Fail! Got %02x, Exp %02x", actual,
+                 pkt->head.checksum);
+      }
+#endif
+      return actual == pkt->head.checksum;
+    }
+  }
+}
+
+/**
+ * @brief Check the buffered bytes for a complete frame
+ *
+ * @param pkt Pointer to the receive buffer
+ * @return e12_packet_t* Pointer to the complete frame or NULL
+ */
+e12_packet_t* e12::frame_scan(e12_onwire_t* pkt) {
+  while (pkt->recv_len) {
+    uint8_t n = pkt->recv_len;
+    e12_integrity_t mode = e12_integrity_t::INTEGRITY_XOR;
+
+    // 1. Magic markers
+    bool bad = pkt->buf[0] != E12_MAGIC_MARKER_1 ||
+               (n >= 2 && !e12_marker_integrity(pkt->buf[1], &mode));
+
+    // 2. Reject impossible lengths as soon as the header is complete
+    if (!bad && n >= sizeof(e12_onwire_head_t)) {
+      bad = pkt->head.len < E12_MIN_FRAME_LEN + get_trailer_len(mode) ||
+            pkt->head.len > E12_MAX_FRAME_LEN ||
+            (mode != e12_integrity_t::INTEGRITY_XOR &&
+             pkt->head.checksum != (uint8_t)~pkt->head.len);
+
+      // 3. Complete frame
+      if (!bad && n >= pkt->head.len) {
+        if (e12_frame_intact(pkt, mode)) {
+          _rx_integrity = mode;
+          if (_integrity_follow) _integrity = mode;
+          pkt->rx_done = true;
+          return &pkt->data;
+        }
+        bad = true;
+      }
+    }
+
+    if (!bad) break;  // wait for more bytes
+    e12_resync(pkt);
+  }
+  return NULL;
+}
+
+/**
+ * @brief Drop the delivered frame, keep the bytes received after it
+ *
+ * @param pkt Pointer to the receive buffer
+ */
+void e12::frame_consume(e12_onwire_t* pkt) {
+  if (!pkt->rx_done) return;
+  pkt->rx_done = false;
+  uint8_t len = pkt->head.len;
+  uint8_t tail = pkt->recv_len - len;
+  if (tail) memmove(pkt->buf, &pkt->buf[len], tail);
+  pkt->recv_len = tail;
+}
+
+/**
+ * @brief Decode the given data into a packet
+ *
+ * @param pkt Pointer to the on-wire packet
+ * @param data Data byte to decode
+ * @return e12_packet_t* Pointer to the decoded packet
+ */
+e12_packet_t* e12::decode(e12_onwire_t* pkt, uint8_t data) {
+  frame_consume(pkt);
+
+  // Safety: never write into the bookkeeping past the frame area
+  if (pkt->recv_len >= E12_MAX_FRAME_LEN) e12_resync(pkt);
+
+  pkt->buf[pkt->recv_len++] = data;
+  return frame_scan(pkt);
+}
+
+/**
+ * @brief Callback used by decode() on a span when none is given
+ */
+static bool e12_dispatch_frame(e12_packet_t* p, void* ctx) {
+  ((e12*)ctx)->on_receive(p);
+  return true;
+}
+
+/**
+ * @brief Callback used by decode_one() to stop at the first frame
+ */
+static bool e12_take_frame(e12_packet_t* p, void* ctx) {
+  *(e12_packet_t**)ctx = p;
+  return false;
+}
+
+/**
+ * @brief Decode a span of received bytes up to the first complete frame
+ *
+ * @param buf Pointer to the received bytes
+ * @param n Number of bytes
+ * @param used Set to the number of bytes consumed
+ * @return e12_packet_t* Pointer to the decoded packet or NULL
+ */
+e12_packet_t* e12::decode_one(const uint8_t* buf, size_t n, size_t* used) {
+  e12_packet_t* p = NULL;
+  *used = decode(buf, n, e12_take_frame, &p);
+  return p;
+}
+
+/**
+ * @brief Decode a span of received bytes, emitting every complete frame
+ *
+ * Unlike the per-byte decode() this looks for the magic marker with
+ * memchr() and copies header and payload with memcpy(), the checksum is
+ * verified once per frame.
+ *
+ * @param buf Pointer to the received bytes
+ * @param n Number of bytes
+ * @param cb Called for every complete frame, on_receive() if NULL
+ * @param ctx Passed to cb
+ * @return size_t Number of bytes consumed
+ */
+size_t e12::decode(const uint8_t* buf, size_t n, e12_frame_cb_t cb,
+                   void* ctx) {
+  if (!cb) {
+    cb = e12_dispatch_frame;
+    ctx = this;
+  }
+
+  e12_onwire_t* pkt = get_decode_buffer();
+  const uint8_t* p = buf;
+  const uint8_t* end = buf + n;
+
+  frame_consume(pkt);
+  while (true) {
+    // buffered bytes may hold several frames after a resync
+    e12_packet_t* f = frame_scan(pkt);
+    if (f) {
+      if (!cb(f, ctx)) break;
+      frame_consume(pkt);
+      continue;
+    }
+    if (p == end) break;
+
+    // 1. Hunt for the magic marker
+    if (pkt->recv_len == 0) {
+      const uint8_t* m =
+          (const uint8_t*)memchr(p, E12_MAGIC_MARKER_1, end - p);
+      if (!m) {
+        p = end;
+        break;
+      }
+      pkt->buf[0] = *m;
+      pkt->recv_len = 1;
+      p = m + 1;
+      continue;
+    }
+
+    // 2. Copy the rest of the header, then the rest of the frame
+    size_t want = (pkt->recv_len < sizeof(e12_onwire_head_t))
+                      ? sizeof(e12_onwire_head_t) - pkt->recv_len
+                      : pkt->head.len - pkt->recv_len;
+    size_t take = ((size_t)(end - p) < want) ? (size_t)(end - p) : want;
+    memcpy(&pkt->buf[pkt->recv_len], p, take);
+    pkt->recv_len += take;
+    p += take;
+  }
+  return p - buf;
+}
+
+/**
+ * @brief Get a new packet for encoding
+ *
+ * @return e12_packet_t* Pointer to the new packet
+ */
+e12_packet_t* e12::e12_get_packet() {
+  e12_onwire_t* pkt = get_encode_buffer();
+#if E12_HALF_DUPLEX
+  // the buffer now holds an outgoing frame, not received bytes
+  pkt->recv_len = 0;
+  pkt->rx_done = false;
+#endif
+  // only the header, every request/response writes the payload it sends
+  memset(&pkt->data.msg.head, 0, sizeof(e12_header_t));
+  pkt->data.msg.head.seq = ++_seq;
+  return &pkt->data;
+}
+
+/**
+ * @brief Check a received frame was overwritten by a packet sent since
+ *
+ * @param p Packet being handled
+ * @return true if p is gone
+ */
+bool e12::rx_overwritten(const e12_packet_t* p) {
+#if E12_HALF_DUPLEX
+  e12_onwire_t* pkt = get_decode_buffer();
+  if (p == &pkt->data && !pkt->rx_done) {
+#if ESP32_E12_SPEC
+    ESP_LOGE(TAG, "Received frame overwritten, half duplex");
+#endif
+    return true;
+  }
+#endif
+  return false;
+}
+
+/**
+ * @brief Gets the status of the e12 node.
+ * @return Status of the e12 node
+ */
+e12_node_op_status_t e12::get_node_status() { return _status.op_status; }
+
+/**
+ * @brief Sets the status of the e12 node.
+ * @param status Status to be set
+ * @param data uint32_t size data to be stored relevant to the status e.g for
+ * SLEEP this is ms till the e12_node is in sleep mode
+ * @return Status of the e12 node
+ */
+e12_node_op_status_t e12::set_node_status(e12_node_op_status_t status,
+                                          uint32_t data) {
+  _status.op_status = status;
+  switch (status) {
+    case e12_node_op_status_t::STATUS_ACTIVE:
+      _status.node_wake_up_ms = 0;
+      on_wakeup();
+      break;
+    case e12_node_op_status_t::STATUS_SLEEP:
+      _status.node_wake_up_ms = data + get_time_ms();
+      break;
+    default:
+      break;
+  }
+  return _status.op_status;
+}
+
+/**
+ * @brief Validates a READ request (Any configured pin is readable)
+ */
+int e12::on_ctl_read(uint8_t pin) {
+  if (pin > 31) return -1;
+
+  uint32_t bit = (1UL << pin);
+  return ((_pin_mask & bit) != 0) ? 0 : -1;
+}
+
+/**
+ * @brief Pass a vendor command to its handler, get_response() answers it
+ *
+ * @param p Packet
+ * @return int from the handler, negative if the command is unknown
+ */
+int e12::on_receive_vendor(e12_packet_t* p) {
+  const e12_cmd_def_t* def = get_vendor_cmd((uint8_t)p->msg.head.cmd);
+  if (!def) {
+#if ESP32_E12_SPEC
+    ESP_LOGW(TAG, "Unknown vendor command %d", (int)p->msg.head.cmd);
+#endif
+    return -1;
+  }
+  bool request = !p->msg.head.IS_RESPONSE;
+  if (request && p->msg.head.len < sizeof(e12_header_t) + def->size) {
+    return -1;
+  }
+  return def->on_receive ? def->on_receive(this, p) : 0;
+}
+
+#if E12_ENABLE_PIN_CTL
+/**
+ * @brief Apply a CMD_PIN_BATCH request, keeping the writes that failed for
+ * its response
+ *
+ * @param p Request
+ * @return int 0 on success, negative on failure
+ */
+int e12::on_pin_batch(e12_packet_t* p) {
+  e12_pin_batch_t* b = (e12_pin_batch_t*)p->msg.data;
+  if (!e12_pin_batch_valid(p)) return -1;
+
+  // all or none, a half applied batch leaves outputs inconsistent
+  uint16_t failed = 0;
+  for (uint8_t i = 0; i < b->count; i++) {
+    if (!e12::on_ctl_write(b->writes[i].pin, b->writes[i].value)) {
+      failed |= 1 << i;
+    }
+  }
+  if (failed) {
+    failed = (1UL << b->count) - 1;
+  } else {
+    for (uint8_t i = 0; i < b->count; i++) {
+      if (!on_ctl_write(b->writes[i].pin, b->writes[i].value)) {
+        failed |= 1 << i;
+      }
+    }
+  }
+
+  _pin_batch_seq = p->msg.head.seq;
+  _pin_batch_failed = failed;
+  return failed ? -1 : 0;
+}
+
+/**
+ * @brief Read pins into a CMD_PIN_BATCH / CMD_PIN_EVENT payload
+ *
+ * @param mask Pins to read
+ * @param st Payload to fill
+ * @return uint8_t bytes of st to send
+ */
+uint8_t e12::read_pins(uint32_t mask, e12_pin_state_t* st) {
+  st->mask = mask;
+  st->failed = 0;
+  st->digital = (mask & 0xFFFF) ? on_ctl_read_digital(mask & 0xFFFF) : 0;
+  uint8_t n = 0;
+  for (uint8_t pin = 16; pin < 32; pin++) {
+    if (mask & (1UL << pin)) st->analog[n++] = (uint16_t)on_ctl_read(pin);
+  }
+  return offsetof(e12_pin_state_t, analog) + n * sizeof(uint16_t);
+}
+#endif
+
+#if E12_PIN_SUBS
+/**
+ * @brief Apply a CMD_PIN_SUBSCRIBE request, get_response() answers it
+ *
+ * @param p Request
+ * @return int 0 on success, negative if there is no room
+ */
+int e12::on_pin_subscribe(e12_packet_t* p) {
+  if (!e12_view<e12_pin_sub_t>(p).valid()) return -1;
+  e12_pin_sub_t sub;
+  memcpy(&sub, p->msg.data, sizeof(sub));
+  uint32_t mask = sub.mask & _pin_mask;
+
+  int ret = 0;
+  int8_t slot = -1;
+  int8_t free_slot = -1;
+  for (uint8_t i = 0; i < E12_PIN_SUBS; i++) {
+    _pin_subs[i].mask &= ~mask;
+    if (!_pin_subs[i].mask) {
+      if (free_slot < 0) free_slot = i;
+    } else if (_pin_subs[i].period == sub.period &&
+               _pin_subs[i].deadband == sub.deadband) {
+      slot = i;
+    }
+  }
+  if (slot < 0) slot = free_slot;
+  if (sub.off) {
+    mask = 0;
+  } else if (slot < 0) {
+    ret = -1;
+    mask = 0;
+  } else {
+    _pin_subs[slot].mask |= mask;
+    _pin_subs[slot].period = sub.period;
+    _pin_subs[slot].deadband = sub.deadband;
+    _pin_subs[slot].ts = get_time_ms();
+  }
+
+  // the values now are the baseline changes are reported against
+  e12_pin_state_t st;
+  read_pins(mask, &st);
+  _pin_levels = (_pin_levels & ~mask) | (st.digital & mask);
+  uint8_t n = 0;
+  for (uint8_t pin = 16; pin < 32; pin++) {
+    if (mask & (1UL << pin)) _pin_last[pin - 16] = st.analog[n++];
+  }
+  return ret;
+}
+#endif
+
+/**
+ * @brief Sample the subscribed pins that are due, send those that changed
+ */
+void e12::pin_poll() {
+#if E12_PIN_SUBS
+  uint32_t now = get_time_ms();
+  bool dirty = _pin_dirty;
+  _pin_dirty = false;
+
+  uint32_t due = 0;
+  for (uint8_t i = 0; i < E12_PIN_SUBS; i++) {
+    if (!_pin_subs[i].mask) continue;
+    if ((uint32_t)(now - _pin_subs[i].ts) >= _pin_subs[i].period) {
+      due |= _pin_subs[i].mask;
+      _pin_subs[i].ts = now;
+    } else if (dirty) {
+      due |= _pin_subs[i].mask & 0xFFFF;
+    }
+  }
+  if (!due) return;
+
+  uint32_t changed = 0;
+  uint16_t dmask = due & 0xFFFF;
+  if (dmask) {
+    uint16_t levels = on_ctl_read_digital(dmask);
+    changed = (levels ^ _pin_levels) & dmask;
+    _pin_levels = (_pin_levels & ~dmask) | (levels & dmask);
+  }
+  for (uint8_t i = 0; i < E12_PIN_SUBS; i++) {
+    uint32_t amask = _pin_subs[i].mask & due & 0xFFFF0000UL;
+    for (uint8_t pin = 16; amask && pin < 32; pin++) {
+      if (!(amask & (1UL << pin))) continue;
+      uint16_t v = (uint16_t)on_ctl_read(pin);
+      uint16_t last = _pin_last[pin - 16];
+      if ((v > last ? v - last : last - v) > _pin_subs[i].deadband) {
+        _pin_last[pin - 16] = v;
+        changed |= 1UL << pin;
+      }
+    }
+  }
+  if (!changed) return;
+
+  e12_packet_t* p = e12_get_packet();
+  if (!p) return;
+  p->msg.head.cmd = e12_cmd_t::CMD_PIN_EVENT;
+  e12_pin_state_t* st = (e12_pin_state_t*)p->msg.data;
+  st->mask = changed;
+  st->digital = _pin_levels & changed;
+  st->failed = 0;
+  uint8_t n = 0;
+  for (uint8_t pin = 16; pin < 32; pin++) {
+    if (changed & (1UL << pin)) st->analog[n++] = _pin_last[pin - 16];
+  }
+  p->msg.head.len = sizeof(e12_header_t) + offsetof(e12_pin_state_t, analog) +
+                    n * sizeof(uint16_t);
+  send(p, true);
+#endif
+}
+
+/**
+ * @brief Get the subscribed pins
+ *
+ * @return uint32_t pin mask
+ */
+uint32_t e12::get_pins_subscribed() {
+  uint32_t mask = 0;
+#if E12_PIN_SUBS
+  for (uint8_t i = 0; i < E12_PIN_SUBS; i++) mask |= _pin_subs[i].mask;
+#endif
+  return mask;
+}
+
+/**
+ * @brief Read the digital pins in mask, one on_ctl_read() per pin
+ */
+uint16_t e12::on_ctl_read_digital(uint16_t mask) {
+  uint16_t levels = 0;
+  for (uint8_t pin = 0; pin < 16; pin++) {
+    if ((mask & (1 << pin)) && on_ctl_read(pin) > 0) levels |= 1 << pin;
+  }
+  return levels;
+}
+
+/**
+ * @brief Validates a WRITE request (PIN <- IN only)
+ */
+bool e12::on_ctl_write(uint8_t pin, uint32_t val) {
+  if (pin > 31) return false;
 
   uint32_t bit = (1UL << pin);
   if (!(_pin_mask & bit) || !(_pin_io_mask & bit)) {
@@ -556,4 +2270,4 @@ bool e12::on_ctl_write(uint8_t pin, uint32_t val) {
   }
 
   return true;
-}
\ No newline at end of file
+}
@@ -19,13 +19,51 @@
 #ifndef H_E12_SPEC
 #define H_E12_SPEC
 
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
+
+#include "e12_tlv.h"
 
 /**
- * @brief e12 on wire max packet size
+ * @brief e12 on wire max packet size. Each e12 instance holds an encode
+ * and a decode buffer of this size, a peer must not send larger frames.
+ * Payloads that no longer fit fail to compile, CMD_AUTH needs 84 bytes so
+ * smaller packets need E12_ENABLE_AUTH 0.
  *
  */
+#ifndef E12_MAX_PKT_SIZE
 #define E12_MAX_PKT_SIZE 128
+#endif
+
+/**
+ * @brief Half duplex links (one side speaks at a time, every request
+ * waits for its response) can share one buffer for encoding and decoding.
+ * A response is then built in place over its request, and building any
+ * packet drops the bytes received so far. CMD_BATCH requests stop at the
+ * first sub-packet that sends something.
+ *
+ */
+#ifndef E12_HALF_DUPLEX
+#define E12_HALF_DUPLEX 0
+#endif
+
+/**
+ * @brief Features, 0 drops their commands and the code handling them:
+ * get_request() returns NULL and on_receive() -1 for those commands.
+ * OTA covers CMD_OTA, CMD_VMCU_OTA and firmware streaming, PIN_CTL covers
+ * CMD_PIN_CTL, CMD_PIN_BATCH and pin subscriptions.
+ *
+ */
+#ifndef E12_ENABLE_OTA
+#define E12_ENABLE_OTA 1
+#endif
+#ifndef E12_ENABLE_AUTH
+#define E12_ENABLE_AUTH 1
+#endif
+#ifndef E12_ENABLE_PIN_CTL
+#define E12_ENABLE_PIN_CTL 1
+#endif
 
 /**
  * @brief e12 max payload size in bytes in a e12 packet
@@ -68,15 +106,48 @@ enum class e12_cmd_t : uint8_t {
   CMD_NODE_AWAKE,
   /// request initiation of OTA
   CMD_OTA,
-  /// request initiation of VMCU OTA
+  /// request initiation of VMCU OTA, the image is then streamed with
+  /// CMD_FW_BEGIN / CMD_FW_CHUNK
   CMD_VMCU_OTA,
   /// set various e12 node properties e.g logmask,
   /// activating captive portal etc
   CMD_SET_NODE_PROPERTIES,
   /// initiate a debug blink of led on e12 node
-  CMD_DEBUG_BLINK
+  CMD_DEBUG_BLINK,
+  /// several small packets in one frame, see e12::batch_add()
+  CMD_BATCH,
+  /// several log events in one frame, see e12::queue_log()
+  CMD_LOG_BATCH,
+  /// offer a firmware image to stream, see e12::fw_send()
+  CMD_FW_BEGIN,
+  /// one chunk of a firmware image
+  CMD_FW_CHUNK,
+  /// chunks of a firmware image received so far
+  CMD_FW_ACK,
+  /// several pin writes and a read of many pins in one round trip
+  CMD_PIN_BATCH,
+  /// request to be sent CMD_PIN_EVENT when subscribed pins change
+  CMD_PIN_SUBSCRIBE,
+  /// subscribed pins that changed, sent by the vendor mcu
+  CMD_PIN_EVENT
 };
 
+/**
+ * @brief Checks a command is built in, see E12_ENABLE_OTA etc
+ *
+ */
+constexpr bool e12_cmd_enabled(e12_cmd_t cmd) {
+  return (E12_ENABLE_OTA ||
+          (cmd != e12_cmd_t::CMD_OTA && cmd != e12_cmd_t::CMD_VMCU_OTA &&
+           cmd != e12_cmd_t::CMD_FW_BEGIN && cmd != e12_cmd_t::CMD_FW_CHUNK &&
+           cmd != e12_cmd_t::CMD_FW_ACK)) &&
+         (E12_ENABLE_AUTH || cmd != e12_cmd_t::CMD_AUTH) &&
+         (E12_ENABLE_PIN_CTL ||
+          (cmd != e12_cmd_t::CMD_PIN_CTL && cmd != e12_cmd_t::CMD_PIN_BATCH &&
+           cmd != e12_cmd_t::CMD_PIN_SUBSCRIBE &&
+           cmd != e12_cmd_t::CMD_PIN_EVENT));
+}
+
 enum class e12_release_t : uint8_t {
   /// Stable release
   STABLE = 0,
@@ -100,6 +171,10 @@ enum class ctl_op_t : uint8_t {
 enum class e12_err_t : int8_t {
   ERR_NONE = 0,
   ERR_RETRY_LATER = -1,
+  /// no response within the e12 timeout
+  ERR_TIMEOUT = -2,
+  /// the transport failed to write the request
+  ERR_BUS = -3,
 };
 
 /**
@@ -140,8 +215,18 @@ enum class mcu_flashing_protocol_t : uint8_t {
   PROTOCOL_BOSSA
 };
 
+#ifndef E12_MAX_LOG_BUFFERS
 #define E12_MAX_LOG_BUFFERS 1
+#endif
+
+/**
+ * @brief chars of a string log event. Changes e12_log_evt_t, so both ends
+ * must agree on it for LOG_FMT_FIXED.
+ *
+ */
+#ifndef MAX_S_LOG_DATA
 #define MAX_S_LOG_DATA 16
+#endif
 typedef struct __attribute__((packed, aligned(4))) e12_log_evt {
   uint8_t type;
   uint8_t status;
@@ -242,12 +327,46 @@ typedef struct __attribute__((packed, aligned(4))) e12_node_state {
 
 #define MAX_LOG_SIZE (sizeof(e12_log_evt_t))
 
+/**
+ * @brief log events held by e12::queue_log() until they are flushed as
+ * CMD_LOG_BATCH. 0 disables the ring: every event goes out as CMD_LOG, the
+ * only log command e12 nodes without CMD_LOG_BATCH understand.
+ *
+ */
+#ifndef E12_LOG_RING_SIZE
+#define E12_LOG_RING_SIZE 0
+#endif
+
+/**
+ * @brief queued log events are flushed once they are this old (ms)
+ *
+ */
+#define E12_LOG_MAX_AGE 5000
+
+/**
+ * @brief Encoding of the events in a CMD_LOG_BATCH
+ *
+ */
+enum class e12_log_fmt_t : uint8_t {
+  /// e12_log_evt_t as is
+  LOG_FMT_FIXED = 0,
+  /// variable length events, see e12::log_encode()
+  LOG_FMT_COMPACT
+};
+
+/**
+ * @brief max bytes of one event in LOG_FMT_COMPACT
+ *
+ */
+#define E12_LOG_COMPACT_MAX (1 + 2 + 3 + 1 + 5 + 5 + 1 + MAX_S_LOG_DATA)
+
 typedef struct __attribute__((packed, aligned(4))) e12_header {
   uint8_t seq;
   uint8_t len;
   struct {
     uint8_t RESP_EXPECTED : 1;
     uint8_t IS_RESPONSE : 1;
+    uint8_t FRAGMENT : 1;  ///< data starts with e12_frag_t
     uint8_t : 0;
   };
   e12_cmd_t cmd;
@@ -256,6 +375,36 @@ typedef struct __attribute__((packed, aligned(4))) e12_header {
 #define E12_MAGIC_MARKER_LEN 2
 #define E12_MAGIC_MARKER_1 (0xEC)
 #define E12_MAGIC_MARKER_2 (0xEC ^ 0xCE)
+// the second marker also tells which integrity check protects the frame
+#define E12_MAGIC_MARKER_2_CRC16 (0xEC ^ 0xC1)
+#define E12_MAGIC_MARKER_2_CRC32 (0xEC ^ 0xC3)
+
+/**
+ * @brief Frame integrity check, selected per link by the sender.
+ *
+ * INTEGRITY_XOR is the original single byte checksum in the onwire head.
+ * With the CRC modes the CRC (little endian) trails the payload and is
+ * counted in head.len, the head checksum byte then carries ~head.len so a
+ * corrupted length is caught as soon as the head is in.
+ */
+enum class e12_integrity_t : uint8_t {
+  INTEGRITY_XOR = 0,
+  INTEGRITY_CRC16,
+  INTEGRITY_CRC32
+};
+
+#define E12_CRC16_LEN 2
+#define E12_CRC32_LEN 4
+
+// slice-by-8 CRC-32 needs 8KB of RAM tables, only worth it on hosts
+#ifndef E12_CRC32_SLICE_BY_8
+#if (defined(__linux__) || defined(__APPLE__)) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define E12_CRC32_SLICE_BY_8 1
+#else
+#define E12_CRC32_SLICE_BY_8 0
+#endif
+#endif
 typedef union __attribute__((packed, aligned(4))) e12_onwire_head {
   uint32_t head;
   struct {
@@ -283,6 +432,72 @@ typedef struct __attribute__((packed, aligned(4))) {
   };
 } e12_ctl_msg_t;
 
+/**
+ * @brief max writes in one e12_pin_batch_t, 16 or as many as fit
+ *
+ */
+#ifndef E12_PIN_BATCH_MAX
+#define E12_PIN_BATCH_MAX                  \
+  ((E12_MAX_CMD_DATA_PAYLOAD - 8) / 4 < 16 \
+       ? (E12_MAX_CMD_DATA_PAYLOAD - 8) / 4 \
+       : 16)
+#endif
+
+typedef struct __attribute__((packed, aligned(4))) e12_pin_write {
+  uint8_t pin;     ///< bit of the pin in the pin mask, analog from 16
+  uint8_t resv;
+  uint16_t value;  ///< digital pin (0/1), analog pin (0 - 4095)
+} e12_pin_write_t;
+
+/**
+ * @brief Payload of a CMD_PIN_BATCH request. The writes are checked
+ * against the pin masks first and applied only if all are valid, then the
+ * pins in read are read. head.len covers the count writes only.
+ *
+ */
+typedef struct __attribute__((packed, aligned(4))) e12_pin_batch {
+  uint32_t read;   ///< pins to read, as the pin mask, ~0 for all
+  uint8_t count;   ///< number of writes
+  uint8_t resv[3];
+  e12_pin_write_t writes[E12_PIN_BATCH_MAX];
+} e12_pin_batch_t;
+
+/**
+ * @brief Payload of a CMD_PIN_BATCH response. head.len covers one analog
+ * value per analog pin in mask.
+ *
+ */
+typedef struct __attribute__((packed, aligned(4))) e12_pin_state {
+  uint32_t mask;        ///< pins read, the requested ones that are set up
+  uint16_t digital;     ///< levels of the digital pins in mask
+  uint16_t failed;      ///< bit per write of the request not applied
+  uint16_t analog[16];  ///< analog pins in mask, lowest pin first
+} e12_pin_state_t;
+
+/**
+ * @brief max subscriptions with distinct period and deadband, a pin is in
+ * one at most. 0 disables subscriptions, opt in with e.g 2 on AVR, 8
+ * elsewhere, along with E12_ENABLE_PIN_CTL.
+ *
+ */
+#ifndef E12_PIN_SUBS
+#define E12_PIN_SUBS 0
+#endif
+
+/**
+ * @brief Payload of a CMD_PIN_SUBSCRIBE request. Subscribing pins moves
+ * them out of the subscription they were in. The response is an
+ * e12_pin_state_t of the pins subscribed, their current values.
+ *
+ */
+typedef struct __attribute__((packed, aligned(4))) e12_pin_sub {
+  uint32_t mask;      ///< pins, as the pin mask
+  uint16_t period;    ///< ms between samples, 0 every loop
+  uint16_t deadband;  ///< analog change reported only when larger
+  uint8_t off;        ///< unsubscribe the pins instead
+  uint8_t resv[3];
+} e12_pin_sub_t;
+
 // it is expected that the head.len is set to include the 
 // size of e12_header_t + size of the specific msg payload
 // so typically e.g msg_err.head.len = sizeof(msg_err);
@@ -362,6 +577,7 @@ typedef union __attribute__((packed, aligned(4))) e12_onwire {
     e12_onwire_head_t head;
     e12_packet_t data;
     uint8_t resp_pending : 1;
+    uint8_t rx_done : 1;  /// frame at buf[0] was delivered, drop it first
     uint8_t : 0;
     uint8_t recv_len;
     uint8_t resv;
@@ -370,6 +586,319 @@ typedef union __attribute__((packed, aligned(4))) e12_onwire {
   };
 } e12_onwire_t;
 
+/**
+ * @brief smallest valid on-wire frame: onwire head + e12_header_t
+ *
+ */
+#define E12_MIN_FRAME_LEN (sizeof(e12_onwire_head_t) + sizeof(e12_header_t))
+
+/**
+ * @brief largest valid on-wire frame: onwire head + e12_packet_t. Bytes
+ * past it in e12_onwire_t hold receive bookkeeping (recv_len etc)
+ *
+ */
+#define E12_MAX_FRAME_LEN (sizeof(e12_onwire_head_t) + sizeof(e12_packet_t))
+
+/**
+ * @brief sub-packets of a CMD_BATCH payload start 4 byte aligned
+ *
+ */
+#define E12_BATCH_ALIGN(len) (((len) + 3) & ~3)
+
+/**
+ * @brief Called for every complete frame found by e12::decode() on a span.
+ * The packet lives in the decode buffer and is only valid during the call.
+ *
+ * @return true to continue decoding the span, false to stop after it
+ */
+typedef bool (*e12_frame_cb_t)(e12_packet_t* p, void* ctx);
+
+/**
+ * @brief Called when a tracked request completes.
+ * @param seq sequence number of the request
+ * @param err ERR_NONE with the response in p (p NULL if the request
+ * expected none), ERR_TIMEOUT or ERR_BUS with p NULL
+ * @param p response packet, only valid during the call
+ * @param ctx context given when the request was tracked
+ */
+typedef void (*e12_resp_cb_t)(uint8_t seq, e12_err_t err, e12_packet_t* p,
+                              void* ctx);
+
+/**
+ * @brief max number of requests waiting for a response
+ *
+ */
+#ifndef E12_MAX_PENDING
+#if defined(__AVR__)
+#define E12_MAX_PENDING 4
+#else
+#define E12_MAX_PENDING 8
+#endif
+#endif
+
+/**
+ * @brief default time to wait for a response
+ *
+ */
+#define E12_RESP_TIMEOUT 5000
+
+/**
+ * @brief One fragment of a payload larger than a frame, sent with
+ * head.FRAGMENT set. All fragments of a payload share head.seq and
+ * head.cmd and are sent in order, only the last one may expect a response.
+ *
+ */
+typedef struct __attribute__((packed, aligned(4))) e12_frag {
+  uint8_t index;   ///< of this fragment, from 0
+  uint8_t count;   ///< number of fragments of the payload
+  uint16_t total;  ///< payload bytes over all fragments
+  uint8_t data[E12_MAX_CMD_DATA_PAYLOAD - 4];
+} e12_frag_t;
+
+/**
+ * @brief a payload is dropped when its next fragment does not arrive
+ * within this time (ms)
+ *
+ */
+#define E12_FRAG_TIMEOUT 2000
+
+/**
+ * @brief bytes e12::on_fragment() reassembles payloads in, larger payloads
+ * need on_fragment() to be overridden to consume them as they arrive.
+ * 0 disables the buffer, opt in with e.g 1024.
+ *
+ */
+#ifndef E12_FRAG_BUF_SIZE
+#define E12_FRAG_BUF_SIZE 0
+#endif
+
+/**
+ * @brief Fills the next fragment of a payload sent by
+ * e12::send_fragmented(), so it never needs to be in memory at once.
+ * @param buf where to write the bytes
+ * @param off offset of buf in the payload
+ * @param len number of bytes to write
+ * @param ctx context given to send_fragmented()
+ * @return 0 on success, negative to abort sending
+ */
+typedef int (*e12_frag_src_t)(uint8_t* buf, uint16_t off, uint8_t len,
+                              void* ctx);
+
+/**
+ * @brief Payload being reassembled from its fragments
+ *
+ */
+typedef struct e12_reassembly {
+  uint8_t seq;
+  e12_cmd_t cmd;
+  uint8_t next;   ///< index of the next fragment expected
+  uint8_t count;  ///< number of fragments
+  uint16_t total;
+  uint16_t off;   ///< bytes received so far
+  uint32_t ts;    ///< time the last fragment arrived
+  uint8_t ack_seq;  ///< seq of the last fragment handled
+  uint8_t in_use : 1;
+  uint8_t ack_err : 1;  ///< the last fragment was dropped
+  uint8_t : 0;
+} e12_reassembly_t;
+
+/**
+ * @brief SHA-256 context, see e12::sha256_init()
+ *
+ */
+typedef struct e12_sha256 {
+  uint32_t h[8];
+  uint64_t len;  ///< bytes hashed
+  uint8_t buf[64];
+} e12_sha256_t;
+
+#define E12_SHA256_LEN 32
+
+/**
+ * @brief OTA request, the payload of CMD_OTA
+ *
+ */
+typedef struct __attribute__((packed, aligned(4))) e12_ota {
+  uint32_t release_type;
+  uint32_t size;
+  char version[E12_MAX_FIRMWARE_VERSION_LEN];
+} e12_ota_t;
+
+/**
+ * @brief Firmware image offered with CMD_FW_BEGIN. A receiver that has
+ * part of the same image (size, chunk_size and sha256 match) resumes it.
+ *
+ */
+typedef struct __attribute__((packed, aligned(4))) e12_fw_info {
+  uint32_t size;        ///< image bytes
+  uint32_t version;
+  uint16_t chunk_size;  ///< image bytes per CMD_FW_CHUNK, but the last
+  uint8_t window;       ///< chunks in flight ahead of the last ack, <= 32
+  uint8_t flags;        ///< E12_FW_*
+  uint8_t sha256[E12_SHA256_LEN];  ///< of the whole image
+} e12_fw_info_t;
+
+/**
+ * @brief e12_fw_info_t flag: the image is an e12 delta patch against the
+ * running firmware (set_fwr_details()), see e12_delta.h. size and sha256
+ * are of the patch, apply it with e12_delta_feed() once received.
+ *
+ */
+#define E12_FW_DELTA 0x01
+
+typedef struct __attribute__((packed, aligned(4))) e12_fw_chunk {
+  uint16_t index;
+  uint16_t resv;
+  uint8_t data[E12_MAX_CMD_DATA_PAYLOAD - 4];
+} e12_fw_chunk_t;
+
+/**
+ * @brief State of a firmware transfer, carried by CMD_FW_ACK
+ *
+ */
+enum class e12_fw_status_t : uint8_t {
+  /// more chunks wanted
+  FW_RECEIVING = 0,
+  /// every chunk written and the SHA-256 matches
+  FW_DONE,
+  /// every chunk written but the SHA-256 does not match
+  FW_BAD_HASH,
+  /// the receiver does not take the image
+  FW_REFUSED,
+  /// a chunk could not be written
+  FW_WRITE_ERR,
+  /// the receiver stopped answering, only reported to the sender
+  FW_TIMEOUT
+};
+
+typedef struct __attribute__((packed, aligned(4))) e12_fw_ack {
+  e12_fw_status_t status;
+  uint8_t resv;
+  uint16_t base;  ///< every chunk below base was received
+  uint32_t mask;  ///< bit i set if chunk base + i was received
+} e12_fw_ack_t;
+
+/**
+ * @brief default chunks in flight ahead of the last CMD_FW_ACK
+ *
+ */
+#define E12_FW_WINDOW 8
+
+/**
+ * @brief times the firmware sender resends unacknowledged chunks before
+ * giving up
+ *
+ */
+#define E12_FW_RETRIES 5
+
+/**
+ * @brief max chunks of a received firmware image, sizes the chunk bitmap.
+ * 0 disables receiving firmware. Opt in along with E12_ENABLE_OTA, with the
+ * image size over the chunk size: e.g 512 for a 32KB image, 16384 for 1MB
+ * takes a 2KB bitmap.
+ *
+ */
+#ifndef E12_FW_MAX_CHUNKS
+#define E12_FW_MAX_CHUNKS 0
+#endif
+
+/**
+ * @brief bytes of a chunk that came early read back with on_fw_read() at a
+ * time to be hashed, a stack buffer
+ *
+ */
+#ifndef E12_FW_READ_PIECE
+#if defined(__AVR__)
+#define E12_FW_READ_PIECE 16
+#else
+#define E12_FW_READ_PIECE 64
+#endif
+#endif
+
+/**
+ * @brief 1 to build the firmware sender, e12 nodes and hosts stream to
+ * the VMCU, not the other way round
+ *
+ */
+#ifndef E12_FW_SENDER
+#if !E12_ENABLE_OTA || defined(__AVR__)
+#define E12_FW_SENDER 0
+#else
+#define E12_FW_SENDER 1
+#endif
+#endif
+
+/**
+ * @brief Firmware being received. Persist it with e12::on_fw_save() to
+ * resume after a reset.
+ *
+ */
+typedef struct e12_fw_rx {
+  e12_fw_info_t info;
+  uint16_t chunks;    ///< number of chunks of the image
+  uint16_t hashed;    ///< chunks below this are received and hashed
+  uint16_t received;  ///< number of chunks received
+  uint8_t since_ack;  ///< chunks received since the last CMD_FW_ACK
+  uint8_t in_use : 1;
+  uint8_t : 0;
+  e12_fw_status_t status;  ///< outcome, repeated if the last ack is lost
+  e12_sha256_t sha;        ///< over the chunks below hashed
+  uint8_t bitmap[(E12_FW_MAX_CHUNKS + 7) / 8];  ///< chunks received
+} e12_fw_rx_t;
+
+/**
+ * @brief Reads the firmware image sent by e12::fw_send(), so it never
+ * needs to be in memory at once.
+ * @param buf where to write the bytes
+ * @param off offset of buf in the image
+ * @param len number of bytes to write
+ * @param ctx context given to fw_send()
+ * @return 0 on success, negative to abort sending
+ */
+typedef int (*e12_fw_src_t)(uint8_t* buf, uint32_t off, uint8_t len,
+                            void* ctx);
+
+/**
+ * @brief Firmware being sent
+ *
+ */
+typedef struct e12_fw_tx {
+  e12_fw_info_t info;
+  uint16_t chunks;  ///< number of chunks of the image
+  uint16_t base;    ///< of the last CMD_FW_ACK
+  uint32_t acked;   ///< mask of the last CMD_FW_ACK, relative to base
+  uint32_t sent;    ///< chunks sent since the last retry, relative to base
+  uint32_t ts;      ///< time of the last CMD_FW_ACK or retry
+  e12_fw_src_t src;
+  void* ctx;
+  uint8_t retries;
+  uint8_t in_use : 1;
+  uint8_t acked_begin : 1;  ///< the receiver answered CMD_FW_BEGIN
+  uint8_t : 0;
+} e12_fw_tx_t;
+
+/**
+ * @brief Request waiting for its response, keyed by head.seq
+ *
+ */
+typedef struct e12_pending {
+  uint8_t seq;
+  e12_cmd_t cmd;
+  uint8_t in_use : 1;
+  uint8_t held : 1;  ///< queued, not written yet, the timeout waits
+  uint8_t done : 1;  ///< ended, cb runs from the next expire_pending()
+  uint8_t : 0;
+  e12_err_t err;  ///< result once done
+  uint32_t ts;    ///< time the request was sent
+  e12_resp_cb_t cb;
+  void* ctx;
+} e12_pending_t;
+
+/**
+ * @brief State or config. data is a JSON string, or e12_tlv fields when
+ * IS_JSON is false.
+ *
+ */
 typedef struct __attribute__((packed, aligned(4))) e12_data {
   uint8_t IS_JSON : 1;
   uint8_t STORE : 1;
@@ -379,6 +908,20 @@ typedef struct __attribute__((packed, aligned(4))) e12_data {
   uint8_t data[E12_MAX_CMD_DATA_PAYLOAD - 5];
 } e12_data_t;
 
+typedef struct __attribute__((packed, aligned(4))) e12_log_batch {
+  e12_log_fmt_t format;
+  uint8_t count;  ///< number of events in data
+  uint16_t resv;
+  uint8_t data[E12_MAX_CMD_DATA_PAYLOAD - 4];
+} e12_log_batch_t;
+
+/**
+ * @brief max e12_log_evt_t in one CMD_LOG_BATCH
+ *
+ */
+#define E12_LOG_BATCH_MAX_FIXED \
+  (sizeof(((e12_log_batch_t*)0)->data) / sizeof(e12_log_evt_t))
+
 typedef struct __attribute__((packed, aligned(4))) e12_device {
   e12_data_t state;
   e12_data_t config;
@@ -391,6 +934,135 @@ typedef struct __attribute__((packed, aligned(4))) {
   int16_t value;
 } ctl_log_t;
 
+/**
+ * @brief Typed, bounds checked view of the payload of an e12 packet.
+ *
+ * The view points into the packet, nothing is copied. Senders reserve()
+ * the payload and write it in place, receivers get() it straight from the
+ * decode buffer. get() returns NULL unless head.len covers the whole T.
+ *
+ * e.g
+ *   e12_packet_t* p = get_request(e12_cmd_t::CMD_LOG, true, NULL);
+ *   e12_log_evt_t* evt = e12_view<e12_log_evt_t>(p).get();
+ */
+template <typename T>
+class e12_view {
+  static_assert(sizeof(T) <= E12_MAX_CMD_DATA_PAYLOAD,
+                "payload does not fit in an e12 packet");
+
+ private:
+  e12_packet_t* _p;
+
+ public:
+  explicit e12_view(e12_packet_t* p) : _p(p) {}
+
+  /**
+   * @brief Checks the packet carries a complete T.
+   * @return true if the payload can be read
+   */
+  bool valid() const {
+    return _p && _p->msg.head.len >= sizeof(e12_header_t) + sizeof(T) &&
+           _p->msg.head.len <= sizeof(e12_packet_t);
+  }
+
+  /**
+   * @brief Gets the payload.
+   * @return Pointer to the payload in the packet, NULL if not valid
+   */
+  T* get() const { return valid() ? (T*)_p->msg.data : 0; }
+
+  T* operator->() const { return get(); }
+
+  /**
+   * @brief Sets head.len for a T payload. The payload is not cleared.
+   * @return Pointer to the payload in the packet to be written
+   */
+  T* reserve() {
+    if (!_p) return 0;
+    _p->msg.head.len = sizeof(e12_header_t) + sizeof(T);
+    return (T*)_p->msg.data;
+  }
+};
+
+/**
+ * @brief First opcode of the vendor commands, up to 0xFF. Lower opcodes
+ * belong to e12_cmd_t.
+ *
+ */
+#define E12_CMD_VENDOR 0x80
+
+class e12;
+
+/**
+ * @brief Handles a received vendor command, request or response
+ *
+ * @param e protocol instance
+ * @param p packet, its payload at least the declared size
+ * @return int returned by e12::on_receive()
+ */
+typedef int (*e12_cmd_handler_t)(e12* e, e12_packet_t* p);
+
+/**
+ * @brief Fills the response to a vendor command
+ *
+ * @param e protocol instance
+ * @param req request
+ * @param resp response, head.len covers the header only. With
+ * E12_HALF_DUPLEX it is req, turned into the response: read the request
+ * payload before writing over it.
+ * @return int 0 to send it, negative to not respond
+ */
+typedef int (*e12_cmd_resp_t)(e12* e, const e12_packet_t* req,
+                              e12_packet_t* resp);
+
+/**
+ * @brief Declares a vendor command, see E12_CMD()
+ *
+ */
+typedef struct e12_cmd_def {
+  uint8_t cmd;
+  uint8_t size;                  ///< payload bytes of a request
+  e12_cmd_handler_t on_receive;  ///< NULL to only respond
+  e12_cmd_resp_t on_response;    ///< NULL for a plain ack
+} e12_cmd_def_t;
+
+template <typename T>
+constexpr uint8_t e12_cmd_size() {
+  static_assert(sizeof(T) <= E12_MAX_CMD_DATA_PAYLOAD,
+                "payload does not fit in an e12 packet");
+  return sizeof(T);
+}
+
+/**
+ * @brief Declares vendor command cmd with a T payload, checked to fit in
+ * a packet at compile time.
+ *
+ * Example:
+ *   static int on_relay(e12* e, e12_packet_t* p);
+ *   static constexpr e12_cmd_def_t cmds[] = {
+ *       E12_CMD(CMD_RELAY, relay_t, on_relay, NULL),
+ *       E12_CMD(CMD_METER, meter_req_t, NULL, on_meter),
+ *   };
+ *   static_assert(E12_CMDS_VALID(cmds), "vendor commands out of order");
+ *   e.set_vendor_cmds(cmds, sizeof(cmds) / sizeof(cmds[0]));
+ */
+#define E12_CMD(cmd, T, handler, resp) \
+  { (uint8_t)(cmd), e12_cmd_size<T>(), handler, resp }
+
+// C++11 constexpr, one return statement
+constexpr bool e12_cmds_valid(const e12_cmd_def_t* t, size_t n, size_t i) {
+  return i >= n ||
+         (t[i].cmd == E12_CMD_VENDOR + i && e12_cmds_valid(t, n, i + 1));
+}
+
+/**
+ * @brief Checks at compile time a table of E12_CMD() holds the opcodes
+ * from E12_CMD_VENDOR in order, no gaps, so it is indexed by opcode.
+ *
+ */
+#define E12_CMDS_VALID(t) \
+  e12_cmds_valid(t, sizeof(t) / sizeof((t)[0]), 0)
+
 /**
  * @class e12
  * @brief This class represents the base class for the e12 protocol.
@@ -413,31 +1085,219 @@ class e12 {
   mcu_flashing_protocol_t _protocol;
   bool _mcu_flashing_enabled;
 
+  e12_integrity_t _integrity;     ///< integrity check used when sending
+  e12_integrity_t _rx_integrity;  ///< integrity check of the last frame
+  bool _integrity_follow;         ///< mirror the peer's integrity check
+
+#if E12_HALF_DUPLEX
+  e12_onwire_t _onwire_buf;  ///< Buffer for encoding and decoding packets
+#else
   e12_onwire_t _encode_buf;  ///< Buffer for encoding packets
   e12_onwire_t _decode_buf;  ///< Buffer for decoding packets
+#endif
   e12_device_t* _dev_ptr;    ///< Pointer to the e12 device
 
- protected:
-  uint32_t _timeout;  ///< Timeout value in milliseconds
-  uint8_t _seq;       ///< Sequence number for packets
+  e12_pending_t _pending[E12_MAX_PENDING];  ///< requests in flight
+  e12_resp_cb_t _resp_cb;  ///< completion callback of untracked requests
+  void* _resp_ctx;         ///< passed to _resp_cb
+
+  /**
+   * @brief Completes the pending request the response answers.
+   * @param p Pointer to the response
+   * @return true if a pending request matched
+   */
+  bool complete_pending(e12_packet_t* p);
+
+  e12_reassembly_t _frag;  ///< payload being received in fragments
+#if E12_FRAG_BUF_SIZE
+  uint8_t _frag_buf[E12_FRAG_BUF_SIZE];  ///< reassembled payload
+#endif
+
+  /**
+   * @brief Checks a fragment follows the previous one and hands it to
+   * on_fragment().
+   * @param p Pointer to the fragment
+   * @return int on_fragment() result, negative if the payload was dropped
+   */
+  int on_receive_fragment(e12_packet_t* p);
+
+  /**
+   * @brief Drops the payload being reassembled, on_fragment() is told with
+   * NULL data.
+   */
+  void drop_fragments();
+
+#if E12_FW_MAX_CHUNKS
+  e12_fw_rx_t _fw_rx;  ///< firmware being received
+
+  /**
+   * @brief Starts or resumes receiving the offered firmware.
+   * @param info Offered image
+   */
+  void fw_rx_begin(const e12_fw_info_t* info);
+
+  /**
+   * @brief Writes a firmware chunk and hashes what became contiguous.
+   * @param c Chunk
+   * @param len Chunk bytes
+   */
+  void fw_rx_chunk(const e12_fw_chunk_t* c, uint8_t len);
+
+  /**
+   * @brief Sends CMD_FW_ACK with the chunks received so far.
+   * @param status State of the transfer
+   */
+  void fw_rx_ack(e12_fw_status_t status);
+#endif
+
+#if E12_FW_SENDER
+  e12_fw_tx_t _fw_tx;  ///< firmware being sent
+
+  /**
+   * @brief Applies a CMD_FW_ACK and sends the next chunks.
+   * @param ack Acknowledgement from the receiver
+   */
+  void fw_tx_ack(const e12_fw_ack_t* ack);
+
+  /**
+   * @brief Sends the chunks of the window neither acknowledged nor in
+   * flight.
+   * @return int number of chunks sent, negative on failure
+   */
+  int fw_tx_window();
+#endif
+
+#if E12_PIN_SUBS
+  struct {
+    uint32_t mask;
+    uint16_t period;
+    uint16_t deadband;
+    uint32_t ts;  ///< last sampled
+  } _pin_subs[E12_PIN_SUBS];
+  uint16_t _pin_levels;         ///< last digital levels reported
+  uint16_t _pin_last[16];       ///< last analog values reported
+  volatile bool _pin_dirty;     ///< set by pin_changed()
+
+  /**
+   * @brief Applies a CMD_PIN_SUBSCRIBE request, get_response() answers it.
+   * @param p Request
+   * @return int 0 on success, negative if there is no room
+   */
+  int on_pin_subscribe(e12_packet_t* p);
+#endif
+
+#if E12_LOG_RING_SIZE
+  e12_log_evt_t _log_ring[E12_LOG_RING_SIZE];  ///< events not sent yet
+  uint8_t _log_head;        ///< oldest queued event
+  uint8_t _log_count;       ///< number of queued events
+  uint8_t _log_flush_at;    ///< flush once this many are queued, 0 full
+  uint32_t _log_first_ts;   ///< time the oldest queued event was queued
+  uint32_t _log_max_age;    ///< flush once the oldest is this old (ms)
+  bool _log_flush_due;      ///< the node woke up, flush all on next poll
+#endif
+  e12_log_fmt_t _log_fmt;  ///< encoding of CMD_LOG_BATCH sent
+
+  const e12_cmd_def_t* _vendor_cmds;  ///< indexed by cmd - E12_CMD_VENDOR
+  uint8_t _vendor_cmds_count;
+
+  /**
+   * @brief Gets the declaration of a vendor command.
+   * @param cmd Opcode
+   * @return Pointer to it, NULL if not declared
+   */
+  const e12_cmd_def_t* get_vendor_cmd(uint8_t cmd) {
+    uint8_t i = cmd - E12_CMD_VENDOR;
+    return cmd >= E12_CMD_VENDOR && i < _vendor_cmds_count ? &_vendor_cmds[i]
+                                                           : 0;
+  }
+
+  /**
+   * @brief Passes a vendor command to its handler, get_response() answers
+   * it through on_response.
+   * @param p Packet
+   * @return int from the handler, negative if the command is unknown
+   */
+  int on_receive_vendor(e12_packet_t* p);
+
+  /**
+   * @brief Builds the responses to the sub-packets of a CMD_BATCH request
+   * into one CMD_BATCH response.
+   * @param p CMD_BATCH request
+   * @return Pointer to the response, NULL if no sub-packet expects one
+   */
+  e12_packet_t* get_batch_response(e12_packet_t* p);
+
+  /**
+   * @brief Appends the used bytes of a state or config to a response,
+   * leaving room for the integrity trailer.
+   * @param resp Response packet
+   * @param d State or config to copy
+   * @return false if it does not fit the frame
+   */
+  bool put_data(e12_packet_t* resp, const e12_data_t* d);
+
+ protected:
+  uint32_t _timeout;  ///< Timeout value in milliseconds
+  uint8_t _seq;       ///< Sequence number for packets
+
+  /**
+   * @brief Checks the received frame p is still in the decode buffer,
+   * with E12_HALF_DUPLEX sending anything overwrites it.
+   * @param p Packet being handled
+   * @return true if p was overwritten
+   */
+  bool rx_overwritten(const e12_packet_t* p);
 
   /**
    * @brief Gets the buffer for encoding packets.
    * @return Pointer to the encoding buffer
    */
+#if E12_HALF_DUPLEX
+  e12_onwire_t* get_encode_buffer() { return &_onwire_buf; }
+#else
   e12_onwire_t* get_encode_buffer() { return &_encode_buf; }
+#endif
 
   /**
    * @brief Gets the buffer for decoding packets.
    * @return Pointer to the decoding buffer
    */
+#if E12_HALF_DUPLEX
+  e12_onwire_t* get_decode_buffer() { return &_onwire_buf; }
+#else
   e12_onwire_t* get_decode_buffer() { return &_decode_buf; }
+#endif
 
   /**
    * @brief Flushes the given buffer.
    * @param buf Pointer to the buffer to be flushed
    */
   void flush_buffer(e12_onwire_t* buf);
+
+  /**
+   * @brief Decodes a span of received bytes up to the first complete frame.
+   * @param buf Pointer to the received bytes
+   * @param n Number of bytes
+   * @param used Set to the number of bytes consumed
+   * @return Pointer to the decoded packet, NULL if the span held none
+   */
+  e12_packet_t* decode_one(const uint8_t* buf, size_t n, size_t* used);
+
+  /**
+   * @brief Checks the bytes buffered in pkt. Invalid markers, impossible
+   * lengths and bad checksums make it rescan the buffered bytes for the
+   * next magic marker instead of dropping them.
+   * @param pkt Pointer to the receive buffer
+   * @return Pointer to the complete frame at the start of pkt, or NULL
+   */
+  e12_packet_t* frame_scan(e12_onwire_t* pkt);
+
+  /**
+   * @brief Drops the frame returned by frame_scan(), keeping bytes that
+   * were received after it.
+   * @param pkt Pointer to the receive buffer
+   */
+  void frame_consume(e12_onwire_t* pkt);
   
   /**
    * @brief Gets the status of the e12 node.
@@ -455,15 +1315,41 @@ class e12 {
   e12_node_op_status_t set_node_status(e12_node_op_status_t status,
                                        uint32_t data);
 
+#if E12_ENABLE_PIN_CTL
   /**
-   * @brief function doing basic sanity and scheduling return cmds
-   * 
-   * @param pin 
-   * @param val 
-   * @return true 
-   * @return false 
+   * @brief Applies a CMD_PIN_CTL request through the on_ctl_read() /
+   * on_ctl_write() hooks, get_response() answers it
+   *
+   * @param op READ or WRITE
+   * @param pin Pin number
+   * @param val Value to write
+   * @return int16_t the value read or written, negative on failure
    */
-  bool on_ctl(ctl_op_t op, uint8_t pin, uint32_t val);
+  int16_t on_ctl(ctl_op_t op, uint8_t pin, uint32_t val);
+
+  uint8_t _pin_ctl_seq;    ///< of the last CMD_PIN_CTL applied
+  int16_t _pin_ctl_value;  ///< what on_ctl() returned for it
+
+  uint8_t _pin_batch_seq;      ///< of the last CMD_PIN_BATCH applied
+  uint16_t _pin_batch_failed;  ///< its writes not applied
+
+  /**
+   * @brief Applies a CMD_PIN_BATCH request, get_response() answers it
+   *
+   * @param p Request
+   * @return int 0 on success, negative on failure
+   */
+  int on_pin_batch(e12_packet_t* p);
+
+  /**
+   * @brief Reads pins into a CMD_PIN_BATCH / CMD_PIN_EVENT payload
+   *
+   * @param mask Pins to read, all set up
+   * @param st Filled, but failed
+   * @return uint8_t bytes of st to send
+   */
+  uint8_t read_pins(uint32_t mask, e12_pin_state_t* st);
+#endif
 
  public:
   /**
@@ -481,7 +1367,9 @@ class e12 {
   // Packet handling
 
   /**
-   * @brief Gets a new packet for the e12 protocol.
+   * @brief Gets a new packet for the e12 protocol. Only the header is
+   * cleared, the payload is left for the caller to write. With
+   * E12_HALF_DUPLEX the received frame, if any, is gone.
    * @return Pointer to the new packet
    */
   e12_packet_t* e12_get_packet();
@@ -493,6 +1381,55 @@ class e12 {
    */
   e12_onwire_t* encode(e12_packet_t* data);
 
+  /**
+   * @brief Encodes a packet into a frame with the head and trailer of the
+   * integrity mode, shared by encode() and e12_static::send()
+   * @param pkt Frame to fill, may hold data already
+   * @param data Pointer to the packet
+   * @param mode Integrity check
+   * @return pkt, NULL if the packet does not fit in a frame
+   */
+  static inline e12_onwire_t* encode_frame(e12_onwire_t* pkt,
+                                           e12_packet_t* data,
+                                           e12_integrity_t mode) {
+    uint8_t len = data->msg.head.len;
+    uint8_t trailer = get_trailer_len(mode);
+    if (sizeof(e12_onwire_head_t) + len + trailer > E12_MAX_FRAME_LEN) {
+      return NULL;
+    }
+
+    pkt->head.magic[0] = E12_MAGIC_MARKER_1;
+    pkt->head.len = sizeof(e12_onwire_head_t) + len + trailer;
+    if ((uint8_t*)data != (uint8_t*)&pkt->data) {
+      memcpy(&pkt->data, data, len);
+    }
+
+    uint8_t* crc = &pkt->buf[sizeof(e12_onwire_head_t) + len];
+    switch (mode) {
+      case e12_integrity_t::INTEGRITY_CRC16: {
+        uint16_t v = get_crc16((const uint8_t*)&pkt->data, len);
+        pkt->head.magic[1] = E12_MAGIC_MARKER_2_CRC16;
+        pkt->head.checksum = ~pkt->head.len;
+        crc[0] = v;
+        crc[1] = v >> 8;
+      } break;
+      case e12_integrity_t::INTEGRITY_CRC32: {
+        uint32_t v = get_crc32((const uint8_t*)&pkt->data, len);
+        pkt->head.magic[1] = E12_MAGIC_MARKER_2_CRC32;
+        pkt->head.checksum = ~pkt->head.len;
+        crc[0] = v;
+        crc[1] = v >> 8;
+        crc[2] = v >> 16;
+        crc[3] = v >> 24;
+      } break;
+      default: {
+        pkt->head.magic[1] = E12_MAGIC_MARKER_2;
+        pkt->head.checksum = get_checksum((const char*)&pkt->data, len);
+      } break;
+    }
+    return pkt;
+  }
+
   /**
    * @brief Decodes the given data into a packet.
    * @param pkt Pointer to the packet to be decoded
@@ -501,6 +1438,213 @@ class e12 {
    */
   e12_packet_t* decode(e12_onwire_t* pkt, uint8_t data);
 
+  /**
+   * @brief Decodes a span of received bytes into the decode buffer.
+   * Frames may start and end anywhere in the span, partial frames are
+   * kept for the next call.
+   * @param buf Pointer to the received bytes
+   * @param n Number of bytes
+   * @param cb Called for every complete frame, on_receive() if NULL
+   * @param ctx Passed to cb
+   * @return number of bytes consumed, less than n if cb asked to stop
+   */
+  size_t decode(const uint8_t* buf, size_t n, e12_frame_cb_t cb = 0,
+                void* ctx = 0);
+
+  // Batching
+
+  /**
+   * @brief Starts an empty CMD_BATCH packet.
+   * @param batch Packet to hold the batch
+   */
+  void batch_init(e12_packet_t* batch);
+
+  /**
+   * @brief Appends a packet to a CMD_BATCH packet. Each sub-packet keeps
+   * its own header and starts 4 byte aligned, the receiving e12::on_receive()
+   * hands them to on_receive() one by one. get_response() on the batch
+   * answers the sub-packets that expect a response in one CMD_BATCH, a
+   * response that does not fit is dropped and its request times out.
+   * @param batch Packet started with batch_init()
+   * @param p Packet to append, head.len bytes are copied
+   * @return true if appended, false if it does not fit in the frame
+   */
+  bool batch_add(e12_packet_t* batch, const e12_packet_t* p);
+
+  // Fragmentation
+
+  /**
+   * @brief Sends a payload larger than a frame as fragments, see
+   * e12_frag_t. The fragments are filled one at a time by src, so the
+   * payload is never buffered as a whole. Nothing is sent unless all the
+   * fragments fit get_tx_room().
+   * @param cmd Command of the payload
+   * @param total Payload bytes, at most 255 fragments
+   * @param src Fills each fragment
+   * @param ctx Passed to src
+   * @param response true if the last fragment expects a response
+   * @return sequence number shared by the fragments, ERR_RETRY_LATER if
+   * they do not fit now, negative on failure
+   */
+  int send_fragmented(e12_cmd_t cmd, uint16_t total, e12_frag_src_t src,
+                      void* ctx, bool response = false);
+
+  /**
+   * @brief Sends a payload in memory as fragments.
+   * @param cmd Command of the payload
+   * @param data Payload
+   * @param len Payload bytes
+   * @param response true if the last fragment expects a response
+   * @return sequence number shared by the fragments, negative on failure
+   */
+  int send_fragmented(e12_cmd_t cmd, const void* data, uint16_t len,
+                      bool response = false);
+
+  /**
+   * @brief Gets the bytes of encoded frames send() takes right now without
+   * waiting or dropping any, e.g the free transmit queue while the e12 node
+   * sleeps.
+   * @return free bytes, 0xFFFF if send() never holds frames back
+   */
+  virtual uint16_t get_tx_room() { return 0xFFFF; }
+
+  // Firmware streaming
+
+  /**
+   * @brief Streams a firmware image to the peer: CMD_FW_BEGIN, then up to
+   * info->window chunks ahead of the last CMD_FW_ACK. The receiver keeps a
+   * bitmap of the chunks it has, so calling fw_send() again with the same
+   * image after an interruption (node sleep, reset) only sends the chunks
+   * still missing. on_fw_sent() reports the outcome.
+   * @param info Image size, version and SHA-256. chunk_size 0 for as much
+   * as fits in a frame, window 0 for E12_FW_WINDOW.
+   * @param src Reads the image
+   * @param ctx Passed to src
+   * @return 0 on success, negative on failure
+   */
+  int fw_send(const e12_fw_info_t* info, e12_fw_src_t src, void* ctx);
+
+  /**
+   * @brief Resends unacknowledged firmware chunks after the response
+   * timeout and gives up after E12_FW_RETRIES. Call it periodically e.g
+   * from the main loop.
+   */
+  void fw_poll();
+
+  /**
+   * @brief Checks a firmware image is being sent.
+   * @return true until on_fw_sent() was called
+   */
+  bool fw_sending();
+
+  // Vendor commands
+
+  /**
+   * @brief Sets the vendor commands, a table of E12_CMD() checked with
+   * E12_CMDS_VALID(). get_request(), get_response() and on_receive()
+   * handle their opcodes, (e12_cmd_t)cmd, through it.
+   * @param cmds Table, kept by reference
+   * @param count Number of commands
+   */
+  void set_vendor_cmds(const e12_cmd_def_t* cmds, uint8_t count) {
+    _vendor_cmds = cmds;
+    _vendor_cmds_count = cmds ? count : 0;
+  }
+
+  // Pin subscriptions
+
+  /**
+   * @brief Samples the subscribed pins that are due and sends the ones
+   * that changed as one CMD_PIN_EVENT. Call it periodically e.g from the
+   * main loop.
+   */
+  void pin_poll();
+
+  /**
+   * @brief Makes the next pin_poll() sample the subscribed digital pins
+   * whatever their period. Safe to call from a pin change interrupt.
+   */
+  void pin_changed() {
+#if E12_PIN_SUBS
+    _pin_dirty = true;
+#endif
+  }
+
+  /**
+   * @brief Gets the subscribed pins.
+   * @return uint32_t pin mask
+   */
+  uint32_t get_pins_subscribed();
+
+  // Logging
+
+  /**
+   * @brief Queues a log event, it is sent with others as CMD_LOG_BATCH.
+   * The queue is flushed when it holds enough events to fill a frame, when
+   * the oldest event gets too old (see flush_logs()) and when the e12 node
+   * reports it is awake. Without a ring (E12_LOG_RING_SIZE 0) the event is
+   * sent right away as CMD_LOG.
+   * @param evt Event to queue, copied
+   * @return 0 on success, negative on failure
+   */
+  int queue_log(const e12_log_evt_t* evt);
+
+  /**
+   * @brief Sends queued log events.
+   * @param force true to send everything, false to only send if the flush
+   * count or the max age is reached, e.g called periodically from a loop
+   * @return number of events sent, negative on failure
+   */
+  int flush_logs(bool force = true);
+
+  /**
+   * @brief Sets when queued log events are flushed.
+   * @param count flush once this many events are queued, 0 for as many as
+   * fit in a frame (a full ring with LOG_FMT_COMPACT)
+   * @param max_age_ms flush once the oldest event is this old
+   */
+  void set_log_flush(uint8_t count, uint32_t max_age_ms = E12_LOG_MAX_AGE);
+
+  /**
+   * @brief Gets the number of queued log events.
+   * @return number of events
+   */
+  uint8_t get_logs_queued();
+
+  /**
+   * @brief Sets the encoding of the CMD_LOG_BATCH sent. Received batches
+   * are decoded in either encoding.
+   * @param fmt LOG_FMT_FIXED (default) or LOG_FMT_COMPACT, the latter only
+   * for e12 nodes decoding it
+   */
+  void set_log_format(e12_log_fmt_t fmt);
+
+  /**
+   * @brief Encodes a log event as LOG_FMT_COMPACT: a flags byte, varint
+   * type and src (src_index in the high byte), status and count when set,
+   * the zigzag varint delta of ts to the previous event and the value as a
+   * zigzag varint, a half float, a 1/100 fixed-point varint or a float,
+   * whichever is shortest and exact. Numeric events take 5-10 bytes.
+   * @param evt Event to encode
+   * @param prev_ts ts of the previous event, updated
+   * @param buf Buffer to write to
+   * @param len Space left in buf
+   * @return bytes written, 0 if the event does not fit
+   */
+  static uint8_t log_encode(const e12_log_evt_t* evt, uint32_t* prev_ts,
+                            uint8_t* buf, uint8_t len);
+
+  /**
+   * @brief Decodes a LOG_FMT_COMPACT event, see log_encode().
+   * @param buf Buffer to read from
+   * @param len Bytes left in buf
+   * @param prev_ts ts of the previous event, updated
+   * @param evt Event to fill
+   * @return bytes read, 0 if the event is malformed
+   */
+  static uint8_t log_decode(const uint8_t* buf, uint8_t len,
+                            uint32_t* prev_ts, e12_log_evt_t* evt);
+
   // Device management
 
   /**
@@ -584,6 +1728,88 @@ class e12 {
    */
   void set_timeout(uint32_t ms) { _timeout = ms; }
 
+  // Request tracking
+
+  /**
+   * @brief Tracks a request until its response arrives or it times out.
+   * e12_arduino and e12_posix track every request they send that expects
+   * a response, call it before send() to get a per request callback.
+   * @param p Pointer to the request
+   * @param cb Completion callback, the one given to set_response_cb() if
+   * NULL
+   * @param ctx Passed to cb
+   * @return sequence number of the request, -1 if the table is full
+   */
+  int add_pending(e12_packet_t* p, e12_resp_cb_t cb = 0, void* ctx = 0);
+
+  /**
+   * @brief Gets the pending request with the given sequence number.
+   * @param seq Sequence number
+   * @return Pointer to the entry, NULL if not pending
+   */
+  e12_pending_t* get_pending(uint8_t seq);
+
+  /**
+   * @brief Checks if a request for the command waits for a response.
+   * @param cmd Command
+   * @return true if one is pending
+   */
+  bool is_pending(e12_cmd_t cmd);
+
+  /**
+   * @brief Gets the number of requests waiting for a response.
+   * @return number of pending requests
+   */
+  uint8_t get_pending_count();
+
+  /**
+   * @brief Drops the pending request without calling its callback.
+   * @param seq Sequence number
+   */
+  void cancel_pending(uint8_t seq);
+
+  /**
+   * @brief Holds the timeout of a pending request until start_pending(),
+   * e.g while it is queued for a sleeping e12 node.
+   * @param seq Sequence number
+   */
+  void hold_pending(uint8_t seq);
+
+  /**
+   * @brief Starts the timeout of a held request, once it is written.
+   * @param seq Sequence number
+   */
+  void start_pending(uint8_t seq);
+
+  /**
+   * @brief Ends the pending request without a response, e.g ERR_BUS when
+   * the transport failed to write it. The callback runs from the next
+   * expire_pending(), never from inside the send that ended it.
+   * @param seq Sequence number
+   * @param err passed to the callback
+   * @return true if the request was pending
+   */
+  bool end_pending(uint8_t seq, e12_err_t err);
+
+  /**
+   * @brief Runs the callbacks of requests ended by end_pending(), expires
+   * requests older than the timeout, their callbacks get ERR_TIMEOUT, and
+   * drops a payload whose next fragment is overdue (E12_FRAG_TIMEOUT).
+   * Call it periodically e.g from the main loop.
+   * @return number of expired requests
+   */
+  int expire_pending();
+
+  /**
+   * @brief Sets the completion callback for requests tracked without one.
+   * @param cb Completion callback
+   * @param ctx Passed to cb
+   */
+  void set_response_cb(e12_resp_cb_t cb, void* ctx = 0) {
+    _resp_cb = cb;
+    _resp_ctx = ctx;
+  }
+
   /**
    * @brief Checks if the e12 endpoint is configured.
    * @return True if the endpoint is configured, false otherwise
@@ -633,14 +1859,20 @@ class e12 {
                                     void* data = 0);
 
   /**
-   * @brief Gets a response packet for the given packet.
-   * @param p Pointer to the packet
-   * @return Pointer to the response packet
+   * @brief Gets a response packet for the given packet. on_receive()
+   * never responds, whoever calls it sends the response to every request,
+   * built in or vendor, with send(get_response(p)) once it returns.
+   * @param p Pointer to the packet. With E12_HALF_DUPLEX, the received
+   * frame is turned into its response in place. For a CMD_BATCH, the
+   * responses of its sub-packets batched the same way.
+   * @return Pointer to the response packet, NULL if none is expected or
+   * the request was malformed
    */
   virtual e12_packet_t* get_response(e12_packet_t* p);
 
   /**
-   * @brief Gets a message from the e12 protocol.
+   * @brief Copies the last decoded message, only head.len bytes are copied.
+   * Prefer reading the packet returned by read() in place.
    * @param data Pointer to the data to be retrieved
    * @return True if the message was retrieved, false otherwise
    */
@@ -653,10 +1885,92 @@ class e12 {
    * @param len Length of the data
    * @return uint8_t Returns the checksum
    */
-  static uint8_t get_checksum(const char* data, uint8_t len);
+  static inline uint8_t get_checksum(const char* data, uint8_t len) {
+    uint8_t checksum = 0;
+    for (uint8_t i = 0; i < len; i++) {
+      checksum ^= data[i];
+    }
+    return checksum;
+  }
+
+  /**
+   * @brief Get the CRC-16/CCITT-FALSE of the given data
+   *
+   * @param data Pointer to the data
+   * @param len Length of the data
+   * @return uint16_t CRC value
+   */
+  static uint16_t get_crc16(const uint8_t* data, size_t len);
+
+  /**
+   * @brief Get the CRC-32 (IEEE 802.3) of the given data
+   *
+   * @param data Pointer to the data
+   * @param len Length of the data
+   * @return uint32_t CRC value
+   */
+  static uint32_t get_crc32(const uint8_t* data, size_t len);
+
+  /**
+   * @brief Starts a SHA-256
+   *
+   * @param ctx Context to initialise
+   */
+  static void sha256_init(e12_sha256_t* ctx);
+
+  /**
+   * @brief Adds data to a SHA-256
+   *
+   * @param ctx Context started with sha256_init()
+   * @param data Pointer to the data
+   * @param len Length of the data
+   */
+  static void sha256_update(e12_sha256_t* ctx, const uint8_t* data,
+                            size_t len);
 
   /**
-   * @brief Handles the received packet.
+   * @brief Finishes a SHA-256
+   *
+   * @param ctx Context to finish
+   * @param digest E12_SHA256_LEN bytes of digest
+   */
+  static void sha256_final(e12_sha256_t* ctx, uint8_t* digest);
+
+  /**
+   * @brief Get the number of CRC bytes trailing the payload
+   *
+   * @param mode integrity check
+   * @return uint8_t 0, E12_CRC16_LEN or E12_CRC32_LEN
+   */
+  static uint8_t get_trailer_len(e12_integrity_t mode);
+
+  /**
+   * @brief Selects the integrity check for frames sent on this link.
+   * Frames are accepted with any integrity check.
+   * @param mode integrity check to send with
+   * @param follow_peer switch to the check of each valid received frame,
+   * typically set on the e12 node so it answers the way it is asked
+   */
+  void set_integrity(e12_integrity_t mode, bool follow_peer = false) {
+    _integrity = mode;
+    _integrity_follow = follow_peer;
+  }
+
+  /**
+   * @brief Gets the integrity check used when sending.
+   * @return integrity check
+   */
+  e12_integrity_t get_integrity() { return _integrity; }
+
+  /**
+   * @brief Gets the integrity check of the last valid received frame.
+   * @return integrity check
+   */
+  e12_integrity_t get_rx_integrity() { return _rx_integrity; }
+
+  /**
+   * @brief Handles the received packet. A request is answered by the
+   * caller, see get_response().
    * @param p Pointer to the received packet
    * @return 0 on success, non-zero on failure
    */
@@ -695,6 +2009,151 @@ class e12 {
    */
   virtual bool on_ctl_write(uint8_t pin, uint32_t val);
 
+  /**
+   * @brief Reads the digital pins of a CMD_PIN_BATCH at once. Calls
+   * on_ctl_read() per pin, override it to read whole ports instead.
+   *
+   * @param mask Digital pins to read, all set up
+   * @return uint16_t levels, a bit per pin
+   */
+  virtual uint16_t on_ctl_read_digital(uint16_t mask);
+
+  /**
+   * @brief Applies a config sent as e12_tlv fields (IS_JSON false).
+   *
+   * @param r Reader over the fields
+   * @return int non-zero once configured
+   */
+  virtual int on_config_bin(e12_tlv_reader* r) { return 0; }
+
+  /**
+   * @brief Writes the state as e12_tlv fields, sent with IS_JSON false.
+   * Cheaper than on_get_state() on small MCUs, no text formatting. Only
+   * override it when the e12 node firmware decodes e12_tlv states.
+   *
+   * @param w Writer over the state data
+   * @param ctx passed to get_request(CMD_STATE)
+   * @return int 0 on success, negative to send on_get_state() JSON instead
+   */
+  virtual int on_get_state_bin(e12_tlv_writer* w, void* ctx) { return -1; }
+
+  /**
+   * @brief Restores a state stored as e12_tlv fields (IS_JSON false).
+   *
+   * @param r Reader over the fields
+   * @return int 0 on success, negative on failure
+   */
+  virtual int on_restore_state_bin(e12_tlv_reader* r) { return -1; }
+
+  /**
+   * @brief Receives the fragments of a payload in order. The default
+   * copies them into a reassembly buffer (E12_FRAG_BUF_SIZE) and calls
+   * on_reassembled() with the whole payload. Override to consume large
+   * payloads as they arrive instead, e.g on AVR.
+   *
+   * @param cmd Command of the payload
+   * @param off Offset of data in the payload
+   * @param data Fragment bytes, NULL if the payload was dropped (timeout,
+   * missing fragment or a new payload started)
+   * @param len Fragment bytes
+   * @param total Payload bytes
+   * @return int negative to drop the rest of the payload
+   */
+  virtual int on_fragment(e12_cmd_t cmd, uint16_t off, const uint8_t* data,
+                          uint8_t len, uint16_t total);
+
+  /**
+   * @brief Handles a payload reassembled by on_fragment(). CMD_CONFIG and
+   * CMD_STATE payloads (e12_data_t without the padding) go to the same
+   * hooks as unfragmented ones.
+   *
+   * @param cmd Command of the payload
+   * @param data Payload, only valid during the call
+   * @param len Payload bytes
+   * @return int 0 on success, negative on failure
+   */
+  virtual int on_reassembled(e12_cmd_t cmd, const uint8_t* data,
+                             uint16_t len);
+
+  /**
+   * @brief Accepts a new firmware image, e.g erases the flash it goes to.
+   * Not called when a saved transfer of the same image resumes.
+   *
+   * @param info Offered image
+   * @return int 0 to receive it, negative to refuse
+   */
+  virtual int on_fw_begin(const e12_fw_info_t* info) { return -1; }
+
+  /**
+   * @brief Writes a firmware chunk. Chunks may arrive out of order.
+   *
+   * @param off Offset in the image
+   * @param data Chunk bytes
+   * @param len Chunk bytes
+   * @return int 0 on success, negative on failure
+   */
+  virtual int on_fw_write(uint32_t off, const uint8_t* data, uint8_t len) {
+    return -1;
+  }
+
+  /**
+   * @brief Reads back written firmware, to hash chunks that arrived out
+   * of order, E12_FW_READ_PIECE bytes at a time. Without it those chunks
+   * are asked for again. Failing after the first piece of a chunk ends the
+   * transfer with FW_WRITE_ERR, the hash can not be rewound.
+   *
+   * @param off Offset in the image
+   * @param data Where to read to
+   * @param len Bytes to read
+   * @return int 0 on success, negative on failure
+   */
+  virtual int on_fw_read(uint32_t off, uint8_t* data, uint8_t len) {
+    return -1;
+  }
+
+  /**
+   * @brief Called once every chunk of the firmware was written.
+   *
+   * @param info Received image
+   * @param ok true if the SHA-256 matches
+   * @return int 0 on success
+   */
+  virtual int on_fw_done(const e12_fw_info_t* info, bool ok) { return 0; }
+
+  /**
+   * @brief Persists the firmware transfer state before each CMD_FW_ACK, so
+   * what the sender was told is received survives a reset. in_use false
+   * when the transfer ended and the saved state can be cleared.
+   *
+   * @param rx Transfer state
+   * @return int 0 on success, negative if not supported
+   */
+  virtual int on_fw_save(const e12_fw_rx_t* rx) { return -1; }
+
+  /**
+   * @brief Loads the state saved by on_fw_save() when none is in memory,
+   * e.g after a reset, on the next CMD_FW_BEGIN or CMD_FW_CHUNK.
+   *
+   * @param rx Transfer state to fill
+   * @return int 0 on success, negative if there is none
+   */
+  virtual int on_fw_load(e12_fw_rx_t* rx) { return -1; }
+
+  /**
+   * @brief Called when a firmware image sent by fw_send() was received
+   * (FW_DONE) or the transfer failed.
+   *
+   * @param status Outcome
+   */
+  virtual void on_fw_sent(e12_fw_status_t status) {}
+
+  /**
+   * @brief Called with the pins of a CMD_PIN_EVENT, on the node
+   *
+   * @param st Pins that changed and their values
+   */
+  virtual void on_pin_event(const e12_pin_state_t* st) {}
+
   // Pure virtual functions to be implemented by derived classes
 
   virtual int begin(void* bus, uint8_t e12_addr = 0) = 0;
@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_E12_RING
+#define H_E12_RING
+
+#include <stdint.h>
+#include <string.h>
+
+#include "e12_transport.h"
+
+// orders the buffer access against the index update (compiler barrier on
+// single core MCUs)
+#define E12_RING_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/**
+ * @brief Index type of an e12_ring, a single byte up to 256 bytes so it
+ * is read and written atomically on 8 bit MCUs as well
+ */
+template <bool SMALL>
+struct e12_ring_index {
+  typedef uint16_t type;
+};
+
+template <>
+struct e12_ring_index<true> {
+  typedef uint8_t type;
+};
+
+/**
+ * @class e12_ring
+ * @brief Fixed size byte ring, no allocation.
+ *
+ * Safe for one producer and one consumer without locks, e.g an interrupt
+ * handler pushing and the main loop popping. put()/push() are the
+ * producer side, read()/peek()/segments()/drop() the consumer side.
+ * One byte is kept free to tell full from empty, so SIZE - 1 bytes fit.
+ *
+ * @tparam SIZE ring size in bytes, a power of two
+ */
+template <uint16_t SIZE>
+class e12_ring {
+  static_assert(SIZE >= 2 && (SIZE & (SIZE - 1)) == 0,
+                "e12_ring size must be a power of two");
+
+  typedef typename e12_ring_index<(SIZE <= 256)>::type index_t;
+
+ private:
+  uint8_t _buf[SIZE];
+  volatile index_t _head;  ///< next byte written, owned by the producer
+  volatile index_t _tail;  ///< next byte read, owned by the consumer
+
+ public:
+  e12_ring() : _head(0), _tail(0) {}
+
+  /**
+   * @brief Gets the number of bytes the ring can hold.
+   * @return capacity in bytes
+   */
+  uint16_t capacity() const { return SIZE - 1; }
+
+  /**
+   * @brief Gets the number of bytes queued.
+   * @return bytes queued
+   */
+  uint16_t count() const {
+    return (uint16_t)((index_t)(_head - _tail) & (SIZE - 1));
+  }
+
+  /**
+   * @brief Gets the number of bytes that can still be pushed.
+   * @return free bytes
+   */
+  uint16_t space() const { return SIZE - 1 - count(); }
+
+  bool empty() const { return _head == _tail; }
+
+  /**
+   * @brief Appends one byte. Producer side.
+   * @param c byte to append
+   * @return false if the ring is full
+   */
+  bool put(uint8_t c) {
+    index_t head = _head;
+    index_t next = (head + 1) & (SIZE - 1);
+    if (next == _tail) return false;
+    _buf[head] = c;
+    E12_RING_FENCE();
+    _head = next;
+    return true;
+  }
+
+  /**
+   * @brief Appends len bytes, all or nothing. Producer side.
+   * @param buf bytes to append
+   * @param len number of bytes
+   * @return false if they do not fit
+   */
+  bool push(const uint8_t* buf, uint16_t len) {
+    if (len > space()) return false;
+    index_t head = _head;
+    uint16_t first = SIZE - head;
+    if (first > len) first = len;
+    memcpy(&_buf[head], buf, first);
+    memcpy(&_buf[0], buf + first, len - first);
+    E12_RING_FENCE();
+    _head = (head + len) & (SIZE - 1);
+    return true;
+  }
+
+  /**
+   * @brief Gets where the next bytes can be written in place, e.g by
+   * e12_transport::read(), followed by commit(). Producer side.
+   * @param len set to the contiguous free bytes at the returned pointer
+   * @return where to write
+   */
+  uint8_t* write_ptr(uint16_t* len) {
+    index_t head = _head;
+    uint16_t first = SIZE - head;
+    uint16_t free = space();
+    *len = free < first ? free : first;
+    return &_buf[head];
+  }
+
+  /**
+   * @brief Appends len bytes written at write_ptr(). Producer side.
+   * @param len number of bytes, at most what write_ptr() returned
+   */
+  void commit(uint16_t len) {
+    E12_RING_FENCE();
+    _head = (_head + len) & (SIZE - 1);
+  }
+
+  /**
+   * @brief Gets a queued byte without removing it. Consumer side.
+   * @param i offset from the oldest byte, must be < count()
+   * @return the byte
+   */
+  uint8_t peek(uint16_t i) const { return _buf[(_tail + i) & (SIZE - 1)]; }
+
+  /**
+   * @brief Describes the first len queued bytes as at most two segments,
+   * e.g to hand a queued frame to e12_transport::writev() without copying.
+   * Consumer side.
+   * @param iov array of two segments to fill
+   * @param len number of bytes, must be <= count() and < 256
+   * @return number of segments used
+   */
+  uint8_t segments(e12_iovec_t* iov, uint8_t len) const {
+    index_t tail = _tail;
+    uint16_t first = SIZE - tail;
+    if (first >= len) {
+      iov[0].base = &_buf[tail];
+      iov[0].len = len;
+      return 1;
+    }
+    iov[0].base = &_buf[tail];
+    iov[0].len = (uint8_t)first;
+    iov[1].base = &_buf[0];
+    iov[1].len = (uint8_t)(len - first);
+    return 2;
+  }
+
+  /**
+   * @brief Removes the oldest len bytes. Consumer side.
+   * @param len number of bytes, must be <= count()
+   */
+  void drop(uint16_t len) {
+    E12_RING_FENCE();
+    _tail = (_tail + len) & (SIZE - 1);
+  }
+
+  /**
+   * @brief Copies out and removes up to len bytes. Consumer side.
+   * @param buf destination buffer
+   * @param len size of buf
+   * @return number of bytes copied
+   */
+  uint16_t read(uint8_t* buf, uint16_t len) {
+    uint16_t n = count();
+    if (n > len) n = len;
+    index_t tail = _tail;
+    uint16_t first = SIZE - tail;
+    if (first > n) first = n;
+    memcpy(buf, &_buf[tail], first);
+    memcpy(buf + first, &_buf[0], n - first);
+    drop(n);
+    return n;
+  }
+
+  /**
+   * @brief Drops everything queued. Consumer side.
+   */
+  void clear() { drop(count()); }
+};
+
+/**
+ * @class e12_rx_ring_transport
+ * @brief Buffers the bytes received by another transport, so they can be
+ * taken off the bus from an interrupt handler and decoded by the main
+ * loop later.
+ *
+ * pump() is the producer side: call it from one context only, e.g a UART
+ * receive or timer interrupt, or Wire.onReceive() on an I2C slave where
+ * the next write replaces the bytes not yet read. The backend reads the
+ * ring as a byte stream, e12_arduino::e12_run() decodes every complete
+ * frame in it. e12_esp32_node buffers its I2C slave transport this way.
+ * Not for an I2C master, its reads cannot run in an interrupt handler, use
+ * e12_arduino::notify_rx() instead.
+ *
+ * @tparam SIZE ring size in bytes, a power of two. Up to 256 keeps the
+ * indexes atomic on 8 bit MCUs.
+ */
+template <uint16_t SIZE>
+class e12_rx_ring_transport : public e12_transport {
+ private:
+  e12_transport* _bus;  ///< transport the bytes are received on
+  e12_ring<SIZE> _rx;   ///< received, not yet decoded
+
+ public:
+  /**
+   * @brief Constructor for e12_rx_ring_transport.
+   * @param bus transport to buffer
+   */
+  e12_rx_ring_transport(e12_transport* bus = NULL) : _bus(bus) {}
+
+  /**
+   * @brief Set the transport to buffer, used before begin().
+   * @param bus transport to buffer
+   */
+  void attach(e12_transport* bus) { _bus = bus; }
+
+  /**
+   * @brief Moves the bytes received by the transport into the ring, no
+   * copy. Producer side.
+   * @return int bytes moved, negative if there is no transport. Bytes that
+   * do not fit stay in the transport.
+   */
+  int pump() {
+    if (!_bus) return -1;
+    int total = 0;
+    while (true) {
+      uint16_t room;
+      uint8_t* p = _rx.write_ptr(&room);
+      if (!room) break;
+      int n = _bus->read(p, room > 0xFF ? 0xFF : (uint8_t)room);
+      if (n <= 0) break;
+      _rx.commit(n);
+      total += n;
+    }
+    return total;
+  }
+
+  /**
+   * @brief Appends bytes already read off the bus, e.g the data register
+   * in a UART interrupt. Producer side.
+   * @param buf received bytes
+   * @param len number of bytes
+   * @return false if they do not fit, nothing is appended then
+   */
+  bool push(const uint8_t* buf, uint16_t len) { return _rx.push(buf, len); }
+
+  /**
+   * @brief Gets the number of bytes waiting to be decoded.
+   * @return number of bytes
+   */
+  uint16_t available() const { return _rx.count(); }
+
+  virtual int begin() {
+    if (!_bus) return -1;
+    _rx.clear();
+    return _bus->begin();
+  }
+  virtual int end() { return _bus ? _bus->end() : -1; }
+  virtual int writev(const e12_iovec_t* iov, uint8_t cnt) {
+    return _bus ? _bus->writev(iov, cnt) : -1;
+  }
+  virtual int read(uint8_t* buf, uint8_t len) { return _rx.read(buf, len); }
+};
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "e12_protocol.h"
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define SHA256_K_ATTR PROGMEM
+#define K(i) pgm_read_dword(&sha256_k[i])
+#else
+#define SHA256_K_ATTR
+#define K(i) sha256_k[i]
+#endif
+
+// FIPS 180-4. AVR keeps the round constants in flash, 256 bytes of RAM
+// are a lot there.
+
+static const uint32_t sha256_k[64] SHA256_K_ATTR = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static inline uint32_t ror(uint32_t x, uint8_t n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_block(uint32_t* h, const uint8_t* p) {
+  // 16 word schedule, extended in place
+  uint32_t w[16];
+  for (uint8_t i = 0; i < 16; i++) {
+    w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+           (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+  }
+
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+  uint32_t e = h[4], f = h[5], g = h[6], k = h[7];
+  for (uint8_t i = 0; i < 64; i++) {
+    if (i >= 16) {
+      uint32_t w15 = w[(i + 1) & 15];
+      uint32_t w2 = w[(i + 14) & 15];
+      w[i & 15] += (ror(w15, 7) ^ ror(w15, 18) ^ (w15 >> 3)) +
+                   w[(i + 9) & 15] + (ror(w2, 17) ^ ror(w2, 19) ^ (w2 >> 10));
+    }
+    uint32_t t1 = k + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) +
+                  ((e & f) ^ (~e & g)) + K(i) + w[i & 15];
+    uint32_t t2 =
+        (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    k = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+  h[4] += e;
+  h[5] += f;
+  h[6] += g;
+  h[7] += k;
+}
+
+/**
+ * @brief Start a SHA-256
+ *
+ * @param ctx Context to initialise
+ */
+void e12::sha256_init(e12_sha256_t* ctx) {
+  static const uint32_t iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                 0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                 0x1f83d9ab, 0x5be0cd19};
+  memcpy(ctx->h, iv, sizeof(iv));
+  ctx->len = 0;
+}
+
+/**
+ * @brief Add data to a SHA-256
+ *
+ * @param ctx Context started with sha256_init()
+ * @param data Pointer to the data
+ * @param len Length of the data
+ */
+void e12::sha256_update(e12_sha256_t* ctx, const uint8_t* data, size_t len) {
+  uint8_t used = ctx->len & 63;
+  ctx->len += len;
+  if (used) {
+    uint8_t n = 64 - used;
+    if (n > len) n = len;
+    memcpy(&ctx->buf[used], data, n);
+    data += n;
+    len -= n;
+    if (used + n < 64) return;
+    sha256_block(ctx->h, ctx->buf);
+  }
+  for (; len >= 64; data += 64, len -= 64) sha256_block(ctx->h, data);
+  memcpy(ctx->buf, data, len);
+}
+
+/**
+ * @brief Finish a SHA-256
+ *
+ * @param ctx Context to finish
+ * @param digest 32 bytes of digest
+ */
+void e12::sha256_final(e12_sha256_t* ctx, uint8_t* digest) {
+  uint64_t bits = ctx->len * 8;
+  uint8_t used = ctx->len & 63;
+  ctx->buf[used++] = 0x80;
+  if (used > 56) {
+    memset(&ctx->buf[used], 0, 64 - used);
+    sha256_block(ctx->h, ctx->buf);
+    used = 0;
+  }
+  memset(&ctx->buf[used], 0, 56 - used);
+  for (uint8_t i = 0; i < 8; i++) ctx->buf[63 - i] = bits >> (8 * i);
+  sha256_block(ctx->h, ctx->buf);
+  for (uint8_t i = 0; i < 32; i++) {
+    digest[i] = ctx->h[i / 4] >> (24 - 8 * (i & 3));
+  }
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_E12_STATIC
+#define H_E12_STATIC
+
+#include <stdint.h>
+
+#include "e12_protocol.h"
+
+/**
+ * @class e12_static
+ * @brief Send path of an e12 backend resolved at compile time (CRTP).
+ *
+ * send() encodes the packet with the inline e12::encode_frame(), then
+ * hands the frame straight to Derived::write_frame(), no virtual call or
+ * transport in between. Everything else, receiving and the virtual hooks
+ * included, is Base.
+ * Derived implements:
+ *
+ *   int write_frame(const uint8_t* buf, uint8_t len);
+ *
+ * returning negative on failure, and the pure virtuals of Base. Example:
+ *
+ *   class my_vmcu : public e12_static<my_vmcu, e12_posix> {
+ *    public:
+ *     my_vmcu() : e12_static(VID, PID) {}
+ *     int write_frame(const uint8_t* buf, uint8_t len) { ... }
+ *   };
+ *
+ * @tparam Derived class implementing write_frame()
+ * @tparam Base e12 or a backend deriving from it, constructed with
+ * (vid, pid)
+ */
+template <class Derived, class Base = e12>
+class e12_static : public Base {
+ public:
+  e12_static(uint32_t vid, uint32_t pid) : Base(vid, pid) {}
+
+  /**
+   * @brief Encodes the packet, writes the frame with
+   * Derived::write_frame() and tracks a request until its response.
+   * @param buf Pointer to the packet
+   * @param retry unused, write_frame() decides
+   * @return int bytes written, negative on failure
+   */
+  int send(e12_packet_t* buf, bool retry = true) {
+    if (!buf) return 0;
+    e12_onwire_t* req = e12::encode_frame(this->get_encode_buffer(), buf,
+                                          this->get_integrity());
+    if (!req) return -1;
+    req->resp_pending = req->data.msg.head.RESP_EXPECTED;
+    req->ts = this->get_time_ms();
+    if (static_cast<Derived*>(this)->write_frame(req->buf, req->head.len) <
+        0) {
+      return -1;
+    }
+    if (buf->msg.head.RESP_EXPECTED && !buf->msg.head.IS_RESPONSE) {
+      this->add_pending(buf);
+    }
+    return req->head.len;
+  }
+};
+
+#endif
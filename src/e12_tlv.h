@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_E12_TLV
+#define H_E12_TLV
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Appends v as a little endian base 128 varint, 1-5 bytes.
+ * @param buf buffer with room for 5 bytes
+ * @param v value
+ * @return bytes written
+ */
+static inline uint8_t e12_put_varint(uint8_t* buf, uint32_t v) {
+  uint8_t n = 0;
+  while (v >= 0x80) {
+    buf[n++] = (uint8_t)v | 0x80;
+    v >>= 7;
+  }
+  buf[n++] = (uint8_t)v;
+  return n;
+}
+
+/**
+ * @brief Reads a varint written by e12_put_varint().
+ * @param buf buffer
+ * @param len bytes left in buf
+ * @param v value read
+ * @return bytes read, 0 if truncated or longer than 5 bytes
+ */
+static inline uint8_t e12_get_varint(const uint8_t* buf, uint8_t len,
+                                     uint32_t* v) {
+  uint32_t r = 0;
+  for (uint8_t n = 0; n < len && n < 5; n++) {
+    r |= (uint32_t)(buf[n] & 0x7F) << (7 * n);
+    if (!(buf[n] & 0x80)) {
+      *v = r;
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+static inline uint8_t e12_varint_len(uint32_t v) {
+  uint8_t n = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    n++;
+  }
+  return n;
+}
+
+/**
+ * @brief Maps signed to unsigned so small magnitudes make short varints.
+ */
+static inline uint32_t e12_zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t e12_unzigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+/**
+ * @brief Type of an e12_tlv field, the top 3 bits of its first byte.
+ * 0 ends the fields so zero padding after them is ignored.
+ */
+enum class e12_tlv_type_t : uint8_t {
+  TLV_END = 0,
+  /// varint
+  TLV_UINT,
+  /// zigzag varint
+  TLV_INT,
+  /// IEEE 754 binary32, little endian
+  TLV_FLOAT,
+  /// length byte and bytes, strings are not terminated
+  TLV_BYTES,
+  TLV_TRUE,
+  TLV_FALSE
+};
+
+/**
+ * @brief max key of an e12_tlv field, the low 5 bits of its first byte
+ */
+#define E12_TLV_MAX_KEY 31
+
+/**
+ * @class e12_tlv_writer
+ * @brief Writes key/value fields into a buffer, e.g the data of an
+ * e12_data_t sent with IS_JSON false. Replaces JSON formatting on small
+ * MCUs: a field is 1 byte of type and key followed by the value.
+ *
+ * Example:
+ *   e12_tlv_writer w(buf, sizeof(buf));
+ *   w.put_uint(KEY_COUNT, _count);
+ *   w.put_bool(KEY_ON, _on);
+ *   if (!w.ok()) return -1;
+ */
+class e12_tlv_writer {
+ private:
+  uint8_t* _buf;
+  uint8_t _size;
+  uint8_t _len;
+  bool _ok;
+
+  bool put_head(uint8_t key, e12_tlv_type_t type, uint8_t len) {
+    if (!_ok || key > E12_TLV_MAX_KEY || _len + 1 + len > _size) {
+      _ok = false;
+      return false;
+    }
+    _buf[_len++] = (uint8_t)type << 5 | key;
+    return true;
+  }
+
+  bool put_varint(uint8_t key, e12_tlv_type_t type, uint32_t v) {
+    if (!put_head(key, type, e12_varint_len(v))) return false;
+    _len += e12_put_varint(&_buf[_len], v);
+    return true;
+  }
+
+ public:
+  e12_tlv_writer(uint8_t* buf, uint8_t size)
+      : _buf(buf), _size(size), _len(0), _ok(true) {}
+
+  bool put_uint(uint8_t key, uint32_t v) {
+    return put_varint(key, e12_tlv_type_t::TLV_UINT, v);
+  }
+
+  bool put_int(uint8_t key, int32_t v) {
+    return put_varint(key, e12_tlv_type_t::TLV_INT, e12_zigzag(v));
+  }
+
+  bool put_float(uint8_t key, float v) {
+    if (!put_head(key, e12_tlv_type_t::TLV_FLOAT, sizeof(float))) {
+      return false;
+    }
+    memcpy(&_buf[_len], &v, sizeof(float));
+    _len += sizeof(float);
+    return true;
+  }
+
+  bool put_bool(uint8_t key, bool v) {
+    return put_head(
+        key, v ? e12_tlv_type_t::TLV_TRUE : e12_tlv_type_t::TLV_FALSE, 0);
+  }
+
+  bool put_bytes(uint8_t key, const void* data, uint8_t len) {
+    if (!put_head(key, e12_tlv_type_t::TLV_BYTES, 1 + len)) return false;
+    _buf[_len++] = len;
+    memcpy(&_buf[_len], data, len);
+    _len += len;
+    return true;
+  }
+
+  bool put_str(uint8_t key, const char* s) {
+    size_t len = strlen(s);
+    if (len > 0xFF) {
+      _ok = false;
+      return false;
+    }
+    return put_bytes(key, s, (uint8_t)len);
+  }
+
+  /**
+   * @brief Gets the number of bytes written.
+   * @return bytes written
+   */
+  uint8_t len() const { return _len; }
+
+  /**
+   * @brief Checks every field fit.
+   * @return false if a field did not fit, it and later fields were dropped
+   */
+  bool ok() const { return _ok; }
+};
+
+/**
+ * @class e12_tlv_reader
+ * @brief Reads the fields written by e12_tlv_writer. get_*() convert
+ * between the numeric types, so a peer may send a count as TLV_INT or an
+ * integer temperature as TLV_UINT.
+ *
+ * Example:
+ *   e12_tlv_reader r(buf, len);
+ *   while (r.next()) {
+ *     if (r.key() == KEY_COUNT) _count = r.get_uint();
+ *   }
+ *   if (!r.ok()) return -1;
+ */
+class e12_tlv_reader {
+ private:
+  const uint8_t* _buf;
+  uint16_t _len;
+  uint16_t _pos;
+  bool _ok;
+  uint8_t _key;
+  e12_tlv_type_t _type;
+  uint32_t _v;            ///< varint or float bits
+  const uint8_t* _bytes;  ///< TLV_BYTES value
+  uint8_t _bytes_len;
+
+  // bytes left, capped to what one value can span
+  uint8_t left() const { return _len - _pos > 0xFF ? 0xFF : _len - _pos; }
+
+ public:
+  e12_tlv_reader(const uint8_t* buf, uint16_t len)
+      : _buf(buf),
+        _len(len),
+        _pos(0),
+        _ok(true),
+        _key(0),
+        _type(e12_tlv_type_t::TLV_END),
+        _v(0),
+        _bytes(0),
+        _bytes_len(0) {}
+
+  /**
+   * @brief Moves to the next field.
+   * @return false at the end of the fields or on a malformed field
+   */
+  bool next() {
+    if (!_ok || _pos >= _len) return false;
+    uint8_t head = _buf[_pos++];
+    _key = head & E12_TLV_MAX_KEY;
+    _type = (e12_tlv_type_t)(head >> 5);
+    _v = 0;
+    _bytes = 0;
+    _bytes_len = 0;
+    uint8_t n;
+    switch (_type) {
+      case e12_tlv_type_t::TLV_END:
+        _pos = _len;
+        return false;
+      case e12_tlv_type_t::TLV_UINT:
+      case e12_tlv_type_t::TLV_INT:
+        n = e12_get_varint(&_buf[_pos], left(), &_v);
+        if (!n) break;
+        _pos += n;
+        return true;
+      case e12_tlv_type_t::TLV_FLOAT:
+        if (_len - _pos < (int)sizeof(float)) break;
+        memcpy(&_v, &_buf[_pos], sizeof(float));
+        _pos += sizeof(float);
+        return true;
+      case e12_tlv_type_t::TLV_BYTES:
+        if (_pos >= _len || _buf[_pos] > _len - _pos - 1) break;
+        _bytes_len = _buf[_pos++];
+        _bytes = &_buf[_pos];
+        _pos += _bytes_len;
+        return true;
+      case e12_tlv_type_t::TLV_TRUE:
+      case e12_tlv_type_t::TLV_FALSE:
+        return true;
+      default:
+        break;
+    }
+    _ok = false;
+    return false;
+  }
+
+  uint8_t key() const { return _key; }
+  e12_tlv_type_t type() const { return _type; }
+
+  /**
+   * @brief Gets the read offset, just past the field next() returned.
+   * @return offset in the buffer
+   */
+  uint16_t pos() const { return _pos; }
+
+  /**
+   * @brief Checks the fields were well formed.
+   * @return false if next() stopped on a malformed field
+   */
+  bool ok() const { return _ok; }
+
+  int32_t get_int() const {
+    switch (_type) {
+      case e12_tlv_type_t::TLV_UINT:
+        return (int32_t)_v;
+      case e12_tlv_type_t::TLV_INT:
+        return e12_unzigzag(_v);
+      case e12_tlv_type_t::TLV_FLOAT:
+        return (int32_t)get_float();
+      case e12_tlv_type_t::TLV_TRUE:
+        return 1;
+      default:
+        return 0;
+    }
+  }
+
+  uint32_t get_uint() const {
+    if (_type == e12_tlv_type_t::TLV_UINT) return _v;
+    return (uint32_t)get_int();
+  }
+
+  float get_float() const {
+    float f;
+    switch (_type) {
+      case e12_tlv_type_t::TLV_FLOAT:
+        memcpy(&f, &_v, sizeof(float));
+        return f;
+      case e12_tlv_type_t::TLV_UINT:
+        return (float)_v;
+      default:
+        return (float)get_int();
+    }
+  }
+
+  bool get_bool() const { return get_int() != 0; }
+
+  /**
+   * @brief Gets a TLV_BYTES value.
+   * @param len set to the number of bytes
+   * @return Pointer to the bytes in the buffer, NULL for other types
+   */
+  const uint8_t* get_bytes(uint8_t* len) const {
+    *len = _bytes_len;
+    return _bytes;
+  }
+
+  /**
+   * @brief Copies a TLV_BYTES value as a terminated string.
+   * @param s destination
+   * @param size size of s
+   * @return false if it is not TLV_BYTES or was cut to fit
+   */
+  bool get_str(char* s, uint8_t size) const {
+    if (!size) return false;
+    uint8_t n = _bytes_len < size ? _bytes_len : size - 1;
+    if (_bytes) memcpy(s, _bytes, n);
+    s[n] = 0;
+    return _bytes && n == _bytes_len;
+  }
+};
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "e12_transport.h"
+
+#include <string.h>
+
+/**
+ * @brief Construct a new, unconnected loopback transport
+ */
+e12_loopback_transport::e12_loopback_transport() {
+  _peer = this;
+  _head = 0;
+  _count = 0;
+}
+
+/**
+ * @brief Connect two loopback transports to each other
+ *
+ * @param peer Other end of the link
+ */
+void e12_loopback_transport::connect(e12_loopback_transport* peer) {
+  _peer = peer ? peer : this;
+  if (peer) peer->_peer = this;
+}
+
+/**
+ * @brief Append bytes to the receive ring
+ *
+ * @param buf Bytes to append
+ * @param len Number of bytes
+ * @return int number of bytes appended, -1 if they do not fit
+ */
+int e12_loopback_transport::push(const uint8_t* buf, uint8_t len) {
+  if (_count + len > E12_LOOPBACK_BUF_SIZE) return -1;
+
+  uint16_t tail = (_head + _count) % E12_LOOPBACK_BUF_SIZE;
+  uint16_t first = E12_LOOPBACK_BUF_SIZE - tail;
+  if (first > len) first = len;
+  memcpy(&_rx[tail], buf, first);
+  memcpy(&_rx[0], buf + first, len - first);
+  _count += len;
+  return len;
+}
+
+/**
+ * @brief Deliver the segments to the peer
+ *
+ * @param iov Array of segments
+ * @param cnt Number of segments
+ * @return int number of bytes written, -1 if the peer is full
+ */
+int e12_loopback_transport::writev(const e12_iovec_t* iov, uint8_t cnt) {
+  uint16_t total = 0;
+  for (uint8_t i = 0; i < cnt; i++) total += iov[i].len;
+  if (_peer->_count + total > E12_LOOPBACK_BUF_SIZE) return -1;
+
+  for (uint8_t i = 0; i < cnt; i++) {
+    _peer->push(iov[i].base, iov[i].len);
+  }
+  return total;
+}
+
+/**
+ * @brief Read received bytes
+ *
+ * @param buf Destination buffer
+ * @param len Size of buf
+ * @return int number of bytes copied
+ */
+int e12_loopback_transport::read(uint8_t* buf, uint8_t len) {
+  uint16_t n = (_count < len) ? _count : len;
+  uint16_t first = E12_LOOPBACK_BUF_SIZE - _head;
+  if (first > n) first = n;
+  memcpy(buf, &_rx[_head], first);
+  memcpy(buf + first, &_rx[0], n - first);
+  _head = (_head + n) % E12_LOOPBACK_BUF_SIZE;
+  _count -= n;
+  return n;
+}
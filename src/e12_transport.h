@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_E12_TRANSPORT
+#define H_E12_TRANSPORT
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief One segment of a scatter/gather write
+ *
+ */
+typedef struct e12_iovec {
+  const uint8_t* base;
+  uint8_t len;
+} e12_iovec_t;
+
+/**
+ * @class e12_transport
+ * @brief Byte transport underneath an e12 backend.
+ *
+ * A transport moves already encoded e12 frames between the VMCU and the
+ * e12 node. It knows nothing about the frame format. Implementations exist
+ * for I2C and UART (src/arduino), I2C slave (esp32), file descriptors
+ * (posix) and an in-memory loopback (below). e12_rx_ring_transport
+ * (e12_ring.h) buffers the receive side of another one.
+ */
+class e12_transport {
+ public:
+  virtual ~e12_transport() {}
+
+  /**
+   * @brief Brings up the underlying bus.
+   * @return 0 on success, non-zero on failure
+   */
+  virtual int begin() { return 0; }
+
+  /**
+   * @brief Shuts down the underlying bus.
+   * @return 0 on success, non-zero on failure
+   */
+  virtual int end() { return 0; }
+
+  /**
+   * @brief Writes the segments back to back as one transaction.
+   * @param iov Array of segments
+   * @param cnt Number of segments
+   * @return number of bytes written, negative on failure
+   */
+  virtual int writev(const e12_iovec_t* iov, uint8_t cnt) = 0;
+
+  /**
+   * @brief Asks the peer for up to len bytes. Only meaningful for
+   * master-clocked buses like I2C, streams have nothing to do.
+   * @param len Number of bytes to clock in
+   * @return number of bytes made available, negative on failure
+   */
+  virtual int request(uint8_t len) { return len; }
+
+  /**
+   * @brief Copies up to len already received bytes into buf. Never blocks.
+   * @param buf Destination buffer
+   * @param len Size of buf
+   * @return number of bytes copied, negative on failure
+   */
+  virtual int read(uint8_t* buf, uint8_t len) = 0;
+
+  /**
+   * @brief Tells if frames may be split across reads.
+   * @return false if every request() starts a new frame (I2C), true for
+   * byte streams (UART, pipes)
+   */
+  virtual bool is_stream() { return true; }
+
+  /**
+   * @brief Writes a single contiguous buffer.
+   * @param buf Pointer to the bytes
+   * @param len Number of bytes
+   * @return number of bytes written, negative on failure
+   */
+  int write(const uint8_t* buf, uint8_t len) {
+    e12_iovec_t v = {buf, len};
+    return writev(&v, 1);
+  }
+};
+
+/**
+ * @brief Bytes each loopback end buffers, up to 65535
+ */
+#ifndef E12_LOOPBACK_BUF_SIZE
+#define E12_LOOPBACK_BUF_SIZE 256
+#endif
+
+/**
+ * @class e12_loopback_transport
+ * @brief In-memory transport. Bytes written to one end are read from the
+ * connected peer, or from itself when not connected.
+ */
+class e12_loopback_transport : public e12_transport {
+ private:
+  e12_loopback_transport* _peer;       ///< where writes are delivered
+  uint8_t _rx[E12_LOOPBACK_BUF_SIZE];  ///< receive ring
+  uint16_t _head;                      ///< next byte to read
+  uint16_t _count;                     ///< bytes in the ring
+
+  int push(const uint8_t* buf, uint8_t len);
+
+ public:
+  e12_loopback_transport();
+
+  /**
+   * @brief Connects two loopback transports to each other.
+   * @param peer Other end of the link
+   */
+  void connect(e12_loopback_transport* peer);
+
+  virtual int writev(const e12_iovec_t* iov, uint8_t cnt);
+  virtual int read(uint8_t* buf, uint8_t len);
+
+  /**
+   * @brief Gets the number of bytes waiting to be read.
+   * @return number of bytes
+   */
+  uint16_t available() { return _count; }
+};
+
+#endif
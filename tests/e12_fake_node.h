@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_E12_FAKE_NODE
+#define H_E12_FAKE_NODE
+
+#include <posix_e12_protocol.h>
+#include <string.h>
+
+#define FAKE_NODE_STAGED 1024
+#define FAKE_NODE_FRAMES 32
+
+/**
+ * @brief The e12 node end of an I2C bus for host tests. Frames the master
+ * writes are decoded into got[], frames staged for the master are clocked
+ * out a transaction at a time, 0xFF once there is nothing left.
+ */
+class e12_fake_node : public e12_transport {
+ private:
+  static bool keep(e12_packet_t* p, void* ctx) {
+    e12_fake_node* n = (e12_fake_node*)ctx;
+    if (n->got_n < FAKE_NODE_FRAMES) {
+      memcpy(&n->got[n->got_n], p, p->msg.head.len);
+    }
+    n->got_n++;
+    return true;
+  }
+
+  uint8_t _rx[FAKE_NODE_STAGED];  ///< bytes of the last transaction
+  int _rx_len;
+  int _rx_pos;
+
+ public:
+  e12_posix node;  ///< decodes what the master writes, encodes replies
+  uint8_t staged[FAKE_NODE_STAGED];
+  int staged_len;
+  int staged_pos;
+  e12_packet_t got[FAKE_NODE_FRAMES];
+  int got_n;
+  int writes;        ///< write transactions
+  int requests;      ///< read transactions
+  int clocked;       ///< bytes clocked by read transactions
+  bool fail_writes;  ///< NACK every write
+
+  e12_fake_node() : node(1, 2) { reset(); }
+
+  void reset() {
+    _rx_len = _rx_pos = 0;
+    staged_len = staged_pos = 0;
+    got_n = writes = requests = clocked = 0;
+    fail_writes = false;
+  }
+
+  /**
+   * @brief Stages a packet for the master to read.
+   */
+  void stage(e12_packet_t* p) {
+    e12_onwire_t* w = node.encode(p);
+    memcpy(&staged[staged_len], w->buf, w->head.len);
+    staged_len += w->head.len;
+  }
+
+  /**
+   * @brief Stages the node's response to the i-th frame written.
+   */
+  void reply(int i) {
+    e12_packet_t req;
+    memcpy(&req, &got[i], got[i].msg.head.len);
+    stage(node.get_response(&req));
+  }
+
+  virtual int writev(const e12_iovec_t* iov, uint8_t cnt) {
+    writes++;
+    if (fail_writes) return -1;
+    int total = 0;
+    for (uint8_t i = 0; i < cnt; i++) {
+      node.decode(iov[i].base, iov[i].len, keep, this);
+      total += iov[i].len;
+    }
+    return total;
+  }
+
+  virtual int request(uint8_t len) {
+    requests++;
+    clocked += len;
+    for (_rx_len = 0; _rx_len < len; _rx_len++) {
+      _rx[_rx_len] =
+          staged_pos < staged_len ? staged[staged_pos++] : (uint8_t)0xFF;
+    }
+    _rx_pos = 0;
+    return len;
+  }
+
+  virtual int read(uint8_t* buf, uint8_t len) {
+    int n = 0;
+    while (n < len && _rx_pos < _rx_len) buf[n++] = _rx[_rx_pos++];
+    return n;
+  }
+
+  virtual bool is_stream() { return false; }
+};
+
+#endif
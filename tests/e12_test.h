@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_E12_TEST
+#define H_E12_TEST
+
+#include <stdio.h>
+
+// Host tests are plain programs: a failed CHECK prints where and the test
+// exits non-zero, which is what ctest looks at.
+
+static int e12_test_failures = 0;
+
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, \
+              #cond);                                                 \
+      e12_test_failures++;                                            \
+    }                                                                 \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                  \
+  do {                                                                  \
+    long long _a = (long long)(a), _b = (long long)(b);                 \
+    if (_a != _b) {                                                     \
+      fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", \
+              __FILE__, __LINE__, #a, #b, _a, _b);                      \
+      e12_test_failures++;                                              \
+    }                                                                   \
+  } while (0)
+
+static inline int e12_test_result() {
+  if (e12_test_failures) {
+    fprintf(stderr, "%d check(s) failed\n", e12_test_failures);
+    return 1;
+  }
+  return 0;
+}
+
+#define TEST_DONE() return e12_test_result()
+
+#endif
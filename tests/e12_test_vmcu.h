@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_E12_TEST_VMCU
+#define H_E12_TEST_VMCU
+
+#include <arduino_e12_protocol.h>
+
+/**
+ * @brief e12_arduino with the application hooks stubbed out, for tests
+ * driving it against e12_fake_node.
+ */
+class e12_test_vmcu : public e12_arduino {
+ public:
+  e12_test_vmcu() : e12_arduino(1, 2) {}
+
+  using e12::set_node_status;
+
+  virtual int log(uint8_t type, uint8_t status, uint32_t ts, void* data) {
+    return 0;
+  }
+  // no INFO/CONFIG/STATE on every wake up, tests count their own frames
+  virtual int on_wakeup() { return 0; }
+  virtual int on_config(const char* s, int len) { return 1; }
+  virtual int on_get_state(char* s, int len, void* ctx) { return 0; }
+  virtual int on_restore_state(const char* s, int len) { return 0; }
+};
+
+#endif
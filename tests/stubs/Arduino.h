@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Just enough of the Arduino core to build src/arduino on a host. Time
+// only moves when a test sets e12_stub_ms or the code calls delay().
+
+#ifndef H_E12_STUB_ARDUINO
+#define H_E12_STUB_ARDUINO
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+#define F(s) (s)
+#define PSTR(s) (s)
+#define snprintf_P snprintf
+
+extern uint32_t e12_stub_ms;
+
+static inline uint32_t millis() { return e12_stub_ms; }
+static inline void delay(uint32_t ms) { e12_stub_ms += ms; }
+static inline void pinMode(uint8_t pin, uint8_t mode) {}
+static inline void digitalWrite(uint8_t pin, uint8_t val) {}
+static inline int digitalRead(uint8_t pin) { return LOW; }
+static inline void noInterrupts() {}
+static inline void interrupts() {}
+
+namespace arduino {
+
+class HardwareSerial {
+ public:
+  void begin(uint32_t baud) {}
+  void end() {}
+  size_t write(const uint8_t* buf, size_t len) { return len; }
+  int available() { return 0; }
+  int read() { return -1; }
+  size_t print(const char* s) { return 0; }
+  size_t print(long v) { return 0; }
+  size_t println(const char* s = "") { return 0; }
+  size_t println(long v) { return 0; }
+};
+
+}  // namespace arduino
+
+extern arduino::HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// I2C master stub, host tests talk to the node through their own
+// e12_transport instead.
+
+#ifndef H_E12_STUB_WIRE
+#define H_E12_STUB_WIRE
+
+#include "Arduino.h"
+
+namespace arduino {
+
+class TwoWire {
+ public:
+  void begin() {}
+  void end() {}
+  void setClock(uint32_t hz) {}
+  void beginTransmission(uint8_t addr) {}
+  size_t write(const uint8_t* buf, size_t len) { return len; }
+  uint8_t endTransmission() { return 0; }
+  uint8_t requestFrom(uint8_t addr, uint8_t len) { return 0; }
+  int available() { return 0; }
+  int read() { return -1; }
+};
+
+}  // namespace arduino
+
+extern arduino::TwoWire Wire;
+
+#endif
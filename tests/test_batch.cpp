@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Requests sent in one CMD_BATCH get their responses back in one
+// CMD_BATCH, each completing its own pending request.
+
+#include <posix_e12_protocol.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+typedef struct {
+  int calls;
+  e12_err_t err;
+  e12_cmd_t cmd;
+  char data[16];
+} result_t;
+
+static void on_done(uint8_t seq, e12_err_t err, e12_packet_t* p, void* ctx) {
+  result_t* r = (result_t*)ctx;
+  r->calls++;
+  r->err = err;
+  if (p) {
+    r->cmd = p->msg.head.cmd;
+    memcpy(r->data, p->msg.data, sizeof(r->data) - 1);
+  }
+}
+
+// the node answers whatever it reads
+static int serve(e12_posix* node) {
+  int n = 0;
+  e12_packet_t* p;
+  while ((p = node->read()) != NULL) {
+    node->on_receive(p);
+    e12_packet_t* resp = node->get_response(p);
+    if (resp) {
+      node->send(resp);
+      n++;
+    }
+  }
+  return n;
+}
+
+static void drain(e12_posix* vmcu) {
+  e12_packet_t* p;
+  while ((p = vmcu->read()) != NULL) vmcu->on_receive(p);
+}
+
+int main() {
+  e12_loopback_transport la, lb;
+  la.connect(&lb);
+  e12_posix vmcu(1, 2), node(1, 2);
+  CHECK_EQ(vmcu.begin(&la), 0);
+  CHECK_EQ(node.begin(&lb), 0);
+
+  result_t res[3];
+  memset(res, 0, sizeof(res));
+  e12_packet_t batch;
+  vmcu.batch_init(&batch);
+
+  e12_packet_t* p = vmcu.get_request(e12_cmd_t::CMD_PING);
+  CHECK(vmcu.add_pending(p, on_done, &res[0]) >= 0);
+  CHECK(vmcu.batch_add(&batch, p));
+  p = vmcu.get_request(e12_cmd_t::CMD_TIME);
+  CHECK(vmcu.add_pending(p, on_done, &res[1]) >= 0);
+  CHECK(vmcu.batch_add(&batch, p));
+  // no response expected, nothing batched back for it
+  p = vmcu.get_request(e12_cmd_t::CMD_PING, false);
+  CHECK(vmcu.batch_add(&batch, p));
+  p = vmcu.get_request(e12_cmd_t::CMD_PING);
+  CHECK(vmcu.add_pending(p, on_done, &res[2]) >= 0);
+  CHECK(vmcu.batch_add(&batch, p));
+
+  CHECK(vmcu.send(&batch) > 0);
+  CHECK_EQ(serve(&node), 1);
+  drain(&vmcu);
+
+  for (int i = 0; i < 3; i++) {
+    CHECK_EQ(res[i].calls, 1);
+    CHECK(res[i].err == e12_err_t::ERR_NONE);
+  }
+  CHECK(res[0].cmd == e12_cmd_t::CMD_PING);
+  CHECK(strcmp(res[0].data, "pong") == 0);
+  CHECK(res[1].cmd == e12_cmd_t::CMD_TIME);
+  CHECK(res[2].cmd == e12_cmd_t::CMD_PING);
+  CHECK_EQ(vmcu.get_pending_count(), 0);
+
+  // nothing to answer, no response at all
+  vmcu.batch_init(&batch);
+  for (int i = 0; i < 3; i++) {
+    CHECK(vmcu.batch_add(&batch,
+                         vmcu.get_request(e12_cmd_t::CMD_PING, false)));
+  }
+  CHECK(vmcu.send(&batch) > 0);
+  CHECK_EQ(serve(&node), 0);
+
+  TEST_DONE();
+}
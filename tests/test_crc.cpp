@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// CRC-16/CCITT-FALSE and CRC-32 give the catalogue check values, and the
+// table driven versions agree with the bitwise definition at any length.
+// A frame with a corrupted payload or trailer is dropped by the decoder,
+// the next intact frame still comes through.
+
+#include <posix_e12_protocol.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+static const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+
+static uint16_t crc16_bitwise(const uint8_t* data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int b = 0; b < 8; b++) {
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static uint32_t crc32_bitwise(const uint8_t* data, size_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int b = 0; b < 8; b++) {
+      crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+static void known_answers() {
+  CHECK_EQ(e12::get_crc16(check, sizeof(check)), 0x29B1);
+  CHECK_EQ(e12::get_crc32(check, sizeof(check)), 0xCBF43926);
+  CHECK_EQ(e12::get_crc16(check, 0), 0xFFFF);
+  CHECK_EQ(e12::get_crc32(check, 0), 0);
+
+  // every length up to a few slices, at every alignment
+  uint8_t buf[64 + 8];
+  srand(5);
+  for (size_t i = 0; i < sizeof(buf); i++) buf[i] = rand();
+  for (size_t off = 0; off < 8; off++) {
+    for (size_t len = 0; len <= 64; len++) {
+      CHECK_EQ(e12::get_crc16(&buf[off], len), crc16_bitwise(&buf[off], len));
+      CHECK_EQ(e12::get_crc32(&buf[off], len), crc32_bitwise(&buf[off], len));
+    }
+  }
+}
+
+static bool count(e12_packet_t* p, void* ctx) {
+  if (p->msg.head.cmd == e12_cmd_t::CMD_TIME) (*(int*)ctx)++;
+  return true;
+}
+
+// a CMD_TIME frame as the wire carries it
+static uint8_t frame(e12_posix* tx, uint8_t* buf) {
+  e12_packet_t* p = tx->e12_get_packet();
+  p->msg.head.cmd = e12_cmd_t::CMD_TIME;
+  p->msg_time.ms = 0x12345678;
+  p->msg.head.len = sizeof(p->msg_time);
+  e12_onwire_t* w = tx->encode(p);
+  memcpy(buf, w->buf, w->head.len);
+  return w->head.len;
+}
+
+static void corrupted(e12_integrity_t mode, uint8_t trailer) {
+  e12_posix tx(1, 2), rx(1, 2);
+  tx.set_integrity(mode);
+  uint8_t good[E12_MAX_FRAME_LEN], bad[E12_MAX_FRAME_LEN];
+  uint8_t len = frame(&tx, good);
+  CHECK_EQ(len, sizeof(e12_onwire_head_t) + sizeof(e12_header_t) + 4 +
+                    trailer);
+
+  int n = 0;
+  CHECK_EQ(rx.decode(good, len, count, &n), len);
+  CHECK_EQ(n, 1);
+
+  // a bit flipped anywhere after the head, payload or trailer
+  for (uint8_t i = sizeof(e12_onwire_head_t); i < len; i++) {
+    memcpy(bad, good, len);
+    bad[i] ^= 0x10;
+    n = 0;
+    rx.decode(bad, len, count, &n);
+    CHECK_EQ(n, 0);
+    rx.decode(good, len, count, &n);
+    CHECK_EQ(n, 1);
+  }
+}
+
+int main() {
+  known_answers();
+  corrupted(e12_integrity_t::INTEGRITY_CRC16, E12_CRC16_LEN);
+  corrupted(e12_integrity_t::INTEGRITY_CRC32, E12_CRC32_LEN);
+
+  TEST_DONE();
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// CONFIG and STATE responses carry only the used part of the stored data,
+// so they still fit a frame with a CRC trailer.
+
+#include <posix_e12_protocol.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+static e12_packet_t got;
+
+static bool keep(e12_packet_t* p, void* ctx) {
+  memcpy(&got, p, p->msg.head.len);
+  *(int*)ctx += 1;
+  return true;
+}
+
+// answers a request from rx, decodes the answer on tx
+static bool ask(e12_posix* node, e12_posix* vmcu, e12_cmd_t cmd, bool fetch) {
+  e12_packet_t req;
+  memset(&req, 0, sizeof(req));
+  req.msg.head.seq = 7;
+  req.msg.head.RESP_EXPECTED = true;
+  req.msg.head.cmd = cmd;
+  req.msg.head.len = sizeof(e12_header_t) + offsetof(e12_data_t, data);
+  ((e12_data_t*)req.msg.data)->FETCH = fetch;
+
+  e12_packet_t* resp = node->get_response(&req);
+  if (!resp) return false;
+  e12_onwire_t* w = node->encode(resp);
+  if (!w) return false;
+  int n = 0;
+  memset(&got, 0, sizeof(got));
+  vmcu->decode(w->buf, w->head.len, keep, &n);
+  return n == 1;
+}
+
+int main() {
+  static e12_device_t dev;
+  e12_posix node(1, 2), vmcu(1, 2);
+  node.set_e12_device(&dev);
+
+  // JSON config, most of the buffer
+  char json[sizeof(dev.config.data)];
+  memset(json, 'a', sizeof(json));
+  json[0] = '"';
+  json[sizeof(json) - 20] = '"';
+  json[sizeof(json) - 19] = 0;
+  dev.config.IS_JSON = true;
+  strcpy((char*)dev.config.data, json);
+
+  // TLV state ending in a zero value
+  e12_tlv_writer w(dev.state.data, sizeof(dev.state.data));
+  w.put_str(1, "state");
+  w.put_uint(2, 0);
+  uint8_t tlv_len = w.len();
+
+  const e12_integrity_t modes[] = {e12_integrity_t::INTEGRITY_XOR,
+                                   e12_integrity_t::INTEGRITY_CRC16,
+                                   e12_integrity_t::INTEGRITY_CRC32};
+  for (e12_integrity_t mode : modes) {
+    node.set_integrity(mode);
+
+    CHECK(ask(&node, &vmcu, e12_cmd_t::CMD_CONFIG, false));
+    e12_data_t* d = (e12_data_t*)got.msg.data;
+    CHECK_EQ(got.msg.head.len, sizeof(e12_header_t) +
+                                   offsetof(e12_data_t, data) +
+                                   strlen(json) + 1);
+    CHECK(d->IS_JSON);
+    CHECK(strcmp((char*)d->data, json) == 0);
+
+    CHECK(ask(&node, &vmcu, e12_cmd_t::CMD_STATE, true));
+    CHECK_EQ(got.msg.head.len,
+             sizeof(e12_header_t) + offsetof(e12_data_t, data) + tlv_len);
+    CHECK(d->STORE);
+    CHECK(!d->IS_JSON);
+    e12_tlv_reader r(d->data, tlv_len);
+    CHECK(r.next() && r.key() == 1);
+    CHECK(r.next() && r.key() == 2 && r.get_uint() == 0);
+    CHECK(!r.next() && r.ok());
+  }
+
+  // a config filling the whole buffer only fits without a trailer
+  memset(dev.config.data, 'a', sizeof(dev.config.data));
+  node.set_integrity(e12_integrity_t::INTEGRITY_XOR);
+  CHECK(ask(&node, &vmcu, e12_cmd_t::CMD_CONFIG, false));
+  node.set_integrity(e12_integrity_t::INTEGRITY_CRC32);
+  CHECK(!ask(&node, &vmcu, e12_cmd_t::CMD_CONFIG, false));
+
+  TEST_DONE();
+}
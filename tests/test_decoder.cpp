@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Span decoder: frames split at random points or packed back to back come
+// out of decode(buf, n) exactly like out of the per-byte decode().
+
+#include <posix_e12_protocol.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+#define FRAMES 500
+
+static uint8_t stream[FRAMES * E12_MAX_PKT_SIZE];
+static size_t stream_len;
+
+typedef struct {
+  uint32_t ms[FRAMES];
+  int n;
+  int stop_at;  ///< cb returns false once n reaches it, -1 never
+} frames_t;
+
+static bool collect(e12_packet_t* p, void* ctx) {
+  frames_t* f = (frames_t*)ctx;
+  if (p->msg.head.cmd == e12_cmd_t::CMD_TIME && f->n < FRAMES) {
+    f->ms[f->n] = p->msg_time.ms;
+  }
+  f->n++;
+  return f->n != f->stop_at;
+}
+
+static void make_stream(e12_posix* tx) {
+  stream_len = 0;
+  for (int i = 0; i < FRAMES; i++) {
+    e12_packet_t* p = tx->e12_get_packet();
+    p->msg.head.cmd = e12_cmd_t::CMD_TIME;
+    p->msg_time.ms = 1000 + i;
+    p->msg.head.len = sizeof(p->msg_time);
+    e12_onwire_t* w = tx->encode(p);
+    memcpy(&stream[stream_len], w->buf, w->head.len);
+    stream_len += w->head.len;
+  }
+}
+
+static void check_frames(const frames_t* f) {
+  CHECK_EQ(f->n, FRAMES);
+  for (int i = 0; i < FRAMES && i < f->n; i++) CHECK_EQ(f->ms[i], 1000 + i);
+}
+
+int main() {
+  e12_posix tx(1, 2), rx(1, 2);
+  make_stream(&tx);
+  srand(12);
+
+  // one call over everything
+  frames_t f;
+  memset(&f, 0, sizeof(f));
+  f.stop_at = -1;
+  CHECK_EQ(rx.decode(stream, stream_len, collect, &f), stream_len);
+  check_frames(&f);
+
+  // random chunks, 1 to 40 bytes
+  memset(&f, 0, sizeof(f));
+  f.stop_at = -1;
+  for (size_t off = 0; off < stream_len;) {
+    size_t n = 1 + rand() % 40;
+    if (n > stream_len - off) n = stream_len - off;
+    CHECK_EQ(rx.decode(&stream[off], n, collect, &f), n);
+    off += n;
+  }
+  check_frames(&f);
+
+  // the per-byte decoder agrees
+  e12_onwire_t pkt;
+  memset(&pkt, 0, sizeof(pkt));
+  memset(&f, 0, sizeof(f));
+  f.stop_at = -1;
+  for (size_t i = 0; i < stream_len; i++) {
+    e12_packet_t* p = rx.decode(&pkt, stream[i]);
+    if (p) collect(p, &f);
+  }
+  check_frames(&f);
+
+  // a callback returning false stops the span, the rest is decoded later
+  memset(&f, 0, sizeof(f));
+  f.stop_at = 1;
+  size_t off = 0;
+  while (off < stream_len) {
+    int before = f.n;
+    size_t used = rx.decode(&stream[off], stream_len - off, collect, &f);
+    CHECK(used > 0);
+    CHECK_EQ(f.n, before + 1);
+    off += used;
+    f.stop_at = f.n + 1;
+  }
+  check_frames(&f);
+
+  TEST_DONE();
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Pending table: requests are tracked by seq until their response, a
+// Delta patches: applied in pieces of any size, refused for another base
+// or when corrupted, in a bounded amount of RAM.
+
+#include <e12_delta.h>
+#include <posix_e12_delta.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+#define BASE_SIZE 4096
+#define BASE_VERSION 7
+
+// e12_delta_t and the copy buffer, pointers are 8 bytes on the host
+#define DELTA_RAM_BUDGET 256
+
+typedef struct {
+  const uint8_t* base;
+  uint8_t image[BASE_SIZE + 256];
+} target_t;
+
+static int read_base(uint32_t off, uint8_t* buf, uint8_t len, void* ctx) {
+  memcpy(buf, ((target_t*)ctx)->base + off, len);
+  return 0;
+}
+
+static int write_image(uint32_t off, const uint8_t* buf, uint8_t len,
+                       void* ctx) {
+  target_t* t = (target_t*)ctx;
+  if (off + len > sizeof(t->image)) return -1;
+  memcpy(t->image + off, buf, len);
+  return 0;
+}
+
+// feeds the patch in random pieces, returns the last result
+static int apply(e12_delta_t* d, const uint8_t* patch, long len) {
+  int rc = 0;
+  long pos = 0;
+  while (pos < len && rc == 0) {
+    long n = 1 + rand() % 80;
+    if (n > len - pos) n = len - pos;
+    rc = e12_delta_feed(d, patch + pos, n);
+    pos += n;
+  }
+  return rc;
+}
+
+static uint8_t base[BASE_SIZE];
+static uint8_t other[BASE_SIZE];
+static uint8_t image[BASE_SIZE + 100];
+static uint8_t patch[2 * BASE_SIZE];
+static target_t t;
+
+int main() {
+  srand(12);
+  CHECK(sizeof(e12_delta_t) + E12_DELTA_COPY_BUF <= DELTA_RAM_BUDGET);
+
+  for (int i = 0; i < BASE_SIZE; i++) base[i] = rand();
+  memcpy(other, base, BASE_SIZE);
+  other[BASE_SIZE / 2] ^= 0xFF;
+  // the new image: a few changed constants, an inserted block and a
+  // moved one
+  memcpy(image, base, BASE_SIZE);
+  image[100] ^= 0x5A;
+  image[2000] += 3;
+  memmove(image + 1100, image + 1000, BASE_SIZE - 1000);
+  for (int i = 1000; i < 1100; i++) image[i] = rand();
+  memcpy(image + 3000, base + 200, 300);
+  uint32_t size = sizeof(image);
+
+  long len = e12_delta_make(base, BASE_SIZE, BASE_VERSION, image, size,
+                            patch, sizeof(patch));
+  CHECK(len > 0);
+  CHECK(len < (long)size / 4);
+
+  // in random pieces, several times over
+  e12_delta_t d;
+  t.base = base;
+  for (int round = 0; round < 20; round++) {
+    memset(t.image, 0, sizeof(t.image));
+    e12_delta_begin(&d, BASE_VERSION, BASE_SIZE, read_base, write_image, &t);
+    CHECK_EQ(apply(&d, patch, len), 1);
+    CHECK_EQ(d.out, size);
+    CHECK(!memcmp(t.image, image, size));
+  }
+
+  // a byte at a time
+  e12_delta_begin(&d, 0, BASE_SIZE, read_base, write_image, &t);
+  int rc = 0;
+  for (long i = 0; i < len && rc == 0; i++) {
+    rc = e12_delta_feed(&d, patch + i, 1);
+  }
+  CHECK_EQ(rc, 1);
+
+  // another base version or size is refused from the header
+  e12_delta_begin(&d, BASE_VERSION + 1, BASE_SIZE, read_base, write_image,
+                  &t);
+  CHECK(e12_delta_feed(&d, patch, len) < 0);
+  e12_delta_begin(&d, BASE_VERSION, BASE_SIZE - 1, read_base, write_image,
+                  &t);
+  CHECK(e12_delta_feed(&d, patch, len) < 0);
+
+  // another base of the same size and version fails the SHA-256
+  t.base = other;
+  e12_delta_begin(&d, BASE_VERSION, BASE_SIZE, read_base, write_image, &t);
+  CHECK(apply(&d, patch, len) < 0);
+  t.base = base;
+
+  // a corrupted byte anywhere past the header is caught
+  for (long i = sizeof(e12_delta_header_t); i < len; i += 7) {
+    patch[i] ^= 0x24;
+    e12_delta_begin(&d, BASE_VERSION, BASE_SIZE, read_base, write_image, &t);
+    CHECK(apply(&d, patch, len) < 0);
+    patch[i] ^= 0x24;
+  }
+
+  // a truncated patch never completes, and a failed one stays failed
+  e12_delta_begin(&d, BASE_VERSION, BASE_SIZE, read_base, write_image, &t);
+  CHECK_EQ(e12_delta_feed(&d, patch, len - 1), 0);
+  uint8_t bad = 0xC0;  // no such op
+  CHECK(e12_delta_feed(&d, &bad, 1) < 0);
+  CHECK(e12_delta_feed(&d, patch + len - 1, 1) < 0);
+
+  TEST_DONE();
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Fragmented payloads from the VMCU reach the node whole, or not at all
+// when the transmit queue of a sleeping node cannot take every fragment.
+
+#include "e12_fake_node.h"
+#include "e12_test.h"
+#include "e12_test_vmcu.h"
+
+#define PAYLOAD 1000
+
+static uint8_t payload[PAYLOAD];
+
+// the node end, collecting what on_fragment() gets
+class frag_sink : public e12_posix {
+ public:
+  uint8_t buf[PAYLOAD];
+  uint16_t len;
+  bool whole;
+
+  frag_sink() : e12_posix(1, 2), len(0), whole(false) {}
+
+  virtual int on_fragment(e12_cmd_t cmd, uint16_t off, const uint8_t* data,
+                          uint8_t n, uint16_t total) {
+    if (!data || off != len || off + n > sizeof(buf)) return -1;
+    memcpy(&buf[off], data, n);
+    len += n;
+    whole = len == total;
+    return 0;
+  }
+};
+
+// hands what the node got to the sink, true if it was the whole payload
+static bool deliver(e12_fake_node* link, uint16_t total) {
+  frag_sink sink;
+  for (int i = 0; i < link->got_n && i < FAKE_NODE_FRAMES; i++) {
+    CHECK(link->got[i].msg.head.FRAGMENT);
+    sink.on_receive(&link->got[i]);
+  }
+  return sink.whole && sink.len == total && !memcmp(sink.buf, payload, total);
+}
+
+int main() {
+  for (int i = 0; i < PAYLOAD; i++) payload[i] = (uint8_t)(i * 7 + 3);
+  e12_fake_node link;
+  e12_test_vmcu vmcu;
+  CHECK_EQ(vmcu.begin(&link), 0);
+
+  // awake, straight to the bus
+  CHECK(vmcu.send_fragmented(e12_cmd_t::CMD_STATE, payload, PAYLOAD) >= 0);
+  CHECK(link.got_n > 1);
+  CHECK(deliver(&link, PAYLOAD));
+
+  // asleep: more than the queue takes is refused before any fragment
+  link.reset();
+  vmcu.set_node_status(e12_node_op_status_t::STATUS_SLEEP, 60000);
+  CHECK_EQ(vmcu.send_fragmented(e12_cmd_t::CMD_STATE, payload, PAYLOAD),
+           (int)e12_err_t::ERR_RETRY_LATER);
+  CHECK_EQ(vmcu.get_tx_queued(), 0);
+
+  // what fits is queued whole and goes out on wake up
+  uint16_t fits = vmcu.get_tx_room() / 2;
+  CHECK(vmcu.send_fragmented(e12_cmd_t::CMD_STATE, payload, fits) >= 0);
+  CHECK(vmcu.get_tx_queued() > fits);
+  CHECK_EQ(link.got_n, 0);
+  CHECK(vmcu.send_fragmented(e12_cmd_t::CMD_STATE, payload, fits) ==
+        (int)e12_err_t::ERR_RETRY_LATER);
+
+  e12_packet_t awake;
+  memset(&awake, 0, sizeof(awake));
+  awake.msg.head.cmd = e12_cmd_t::CMD_NODE_AWAKE;
+  awake.msg.head.len = sizeof(e12_header_t);
+  vmcu.on_receive(&awake);
+  CHECK_EQ(vmcu.get_tx_queued(), 0);
+  CHECK(deliver(&link, fits));
+
+  TEST_DONE();
+}
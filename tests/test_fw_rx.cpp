@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Firmware receiver: chunks that came early are read back piecewise to be
+// hashed in order, a read failing part way through ends the transfer.
+
+#include <posix_e12_protocol.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+#define IMAGE_SIZE 350
+#define CHUNK_SIZE 100
+
+class fw_node : public e12_posix {
+ public:
+  uint8_t image[IMAGE_SIZE];
+  int reads;
+  int fail_read;  ///< read that fails, -1 for none
+  int done;
+  bool ok;
+
+  e12_fw_status_t status;
+
+  fw_node() : e12_posix(1, 2) {
+    memset(image, 0, sizeof(image));
+    reads = 0;
+    fail_read = -1;
+    done = 0;
+    ok = false;
+    status = e12_fw_status_t::FW_RECEIVING;
+  }
+
+  int on_fw_begin(const e12_fw_info_t* info) override { return 0; }
+  int on_fw_write(uint32_t off, const uint8_t* data, uint8_t len) override {
+    memcpy(image + off, data, len);
+    return 0;
+  }
+  int on_fw_read(uint32_t off, uint8_t* data, uint8_t len) override {
+    CHECK(len <= E12_FW_READ_PIECE);
+    if (reads++ == fail_read) return -1;
+    memcpy(data, image + off, len);
+    return 0;
+  }
+  int on_fw_done(const e12_fw_info_t* info, bool ok) override {
+    done++;
+    this->ok = ok;
+    return 0;
+  }
+  int on_fw_save(const e12_fw_rx_t* rx) override {
+    status = rx->status;
+    return 0;
+  }
+};
+
+static uint8_t src[IMAGE_SIZE];
+
+static void begin(fw_node* n, const e12_fw_info_t* info) {
+  e12_packet_t p;
+  memset(&p, 0, sizeof(p));
+  p.msg.head.cmd = e12_cmd_t::CMD_FW_BEGIN;
+  memcpy(e12_view<e12_fw_info_t>(&p).reserve(), info, sizeof(*info));
+  n->on_receive(&p);
+}
+
+static void send_chunk(fw_node* n, uint16_t i) {
+  e12_packet_t p;
+  memset(&p, 0, sizeof(p));
+  p.msg.head.cmd = e12_cmd_t::CMD_FW_CHUNK;
+  e12_fw_chunk_t* c = (e12_fw_chunk_t*)p.msg.data;
+  c->index = i;
+  uint32_t off = (uint32_t)i * CHUNK_SIZE;
+  uint8_t len = IMAGE_SIZE - off < CHUNK_SIZE ? IMAGE_SIZE - off : CHUNK_SIZE;
+  memcpy(c->data, src + off, len);
+  p.msg.head.len =
+      sizeof(e12_header_t) + offsetof(e12_fw_chunk_t, data) + len;
+  n->on_receive(&p);
+}
+
+int main() {
+  for (int i = 0; i < IMAGE_SIZE; i++) src[i] = (uint8_t)(i * 7 + 3);
+  e12_fw_info_t info;
+  memset(&info, 0, sizeof(info));
+  info.size = IMAGE_SIZE;
+  info.chunk_size = CHUNK_SIZE;
+  info.window = 4;
+  e12_sha256_t sha;
+  e12::sha256_init(&sha);
+  e12::sha256_update(&sha, src, IMAGE_SIZE);
+  e12::sha256_final(&sha, info.sha256);
+
+  // in order, nothing is read back
+  {
+    fw_node n;
+    begin(&n, &info);
+    for (uint16_t i = 0; i < 4; i++) send_chunk(&n, i);
+    CHECK_EQ(n.reads, 0);
+    CHECK_EQ(n.done, 1);
+    CHECK(n.ok);
+    CHECK(!memcmp(n.image, src, IMAGE_SIZE));
+  }
+
+  // out of order, the early chunks are hashed piece by piece
+  {
+    fw_node n;
+    begin(&n, &info);
+    send_chunk(&n, 3);
+    send_chunk(&n, 1);
+    send_chunk(&n, 2);
+    CHECK_EQ(n.reads, 0);
+    send_chunk(&n, 0);
+    int per = (CHUNK_SIZE + E12_FW_READ_PIECE - 1) / E12_FW_READ_PIECE;
+    int last = IMAGE_SIZE - 3 * CHUNK_SIZE;
+    CHECK_EQ(n.reads, 2 * per + (last + E12_FW_READ_PIECE - 1) /
+                                    E12_FW_READ_PIECE);
+    CHECK_EQ(n.done, 1);
+    CHECK(n.ok);
+    CHECK(n.status == e12_fw_status_t::FW_DONE);
+  }
+
+  // the first piece failing asks for the chunk again
+  {
+    fw_node n;
+    begin(&n, &info);
+    send_chunk(&n, 1);
+    n.fail_read = 0;
+    send_chunk(&n, 0);
+    CHECK_EQ(n.done, 0);
+    CHECK(n.status == e12_fw_status_t::FW_RECEIVING);
+    send_chunk(&n, 1);
+    send_chunk(&n, 2);
+    send_chunk(&n, 3);
+    CHECK_EQ(n.done, 1);
+    CHECK(n.ok);
+  }
+
+  // a later piece failing can't be rewound, the transfer ends
+  {
+    fw_node n;
+    begin(&n, &info);
+    send_chunk(&n, 1);
+    n.fail_read = 1;
+    send_chunk(&n, 0);
+    CHECK(n.status == e12_fw_status_t::FW_WRITE_ERR);
+    send_chunk(&n, 2);
+    send_chunk(&n, 3);
+    CHECK_EQ(n.done, 0);
+  }
+
+  TEST_DONE();
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Built with E12_HALF_DUPLEX: the response is built in place over the
+// request it answers, reading the request payload first. A request sent
+// while a request is handled takes the one buffer, the request is then
+// reported overwritten and left unanswered.
+
+#include <posix_e12_protocol.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+#if !E12_HALF_DUPLEX
+#error "build with E12_HALF_DUPLEX=1"
+#endif
+
+#define DIGITAL_PINS 0x000F
+
+class hd_node : public e12_posix {
+ public:
+  uint16_t levels;
+  bool ping_back;  ///< send a CMD_PING while handling a request
+
+  hd_node() : e12_posix(1, 2), levels(0x5), ping_back(false) {
+    set_pin_mask(DIGITAL_PINS, 0x3);
+  }
+
+  using e12::get_decode_buffer;
+  using e12::get_encode_buffer;
+  using e12::rx_overwritten;
+
+  int on_receive(e12_packet_t* p) override {
+    int ret = e12_posix::on_receive(p);
+    if (ping_back) send(get_request(e12_cmd_t::CMD_PING, false));
+    return ret;
+  }
+
+  int on_ctl_read(uint8_t pin) override {
+    if (e12::on_ctl_read(pin) < 0) return -1;
+    return (levels >> pin) & 1;
+  }
+
+  // as e12_arduino::handle() does
+  bool handle(e12_packet_t* p) {
+    on_receive(p);
+    if (p->msg.head.IS_RESPONSE || rx_overwritten(p)) return false;
+    return send(get_response(p)) > 0;
+  }
+};
+
+int main() {
+  e12_loopback_transport la, lb;
+  la.connect(&lb);
+  e12_posix vmcu(1, 2);
+  hd_node node;
+  CHECK_EQ(vmcu.begin(&la), 0);
+  CHECK_EQ(node.begin(&lb), 0);
+
+  // one buffer for both ways
+  CHECK(node.get_encode_buffer() == node.get_decode_buffer());
+
+  // the response takes the place of its request
+  CHECK(vmcu.send(vmcu.get_request(e12_cmd_t::CMD_PING)) > 0);
+  e12_packet_t* p = node.read();
+  CHECK(p != NULL);
+  uint8_t seq = p->msg.head.seq;
+  CHECK_EQ(node.on_receive(p), 0);
+  CHECK(!node.rx_overwritten(p));
+  e12_packet_t* resp = node.get_response(p);
+  CHECK(resp == p);
+  CHECK(resp->msg.head.IS_RESPONSE);
+  CHECK_EQ(resp->msg.head.seq, seq);
+  CHECK(strcmp(resp->msg.data, "pong") == 0);
+  CHECK(node.send(resp) > 0);
+  p = vmcu.read();
+  CHECK(p != NULL);
+  CHECK(p->msg.head.IS_RESPONSE);
+  CHECK(strcmp(p->msg.data, "pong") == 0);
+  vmcu.on_receive(p);
+  CHECK_EQ(vmcu.get_pending_count(), 0);
+
+  // payloads are read before the response overwrites them
+  e12_packet_t* req = vmcu.get_request(e12_cmd_t::CMD_PIN_CTL, true);
+  req->msg_ctl.pin = 2;
+  req->msg.head.len = sizeof(req->msg_ctl);
+  CHECK(vmcu.send(req) > 0);
+  p = node.read();
+  CHECK(p != NULL);
+  CHECK(node.handle(p));
+  p = vmcu.read();
+  CHECK(p != NULL);
+  CHECK(p->msg_ctl.response);
+  CHECK_EQ(p->msg_ctl.pin, 2);
+  CHECK_EQ(p->msg_ctl.value, 1);
+  vmcu.on_receive(p);
+
+  // a request sent while handling one overwrites it, no response
+  node.ping_back = true;
+  CHECK(vmcu.send(vmcu.get_request(e12_cmd_t::CMD_TIME)) > 0);
+  p = node.read();
+  CHECK(p != NULL);
+  CHECK(!node.handle(p));
+  CHECK(node.rx_overwritten(p));
+  p = vmcu.read();
+  CHECK(p != NULL);
+  CHECK(!p->msg.head.IS_RESPONSE);
+  CHECK(p->msg.head.cmd == e12_cmd_t::CMD_PING);
+  CHECK(vmcu.read() == NULL);
+  CHECK_EQ(vmcu.get_pending_count(), 1);
+
+  // the next request is answered again
+  node.ping_back = false;
+  CHECK(vmcu.send(vmcu.get_request(e12_cmd_t::CMD_TIME)) > 0);
+  p = node.read();
+  CHECK(p != NULL);
+  CHECK(node.handle(p));
+  p = vmcu.read();
+  CHECK(p != NULL);
+  CHECK(p->msg.head.IS_RESPONSE);
+  CHECK(p->msg.head.cmd == e12_cmd_t::CMD_TIME);
+
+  TEST_DONE();
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// e12_json_parse() integers: exact up to the member's range, saturated
+// to its min or max beyond it, never wrapped.
+
+#include <e12_json.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+typedef struct {
+  uint32_t u32;
+  int32_t i32;
+  uint16_t u16;
+  int8_t i8;
+  uint8_t u8;
+} nums_t;
+
+static const e12_json_field_t fields[] = {
+    E12_JSON_FIELD("u32", nums_t, u32, e12_json_type_t::JSON_UINT),
+    E12_JSON_FIELD("i32", nums_t, i32, e12_json_type_t::JSON_INT),
+    E12_JSON_FIELD("u16", nums_t, u16, e12_json_type_t::JSON_UINT),
+    E12_JSON_FIELD("i8", nums_t, i8, e12_json_type_t::JSON_INT),
+    E12_JSON_FIELD("u8", nums_t, u8, e12_json_type_t::JSON_UINT),
+};
+
+static nums_t parse(const char* s) {
+  nums_t n;
+  memset(&n, 0, sizeof(n));
+  CHECK_EQ(e12_json_parse(s, strlen(s) + 1, fields, 5, &n), 5);
+  return n;
+}
+
+int main() {
+  nums_t n = parse(
+      "{\"u32\":4294967295,\"i32\":-2147483648,\"u16\":65535,\"i8\":-128,"
+      "\"u8\":255}");
+  CHECK_EQ(n.u32, 4294967295u);
+  CHECK_EQ(n.i32, INT32_MIN);
+  CHECK_EQ(n.u16, 65535);
+  CHECK_EQ(n.i8, -128);
+  CHECK_EQ(n.u8, 255);
+
+  // digits past 429496728 used to be dropped: 4294967296 read 429496729
+  n = parse(
+      "{\"u32\":4294967296,\"i32\":99999999999,\"u16\":70000,\"i8\":300,"
+      "\"u8\":\"256\"}");
+  CHECK_EQ(n.u32, 0xFFFFFFFFu);
+  CHECK_EQ(n.i32, INT32_MAX);
+  CHECK_EQ(n.u16, 0xFFFF);
+  CHECK_EQ(n.i8, 127);
+  CHECK_EQ(n.u8, 255);
+
+  // -(int32_t)u wrapped for magnitudes above INT32_MAX
+  n = parse(
+      "{\"u32\":-1,\"i32\":-3000000000,\"u16\":-5,\"i8\":-300,\"u8\":1e3}");
+  CHECK_EQ(n.u32, 0);
+  CHECK_EQ(n.i32, INT32_MIN);
+  CHECK_EQ(n.u16, 0);
+  CHECK_EQ(n.i8, -128);
+  CHECK_EQ(n.u8, 255);
+
+  n = parse("{\"u32\":1000,\"i32\":-42,\"u16\":\"7\",\"i8\":-1,\"u8\":3}");
+  CHECK_EQ(n.u32, 1000);
+  CHECK_EQ(n.i32, -42);
+  CHECK_EQ(n.u16, 7);
+  CHECK_EQ(n.i8, -1);
+  CHECK_EQ(n.u8, 3);
+
+  TEST_DONE();
+}
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// LOG_FMT_COMPACT events decode to the events encoded, in the smallest
+// encoding of their value. Queued log events flushed as CMD_LOG_BATCH
+// reach the node as the CMD_LOG events they replace, every frame fitting
+// with its trailer. A node waking up gets the queue on the next poll.
+
+#include <posix_e12_protocol.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+#define EVENTS 16
+
+// the f_data encoding in the flags byte, see e12_log_codec.cpp
+#define F_ENC(buf) (((buf)[0] >> 3) & 0x03)
+#define F_HALF 0
+#define F_CENTI 1
+#define F_FLOAT 2
+
+class log_node : public e12_posix {
+ public:
+  int frames;
+  int batches;
+  int events;
+  e12_log_evt_t last;
+
+  log_node() : e12_posix(1, 2), frames(0), batches(0), events(0) {}
+
+  int on_receive(e12_packet_t* p) override {
+    if (p->msg.head.cmd == e12_cmd_t::CMD_LOG) {
+      events++;
+      memcpy(&last, p->msg.data, sizeof(last));
+      return 0;
+    }
+    return e12_posix::on_receive(p);
+  }
+};
+
+static void fill(e12_log_evt_t* evt, int i) {
+  memset(evt, 0, sizeof(*evt));
+  evt->type = 1;
+  evt->src = 2;
+  evt->ts = 1000 + i * 10;
+  evt->s = true;
+  // a full s_data: 21 bytes compact, five fill a batch up to the trailer
+  char s[MAX_S_LOG_DATA + 1];
+  snprintf(s, sizeof(s), "log event nr %03d", i);
+  memcpy(evt->s_data, s, MAX_S_LOG_DATA);
+}
+
+static void serve(log_node* node) {
+  e12_packet_t* p;
+  while ((p = node->read()) != NULL) {
+    node->frames++;
+    if (p->msg.head.cmd == e12_cmd_t::CMD_LOG_BATCH) node->batches++;
+    node->on_receive(p);
+  }
+}
+
+// encodes evt after prev_ts, decodes it back and checks it is the same
+static uint8_t round_trip(const e12_log_evt_t* evt, uint32_t prev_ts,
+                          uint8_t* buf) {
+  uint32_t enc_ts = prev_ts, dec_ts = prev_ts;
+  uint8_t n = e12::log_encode(evt, &enc_ts, buf, E12_LOG_COMPACT_MAX);
+  CHECK(n > 0);
+  CHECK_EQ(enc_ts, evt->ts);
+
+  e12_log_evt_t out;
+  CHECK_EQ(e12::log_decode(buf, n, &dec_ts, &out), n);
+  CHECK_EQ(dec_ts, evt->ts);
+  CHECK_EQ(out.type, evt->type);
+  CHECK_EQ(out.status, evt->status);
+  CHECK_EQ(out.src, evt->src);
+  CHECK_EQ(out.src_index, evt->src_index);
+  CHECK_EQ(out.ts, evt->ts);
+  CHECK_EQ(out.count, evt->count);
+  CHECK_EQ(out.s, evt->s);
+  CHECK_EQ(out.f, evt->f);
+  CHECK_EQ(out.i, evt->i);
+  if (evt->s) {
+    CHECK(memcmp(out.s_data, evt->s_data, MAX_S_LOG_DATA) == 0);
+  } else {
+    if (evt->f) CHECK(out.f_data == evt->f_data);
+    CHECK_EQ(out.i_data, evt->i_data);
+  }
+  // anything short of the whole event is malformed
+  for (uint8_t i = 0; i < n; i++) {
+    CHECK_EQ(e12::log_decode(buf, i, &dec_ts, &out), 0);
+  }
+  return n;
+}
+
+static void codec() {
+  uint8_t buf[E12_LOG_COMPACT_MAX];
+  e12_log_evt_t evt;
+
+  // flags, type, src and a 1 byte ts delta: 4 bytes, then the value
+  memset(&evt, 0, sizeof(evt));
+  evt.type = 3;
+  evt.src = 4;
+  evt.src_index = 1;
+  evt.ts = 1000;
+  evt.s = true;
+  memcpy(evt.s_data, "hello", 5);
+  CHECK_EQ(round_trip(&evt, 990, buf), 5 + 1 + 5);
+
+  // the shortest of centi, half and float that is exact
+  memset(&evt, 0, sizeof(evt));
+  evt.type = 1;
+  evt.ts = 1000;
+  evt.f = true;
+  evt.f_data = 0.5f;
+  CHECK_EQ(round_trip(&evt, 1000, buf), 4 + 1);
+  CHECK_EQ(F_ENC(buf), F_CENTI);
+  evt.f_data = 1.5f;
+  CHECK_EQ(round_trip(&evt, 1000, buf), 4 + 2);
+  CHECK_EQ(F_ENC(buf), F_HALF);
+  evt.f_data = -65504.0f;
+  CHECK_EQ(round_trip(&evt, 1000, buf), 4 + 2);
+  CHECK_EQ(F_ENC(buf), F_HALF);
+  evt.f_data = 3.14f;
+  CHECK_EQ(round_trip(&evt, 1000, buf), 4 + 2);
+  CHECK_EQ(F_ENC(buf), F_CENTI);
+  evt.f_data = 0.1234567f;
+  CHECK_EQ(round_trip(&evt, 1000, buf), 4 + 4);
+  CHECK_EQ(F_ENC(buf), F_FLOAT);
+
+  // i_data is kept with or without the i flag
+  memset(&evt, 0, sizeof(evt));
+  evt.ts = 1000;
+  evt.i = true;
+  evt.i_data = -5;
+  CHECK_EQ(round_trip(&evt, 1000, buf), 4 + 1);
+  evt.i = false;
+  evt.i_data = 70000;
+  CHECK_EQ(round_trip(&evt, 1000, buf), 4 + 3);
+  evt.i_data = 0;
+  CHECK_EQ(round_trip(&evt, 1000, buf), 4);
+
+  // status and count only when set, ts as a signed delta
+  evt.status = 2;
+  evt.count = 300;
+  CHECK_EQ(round_trip(&evt, 1000, buf), 4 + 1 + 2);
+  evt.ts = 900;
+  CHECK_EQ(round_trip(&evt, 1000, buf), 4 + 1 + 2 + 1);
+  evt.ts = 0xFFFFFFF0;
+  CHECK(round_trip(&evt, 0x10, buf) > 0);
+
+  // no room: nothing written, prev_ts kept
+  uint32_t prev_ts = 1000;
+  CHECK_EQ(e12::log_encode(&evt, &prev_ts, buf, 3), 0);
+  CHECK_EQ(prev_ts, 1000);
+}
+
+// events go out once flush_at are queued, as many to a frame as fit
+static void batching() {
+  e12_loopback_transport la, lb;
+  la.connect(&lb);
+  e12_posix vmcu(1, 2);
+  log_node node;
+  CHECK_EQ(vmcu.begin(&la), 0);
+  CHECK_EQ(node.begin(&lb), 0);
+
+  e12_log_evt_t evt;
+  memset(&evt, 0, sizeof(evt));
+  evt.i = true;
+  vmcu.set_log_flush(2);
+  evt.ts = 1000;
+  CHECK_EQ(vmcu.queue_log(&evt), 0);
+  CHECK_EQ(vmcu.get_logs_queued(), 1);
+  serve(&node);
+  CHECK_EQ(node.frames, 0);
+
+  evt.ts = 1001;
+  evt.i_data = 1;
+  CHECK_EQ(vmcu.queue_log(&evt), 0);
+  CHECK_EQ(vmcu.get_logs_queued(), 0);
+  serve(&node);
+  CHECK_EQ(node.frames, 1);
+  CHECK_EQ(node.batches, 1);
+  CHECK_EQ(node.events, 2);
+  CHECK_EQ(node.last.i_data, 1);
+
+  // LOG_FMT_FIXED: a lone event goes out as CMD_LOG
+  evt.i_data = 2;
+  CHECK_EQ(vmcu.queue_log(&evt), 0);
+  CHECK_EQ(vmcu.flush_logs(), 1);
+  serve(&node);
+  CHECK_EQ(node.frames, 2);
+  CHECK_EQ(node.batches, 1);
+  CHECK_EQ(node.last.i_data, 2);
+
+  // LOG_FMT_COMPACT: all 16 in one batch
+  vmcu.set_log_format(e12_log_fmt_t::LOG_FMT_COMPACT);
+  vmcu.set_log_flush(0);
+  node.frames = node.batches = node.events = 0;
+  for (int i = 0; i < E12_LOG_RING_SIZE; i++) {
+    evt.ts = 2000 + i * 100;
+    evt.i_data = -i;
+    CHECK_EQ(vmcu.queue_log(&evt), 0);
+  }
+  CHECK_EQ(vmcu.get_logs_queued(), 0);
+  serve(&node);
+  CHECK_EQ(node.frames, 1);
+  CHECK_EQ(node.events, E12_LOG_RING_SIZE);
+  CHECK_EQ(node.last.ts, 2000 + (E12_LOG_RING_SIZE - 1) * 100);
+  CHECK_EQ(node.last.i_data, -(E12_LOG_RING_SIZE - 1));
+
+  // a few events and time: the max age sends them
+  vmcu.set_log_flush(0, 0);
+  node.frames = node.events = 0;
+  CHECK_EQ(vmcu.queue_log(&evt), 0);
+  serve(&node);
+  CHECK_EQ(node.events, 1);
+}
+
+static void flush_all(e12_log_fmt_t fmt, e12_integrity_t mode) {
+  e12_loopback_transport la, lb;
+  la.connect(&lb);
+  e12_posix vmcu(1, 2);
+  log_node node;
+  CHECK_EQ(vmcu.begin(&la), 0);
+  CHECK_EQ(node.begin(&lb), 0);
+  vmcu.set_integrity(mode);
+  node.set_integrity(mode);
+  vmcu.set_log_format(fmt);
+  vmcu.set_log_flush(EVENTS);
+
+  e12_log_evt_t evt;
+  for (int i = 0; i < EVENTS; i++) {
+    fill(&evt, i);
+    CHECK_EQ(vmcu.queue_log(&evt), 0);
+  }
+  // a full ring is flushed while queueing, the rest goes here
+  CHECK(vmcu.flush_logs() >= 0);
+  CHECK_EQ(vmcu.get_logs_queued(), 0);
+  serve(&node);
+  CHECK_EQ(node.events, EVENTS);
+  CHECK(node.frames > 1);
+  CHECK_EQ(node.last.ts, 1000 + (EVENTS - 1) * 10);
+  CHECK(memcmp(node.last.s_data, "log event nr 015", MAX_S_LOG_DATA) == 0);
+}
+
+// CMD_NODE_AWAKE only marks the queue due, it is sent from the next read()
+static void flush_on_wakeup() {
+  e12_loopback_transport la, lb;
+  la.connect(&lb);
+  e12_posix vmcu(1, 2);
+  log_node node;
+  CHECK_EQ(vmcu.begin(&la), 0);
+  CHECK_EQ(node.begin(&lb), 0);
+  vmcu.set_log_flush(EVENTS);
+
+  e12_log_evt_t evt;
+  for (int i = 0; i < 2; i++) {
+    fill(&evt, i);
+    CHECK_EQ(vmcu.queue_log(&evt), 0);
+  }
+  e12_packet_t awake;
+  memset(&awake, 0, sizeof(awake));
+  awake.msg.head.cmd = e12_cmd_t::CMD_NODE_AWAKE;
+  awake.msg.head.len = sizeof(e12_header_t);
+  CHECK_EQ(vmcu.on_receive(&awake), 0);
+  CHECK_EQ(vmcu.get_logs_queued(), 2);
+  CHECK(node.read() == NULL);
+
+  CHECK(vmcu.read() == NULL);
+  CHECK_EQ(vmcu.get_logs_queued(), 0);
+  serve(&node);
+  CHECK_EQ(node.frames, 1);
+  CHECK_EQ(node.events, 2);
+}
+
+int main() {
+  codec();
+  batching();
+  flush_all(e12_log_fmt_t::LOG_FMT_COMPACT, e12_integrity_t::INTEGRITY_CRC32);
+  flush_all(e12_log_fmt_t::LOG_FMT_COMPACT, e12_integrity_t::INTEGRITY_CRC16);
+  flush_all(e12_log_fmt_t::LOG_FMT_FIXED, e12_integrity_t::INTEGRITY_CRC32);
+  flush_all(e12_log_fmt_t::LOG_FMT_COMPACT, e12_integrity_t::INTEGRITY_XOR);
+  flush_on_wakeup();
+
+  TEST_DONE();
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Pending table: requests are tracked by seq until their response, a
+// timeout or a cancel, each ending exactly once.
+
+#include <posix_e12_protocol.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+typedef struct {
+  int calls;
+  uint8_t seq;
+  e12_err_t err;
+  bool has_packet;
+} result_t;
+
+static void on_done(uint8_t seq, e12_err_t err, e12_packet_t* p, void* ctx) {
+  result_t* r = (result_t*)ctx;
+  r->calls++;
+  r->seq = seq;
+  r->err = err;
+  r->has_packet = p != NULL;
+}
+
+static e12_packet_t request(uint8_t seq, e12_cmd_t cmd) {
+  e12_packet_t p;
+  memset(&p, 0, sizeof(p));
+  p.msg.head.seq = seq;
+  p.msg.head.cmd = cmd;
+  p.msg.head.RESP_EXPECTED = true;
+  p.msg.head.len = sizeof(e12_header_t);
+  return p;
+}
+
+static e12_packet_t response(uint8_t seq, e12_cmd_t cmd) {
+  e12_packet_t p = request(seq, cmd);
+  p.msg.head.RESP_EXPECTED = false;
+  p.msg.head.IS_RESPONSE = true;
+  return p;
+}
+
+int main() {
+  e12_posix e(1, 2);
+  result_t def, own;
+  memset(&def, 0, sizeof(def));
+  memset(&own, 0, sizeof(own));
+  e.set_response_cb(on_done, &def);
+  e.set_timeout(60000);
+
+  // tracked by seq, with its own callback or the default one
+  e12_packet_t a = request(10, e12_cmd_t::CMD_PING);
+  e12_packet_t b = request(11, e12_cmd_t::CMD_TIME);
+  CHECK_EQ(e.add_pending(&a, on_done, &own), 10);
+  CHECK_EQ(e.add_pending(&b), 11);
+  CHECK_EQ(e.get_pending_count(), 2);
+  CHECK(e.is_pending(e12_cmd_t::CMD_PING));
+  CHECK(e.get_pending(11) != NULL);
+  CHECK(e.get_pending(12) == NULL);
+
+  // a response to another command with the same seq is not a match
+  e12_packet_t r = response(10, e12_cmd_t::CMD_TIME);
+  e.on_receive(&r);
+  CHECK_EQ(own.calls, 0);
+  CHECK_EQ(e.get_pending_count(), 2);
+
+  r = response(10, e12_cmd_t::CMD_PING);
+  e.on_receive(&r);
+  CHECK_EQ(own.calls, 1);
+  CHECK_EQ(own.seq, 10);
+  CHECK(own.err == e12_err_t::ERR_NONE);
+  CHECK(own.has_packet);
+  CHECK_EQ(def.calls, 0);
+  CHECK(!e.is_pending(e12_cmd_t::CMD_PING));
+
+  // a second response to the same seq is ignored
+  e.on_receive(&r);
+  CHECK_EQ(own.calls, 1);
+
+  r = response(11, e12_cmd_t::CMD_TIME);
+  e.on_receive(&r);
+  CHECK_EQ(def.calls, 1);
+  CHECK_EQ(def.seq, 11);
+  CHECK_EQ(e.get_pending_count(), 0);
+
+  // the table is full at E12_MAX_PENDING
+  e12_packet_t many[E12_MAX_PENDING + 1];
+  for (int i = 0; i <= E12_MAX_PENDING; i++) {
+    many[i] = request(100 + i, e12_cmd_t::CMD_PING);
+    CHECK_EQ(e.add_pending(&many[i]), i < E12_MAX_PENDING ? 100 + i : -1);
+  }
+  CHECK_EQ(e.get_pending_count(), E12_MAX_PENDING);
+
+  // tracking the same request again keeps one entry
+  CHECK_EQ(e.add_pending(&many[0]), 100);
+  CHECK_EQ(e.get_pending_count(), E12_MAX_PENDING);
+
+  // a wrapped seq replaces the stale entry
+  e12_packet_t wrapped = request(100, e12_cmd_t::CMD_TIME);
+  CHECK_EQ(e.add_pending(&wrapped), 100);
+  CHECK_EQ(e.get_pending(100)->cmd, e12_cmd_t::CMD_TIME);
+  CHECK_EQ(e.get_pending_count(), E12_MAX_PENDING);
+
+  // cancel ends silently, end_pending through the callback
+  def.calls = 0;
+  e.cancel_pending(101);
+  CHECK_EQ(e.get_pending_count(), E12_MAX_PENDING - 1);
+  CHECK(e.end_pending(102, e12_err_t::ERR_BUS));
+  CHECK(!e.end_pending(102, e12_err_t::ERR_BUS));
+  e.expire_pending();
+  CHECK_EQ(def.calls, 1);
+  CHECK(def.err == e12_err_t::ERR_BUS);
+  CHECK(!def.has_packet);
+
+  // nothing is due yet, then everything left times out once
+  def.calls = 0;
+  CHECK_EQ(e.expire_pending(), 0);
+  e.set_timeout(0);
+  int left = e.get_pending_count();
+  CHECK_EQ(e.expire_pending(), left);
+  CHECK_EQ(def.calls, left);
+  CHECK(def.err == e12_err_t::ERR_TIMEOUT);
+  CHECK_EQ(e.get_pending_count(), 0);
+  CHECK_EQ(e.expire_pending(), 0);
+
+  TEST_DONE();
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Malformed CMD_PIN_BATCH requests are neither applied nor answered.
+// Subscribed pins are pushed as CMD_PIN_EVENT when a digital level
+// changes or an analog value moves past the deadband, at the period of
+// their subscription, until they are unsubscribed.
+
+#include <posix_e12_protocol.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+#define DIGITAL_PINS 0x000F
+#define ANALOG_PIN 16
+
+class pin_vmcu : public e12_posix {
+ public:
+  uint16_t levels;
+  uint16_t analog;
+  uint32_t now;
+
+  pin_vmcu() : e12_posix(1, 2), levels(0), analog(1000), now(0) {
+    set_pin_mask(DIGITAL_PINS | 1UL << ANALOG_PIN, 0x3);
+  }
+
+  uint32_t get_time_ms() override { return now; }
+
+  int on_ctl_read(uint8_t pin) override {
+    if (e12::on_ctl_read(pin) < 0) return -1;
+    return pin < 16 ? (levels >> pin) & 1 : analog;
+  }
+  bool on_ctl_write(uint8_t pin, uint32_t val) override {
+    if (!e12::on_ctl_write(pin, val)) return false;
+    levels = (levels & ~(1 << pin)) | (val << pin);
+    return true;
+  }
+};
+
+class event_node : public e12_posix {
+ public:
+  int events;
+  e12_pin_state_t last;
+
+  event_node() : e12_posix(1, 2), events(0) {}
+
+  void on_pin_event(const e12_pin_state_t* st) override {
+    events++;
+    memcpy(&last, st, sizeof(last));
+  }
+};
+
+static e12_packet_t request(uint8_t seq, e12_cmd_t cmd, const void* data,
+                            uint8_t len) {
+  e12_packet_t p;
+  memset(&p, 0, sizeof(p));
+  p.msg.head.seq = seq;
+  p.msg.head.cmd = cmd;
+  p.msg.head.RESP_EXPECTED = true;
+  p.msg.head.len = sizeof(e12_header_t) + len;
+  memcpy(p.msg.data, data, len);
+  return p;
+}
+
+static int subscribe(pin_vmcu* vmcu, uint32_t mask, uint16_t period,
+                     uint16_t deadband, bool off) {
+  e12_pin_sub_t sub;
+  memset(&sub, 0, sizeof(sub));
+  sub.mask = mask;
+  sub.period = period;
+  sub.deadband = deadband;
+  sub.off = off;
+  e12_packet_t r = request(1, e12_cmd_t::CMD_PIN_SUBSCRIBE, &sub, sizeof(sub));
+  return vmcu->on_receive(&r);
+}
+
+// polls the VMCU, returns the events the node got
+static int poll(pin_vmcu* vmcu, event_node* node) {
+  int events = node->events;
+  vmcu->pin_poll();
+  e12_packet_t* p;
+  while ((p = node->read()) != NULL) node->on_receive(p);
+  return node->events - events;
+}
+
+static void batch_rejected() {
+  pin_vmcu vmcu;
+  e12_pin_batch_t b;
+  memset(&b, 0, sizeof(b));
+  b.read = 0xFFFFFFFF;
+  b.count = 1;
+  b.writes[0].pin = 0;
+  b.writes[0].value = 1;
+  uint8_t head = offsetof(e12_pin_batch_t, writes);
+
+  // shorter than its count of writes
+  e12_packet_t r = request(1, e12_cmd_t::CMD_PIN_BATCH, &b, head);
+  CHECK(vmcu.on_receive(&r) < 0);
+  CHECK(vmcu.get_response(&r) == NULL);
+  // shorter than the batch head
+  r = request(2, e12_cmd_t::CMD_PIN_BATCH, &b, 2);
+  CHECK(vmcu.on_receive(&r) < 0);
+  CHECK(vmcu.get_response(&r) == NULL);
+  // more writes than a batch holds
+  b.count = E12_PIN_BATCH_MAX + 1;
+  r = request(3, e12_cmd_t::CMD_PIN_BATCH, &b, sizeof(b));
+  CHECK(vmcu.on_receive(&r) < 0);
+  CHECK(vmcu.get_response(&r) == NULL);
+  CHECK_EQ(vmcu.levels, 0);
+
+  // the same write well formed
+  b.count = 1;
+  r = request(4, e12_cmd_t::CMD_PIN_BATCH, &b, head + sizeof(b.writes[0]));
+  CHECK_EQ(vmcu.on_receive(&r), 0);
+  CHECK(vmcu.get_response(&r) != NULL);
+  CHECK_EQ(vmcu.levels, 0x1);
+}
+
+static void events() {
+  e12_loopback_transport la, lb;
+  la.connect(&lb);
+  pin_vmcu vmcu;
+  event_node node;
+  CHECK_EQ(vmcu.begin(&la), 0);
+  CHECK_EQ(node.begin(&lb), 0);
+
+  // every poll, the values now are the baseline
+  CHECK_EQ(subscribe(&vmcu, 0x1 | 1UL << ANALOG_PIN, 0, 10, false), 0);
+  CHECK_EQ(vmcu.get_pins_subscribed(), 0x1 | 1UL << ANALOG_PIN);
+  CHECK_EQ(poll(&vmcu, &node), 0);
+
+  // a digital change
+  vmcu.levels = 0x1;
+  CHECK_EQ(poll(&vmcu, &node), 1);
+  CHECK_EQ(node.last.mask, 0x1);
+  CHECK_EQ(node.last.digital, 0x1);
+  // pin 1 is not subscribed
+  vmcu.levels = 0x3;
+  CHECK_EQ(poll(&vmcu, &node), 0);
+
+  // analog within the deadband, then past it
+  vmcu.analog = 1010;
+  CHECK_EQ(poll(&vmcu, &node), 0);
+  vmcu.analog = 1011;
+  CHECK_EQ(poll(&vmcu, &node), 1);
+  CHECK_EQ(node.last.mask, 1UL << ANALOG_PIN);
+  CHECK_EQ(node.last.analog[0], 1011);
+  // measured from the value reported
+  vmcu.analog = 1000;
+  CHECK_EQ(poll(&vmcu, &node), 1);
+  CHECK_EQ(node.last.analog[0], 1000);
+
+  // both at once
+  vmcu.levels = 0x2;
+  vmcu.analog = 2000;
+  CHECK_EQ(poll(&vmcu, &node), 1);
+  CHECK_EQ(node.last.mask, 0x1 | 1UL << ANALOG_PIN);
+  CHECK_EQ(node.last.digital, 0);
+  CHECK_EQ(node.last.analog[0], 2000);
+
+  // unsubscribed pins are not sampled
+  CHECK_EQ(subscribe(&vmcu, 0x1, 0, 10, true), 0);
+  CHECK_EQ(vmcu.get_pins_subscribed(), 1UL << ANALOG_PIN);
+  vmcu.levels = 0x1;
+  CHECK_EQ(poll(&vmcu, &node), 0);
+  CHECK_EQ(subscribe(&vmcu, 1UL << ANALOG_PIN, 0, 10, true), 0);
+  CHECK_EQ(vmcu.get_pins_subscribed(), 0);
+  vmcu.analog = 3000;
+  CHECK_EQ(poll(&vmcu, &node), 0);
+
+  // sampled once the period is over, or on pin_changed() for digital
+  vmcu.now = 1000;
+  CHECK_EQ(subscribe(&vmcu, 0x1 | 1UL << ANALOG_PIN, 100, 0, false), 0);
+  vmcu.levels = 0;
+  vmcu.analog = 3001;
+  vmcu.now = 1050;
+  CHECK_EQ(poll(&vmcu, &node), 0);
+  vmcu.pin_changed();
+  CHECK_EQ(poll(&vmcu, &node), 1);
+  CHECK_EQ(node.last.mask, 0x1);
+  vmcu.now = 1100;
+  CHECK_EQ(poll(&vmcu, &node), 1);
+  CHECK_EQ(node.last.mask, 1UL << ANALOG_PIN);
+  CHECK_EQ(node.last.analog[0], 3001);
+}
+
+int main() {
+  batch_rejected();
+  events();
+
+  TEST_DONE();
+}
@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// on_receive() never answers a request, the caller sends get_response():
+// vendor commands, pin requests and fragments included.
+
+#include <posix_e12_protocol.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+#define DIGITAL_PINS 0x000F
+#define ANALOG_PIN 16
+
+typedef struct __attribute__((packed, aligned(4))) {
+  uint32_t a;
+  uint32_t b;
+} add_req_t;
+
+static int handled;
+
+static int on_add(e12* e, e12_packet_t* p) {
+  handled++;
+  return 0;
+}
+
+static int on_add_resp(e12* e, const e12_packet_t* req, e12_packet_t* resp) {
+  const add_req_t* r = (const add_req_t*)req->msg.data;
+  uint32_t sum = r->a + r->b;
+  memcpy(resp->msg.data, &sum, sizeof(sum));
+  resp->msg.head.len += sizeof(sum);
+  return 0;
+}
+
+static constexpr e12_cmd_def_t cmds[] = {
+    E12_CMD(E12_CMD_VENDOR, add_req_t, on_add, on_add_resp),
+};
+static_assert(E12_CMDS_VALID(cmds), "vendor commands out of order");
+
+class pin_node : public e12_posix {
+ public:
+  uint16_t levels;
+  uint16_t analog;
+
+  pin_node() : e12_posix(1, 2), levels(0), analog(1234) {
+    set_pin_mask(DIGITAL_PINS | 1UL << ANALOG_PIN, 0x3);
+    set_vendor_cmds(cmds, sizeof(cmds) / sizeof(cmds[0]));
+  }
+
+  int on_ctl_read(uint8_t pin) override {
+    if (e12::on_ctl_read(pin) < 0) return -1;
+    return pin < 16 ? (levels >> pin) & 1 : analog;
+  }
+  bool on_ctl_write(uint8_t pin, uint32_t val) override {
+    if (!e12::on_ctl_write(pin, val)) return false;
+    levels = (levels & ~(1 << pin)) | (val << pin);
+    return true;
+  }
+};
+
+static e12_packet_t request(uint8_t seq, e12_cmd_t cmd, const void* data,
+                            uint8_t len) {
+  e12_packet_t p;
+  memset(&p, 0, sizeof(p));
+  p.msg.head.seq = seq;
+  p.msg.head.cmd = cmd;
+  p.msg.head.RESP_EXPECTED = true;
+  p.msg.head.len = sizeof(e12_header_t) + len;
+  memcpy(p.msg.data, data, len);
+  return p;
+}
+
+static e12_packet_t pin_batch(uint8_t seq, uint8_t pin, uint16_t value) {
+  e12_pin_batch_t b;
+  memset(&b, 0, sizeof(b));
+  b.read = 0xFFFFFFFF;
+  b.count = 2;
+  b.writes[0].pin = 0;
+  b.writes[0].value = 1;
+  b.writes[1].pin = pin;
+  b.writes[1].value = value;
+  return request(seq, e12_cmd_t::CMD_PIN_BATCH, &b,
+                 offsetof(e12_pin_batch_t, writes) + 2 * sizeof(b.writes[0]));
+}
+
+static e12_packet_t fragment(uint8_t seq, uint8_t index, uint8_t count,
+                             uint16_t total, uint8_t len, bool last) {
+  e12_frag_t f;
+  memset(&f, 0xA5, sizeof(f));
+  f.index = index;
+  f.count = count;
+  f.total = total;
+  e12_packet_t p = request(seq, e12_cmd_t::CMD_PING, &f,
+                           offsetof(e12_frag_t, data) + len);
+  p.msg.head.FRAGMENT = true;
+  p.msg.head.RESP_EXPECTED = last;
+  return p;
+}
+
+int main() {
+  e12_loopback_transport la, lb;
+  la.connect(&lb);
+  e12_posix vmcu(1, 2);
+  pin_node node;
+  CHECK_EQ(vmcu.begin(&la), 0);
+  CHECK_EQ(node.begin(&lb), 0);
+  vmcu.set_vendor_cmds(cmds, sizeof(cmds) / sizeof(cmds[0]));
+
+  // a vendor request is handled, then answered by the caller only
+  add_req_t add = {40, 2};
+  CHECK(vmcu.send(vmcu.get_request((e12_cmd_t)E12_CMD_VENDOR, true, &add)) >
+        0);
+  e12_packet_t* p = node.read();
+  CHECK(p != NULL);
+  node.on_receive(p);
+  CHECK_EQ(handled, 1);
+  CHECK(vmcu.read() == NULL);
+  CHECK(node.send(node.get_response(p)) > 0);
+  p = vmcu.read();
+  CHECK(p != NULL);
+  CHECK(p->msg.head.IS_RESPONSE);
+  uint32_t sum = 0;
+  memcpy(&sum, p->msg.data, sizeof(sum));
+  CHECK_EQ(sum, 42);
+  // the handler sees the response too
+  vmcu.on_receive(p);
+  CHECK_EQ(handled, 2);
+  CHECK_EQ(vmcu.get_pending_count(), 0);
+
+  // too short to be handled, not answered either
+  e12_packet_t r = request(3, (e12_cmd_t)E12_CMD_VENDOR, &add, 4);
+  CHECK(node.on_receive(&r) < 0);
+  CHECK(node.get_response(&r) == NULL);
+
+  // a pin batch reports the pins read and the writes that failed
+  r = pin_batch(5, 1, 1);
+  CHECK_EQ(node.on_receive(&r), 0);
+  CHECK_EQ(node.levels, 0x3);
+  e12_packet_t* resp = node.get_response(&r);
+  CHECK(resp != NULL);
+  e12_pin_state_t* st = (e12_pin_state_t*)resp->msg.data;
+  CHECK_EQ(resp->msg.head.len, sizeof(e12_header_t) +
+                                   offsetof(e12_pin_state_t, analog) + 2);
+  CHECK_EQ(st->mask, DIGITAL_PINS | 1UL << ANALOG_PIN);
+  CHECK_EQ(st->digital, 0x3);
+  CHECK_EQ(st->failed, 0);
+  CHECK_EQ(st->analog[0], 1234);
+
+  // pin 2 is not an output: none applied
+  node.levels = 0;
+  r = pin_batch(6, 2, 1);
+  CHECK(node.on_receive(&r) < 0);
+  CHECK_EQ(node.levels, 0);
+  st = (e12_pin_state_t*)node.get_response(&r)->msg.data;
+  CHECK_EQ(st->failed, 0x3);
+  node.levels = 0x3;
+
+  // a pin control is answered once, with the value read or written
+  e12_ctl_msg_t ctl;
+  memset(&ctl, 0, sizeof(ctl));
+  ctl.pin = ANALOG_PIN;
+  r = request(9, e12_cmd_t::CMD_PIN_CTL, &ctl.data, sizeof(ctl.data));
+  CHECK_EQ(node.on_receive(&r), 0);
+  CHECK(vmcu.read() == NULL);
+  resp = node.get_response(&r);
+  CHECK_EQ(resp->msg.head.len, sizeof(e12_ctl_msg_t));
+  CHECK(resp->msg_ctl.response);
+  CHECK_EQ(resp->msg_ctl.pin, ANALOG_PIN);
+  CHECK_EQ(resp->msg_ctl.value, 1234);
+
+  ctl.op = (uint8_t)ctl_op_t::WRITE;
+  ctl.pin = 1;
+  ctl.value = 0;
+  r = request(10, e12_cmd_t::CMD_PIN_CTL, &ctl.data, sizeof(ctl.data));
+  CHECK_EQ(node.on_receive(&r), 0);
+  CHECK_EQ(node.levels, 0x1);
+  resp = node.get_response(&r);
+  CHECK(resp->msg_ctl.response);
+  CHECK_EQ(resp->msg_ctl.value, 0);
+
+  // pin 2 is not an output
+  ctl.pin = 2;
+  ctl.value = 1;
+  r = request(11, e12_cmd_t::CMD_PIN_CTL, &ctl.data, sizeof(ctl.data));
+  CHECK(node.on_receive(&r) < 0);
+  resp = node.get_response(&r);
+  CHECK_EQ(resp->msg.head.len, sizeof(resp->msg_err));
+  CHECK_EQ(resp->msg_err.err, 1);
+
+  // the last fragment is acknowledged, with an error if it was dropped
+  r = fragment(20, 0, 2, 40, 20, false);
+  CHECK_EQ(node.on_receive(&r), 0);
+  CHECK(node.get_response(&r) == NULL);
+  r = fragment(20, 1, 2, 40, 20, true);
+  CHECK_EQ(node.on_receive(&r), 0);
+  resp = node.get_response(&r);
+  CHECK(resp != NULL);
+  CHECK_EQ(resp->msg.head.len, sizeof(resp->msg_err));
+  CHECK_EQ(resp->msg_err.err, 0);
+
+  // out of order
+  r = fragment(21, 1, 2, 40, 20, true);
+  CHECK(node.on_receive(&r) < 0);
+  resp = node.get_response(&r);
+  CHECK(resp != NULL);
+  CHECK_EQ(resp->msg_err.err, 1);
+
+  // larger than E12_FRAG_BUF_SIZE
+  r = fragment(22, 0, 2, E12_FRAG_BUF_SIZE + 1, 20, true);
+  CHECK(node.on_receive(&r) < 0);
+  CHECK_EQ(node.get_response(&r)->msg_err.err, 1);
+
+#if E12_PIN_SUBS
+  // a subscription answers with the pins now subscribed
+  e12_pin_sub_t sub;
+  memset(&sub, 0, sizeof(sub));
+  sub.mask = 0x1 | 1UL << ANALOG_PIN | 1UL << 20;
+  sub.period = 100;
+  r = request(7, e12_cmd_t::CMD_PIN_SUBSCRIBE, &sub, sizeof(sub));
+  CHECK_EQ(node.on_receive(&r), 0);
+  st = (e12_pin_state_t*)node.get_response(&r)->msg.data;
+  CHECK_EQ(st->mask, 0x1 | 1UL << ANALOG_PIN);
+  CHECK_EQ(st->analog[0], 1234);
+
+  sub.off = 1;
+  r = request(8, e12_cmd_t::CMD_PIN_SUBSCRIBE, &sub, sizeof(sub));
+  CHECK_EQ(node.on_receive(&r), 0);
+  st = (e12_pin_state_t*)node.get_response(&r)->msg.data;
+  CHECK_EQ(st->mask, 0);
+#endif
+  CHECK(vmcu.read() == NULL);
+
+  TEST_DONE();
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Noise injection: a share of the frames get a bit flipped, the stream is
+// fed in random chunks. Every intact frame must come out, no damaged one,
+// in every integrity mode.
+
+#include <posix_e12_protocol.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+#define FRAMES 5000
+#define CORRUPT_PCT 10
+
+static uint8_t stream[FRAMES * E12_MAX_PKT_SIZE];
+
+typedef struct {
+  bool clean[FRAMES];
+  int next;  ///< lowest frame that may still arrive
+  int got;
+  int bad;   ///< frames out of order, damaged or delivered twice
+} rx_t;
+
+static bool collect(e12_packet_t* p, void* ctx) {
+  rx_t* r = (rx_t*)ctx;
+  int i = (int)p->msg_time.ms - 1000;
+  if (p->msg.head.cmd != e12_cmd_t::CMD_TIME || i < r->next || i >= FRAMES ||
+      !r->clean[i]) {
+    r->bad++;
+    return true;
+  }
+  r->next = i + 1;
+  r->got++;
+  return true;
+}
+
+static void run(e12_integrity_t mode) {
+  e12_posix tx(1, 2), rx(1, 2);
+  tx.set_integrity(mode);
+  rx_t r;
+  memset(&r, 0, sizeof(r));
+  srand(4);
+
+  size_t len = 0;
+  int clean = 0, corrupted = 0;
+  for (int i = 0; i < FRAMES; i++) {
+    e12_packet_t* p = tx.e12_get_packet();
+    p->msg.head.cmd = e12_cmd_t::CMD_TIME;
+    p->msg_time.ms = 1000 + i;
+    p->msg.head.len = sizeof(p->msg_time);
+    e12_onwire_t* w = tx.encode(p);
+    memcpy(&stream[len], w->buf, w->head.len);
+    r.clean[i] = rand() % 100 >= CORRUPT_PCT;
+    if (r.clean[i]) {
+      clean++;
+    } else {
+      stream[len + rand() % w->head.len] ^= 1 << (rand() % 8);
+      corrupted++;
+    }
+    len += w->head.len;
+  }
+
+  for (size_t off = 0; off < len;) {
+    size_t n = 1 + rand() % 40;
+    if (n > len - off) n = len - off;
+    rx.decode(&stream[off], n, collect, &r);
+    off += n;
+  }
+
+  printf("integrity %d: %d/%d intact frames recovered, %d corrupted, "
+         "%.2f intact frames lost per corrupted frame\n",
+         (int)mode, r.got, clean, corrupted,
+         corrupted ? (double)(clean - r.got) / corrupted : 0.0);
+  CHECK_EQ(r.got, clean);
+  CHECK_EQ(r.bad, 0);
+}
+
+int main() {
+  run(e12_integrity_t::INTEGRITY_XOR);
+  run(e12_integrity_t::INTEGRITY_CRC16);
+  run(e12_integrity_t::INTEGRITY_CRC32);
+  TEST_DONE();
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Pending table: requests are tracked by seq until their response, a
+// e12_rx_ring_transport: frames written while the main loop is busy are
+// pumped into the ring, as from Wire.onReceive(), and all decoded later.
+
+#include <e12_ring.h>
+#include <posix_e12_protocol.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+int main() {
+  e12_loopback_transport la, lb;
+  la.connect(&lb);
+  e12_rx_ring_transport<256> ring(&lb);
+  e12_posix vmcu(1, 2), node(1, 2);
+  CHECK_EQ(vmcu.begin(&la), 0);
+  CHECK_EQ(node.begin(&ring), 0);
+
+  // three writes land before the node reads any
+  int n = vmcu.send(vmcu.get_request(e12_cmd_t::CMD_PING));
+  CHECK(n > 0);
+  CHECK_EQ(ring.pump(), n);
+  int m = vmcu.send(vmcu.get_request(e12_cmd_t::CMD_TIME));
+  CHECK(m > 0);
+  m += vmcu.send(vmcu.get_request(e12_cmd_t::CMD_PING, false));
+  CHECK_EQ(ring.pump(), m);
+  CHECK_EQ(ring.available(), n + m);
+
+  e12_packet_t* p = node.read();
+  CHECK(p != NULL && p->msg.head.cmd == e12_cmd_t::CMD_PING);
+  CHECK(p->msg.head.RESP_EXPECTED);
+  p = node.read();
+  CHECK(p != NULL && p->msg.head.cmd == e12_cmd_t::CMD_TIME);
+  p = node.read();
+  CHECK(p != NULL && p->msg.head.cmd == e12_cmd_t::CMD_PING);
+  CHECK(!p->msg.head.RESP_EXPECTED);
+  CHECK(node.read() == NULL);
+  CHECK_EQ(ring.available(), 0);
+
+  // what does not fit stays on the bus for the next pump
+  for (int i = 0; i < 30; i++) {
+    CHECK(vmcu.send(vmcu.get_request(e12_cmd_t::CMD_PING, false)) > 0);
+  }
+  CHECK_EQ(ring.pump(), 255);  // one byte of the ring stays free
+  int got = 0;
+  while (node.read() != NULL) got++;
+  CHECK(got < 30);
+  CHECK(ring.pump() > 0);
+  while (node.read() != NULL) got++;
+  CHECK_EQ(got, 30);
+
+  // writes go straight to the bus
+  CHECK(node.send(node.get_request(e12_cmd_t::CMD_PING, false)) > 0);
+  p = vmcu.read();
+  CHECK(p != NULL && p->msg.head.cmd == e12_cmd_t::CMD_PING);
+
+  TEST_DONE();
+}
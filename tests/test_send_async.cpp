@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// send_async() never completes inside the call, results reach the
+// callback from the next e12_run().
+
+#include "e12_fake_node.h"
+#include "e12_test.h"
+#include "e12_test_vmcu.h"
+
+static bool in_send;
+static int calls;
+static int calls_in_send;
+static e12_err_t last_err;
+static bool last_has_packet;
+
+static void on_done(uint8_t seq, e12_err_t err, e12_packet_t* p, void* ctx) {
+  calls++;
+  if (in_send) calls_in_send++;
+  last_err = err;
+  last_has_packet = p != NULL;
+}
+
+static int send_async(e12_test_vmcu* vmcu, e12_cmd_t cmd, bool response) {
+  in_send = true;
+  int seq = vmcu->send_async(vmcu->get_request(cmd, response), on_done);
+  in_send = false;
+  return seq;
+}
+
+int main() {
+  e12_fake_node link;
+  e12_test_vmcu vmcu;
+  CHECK_EQ(vmcu.begin(&link), 0);
+  vmcu.set_configured(true);
+
+  // no response expected: written at once, reported from e12_run()
+  CHECK(send_async(&vmcu, e12_cmd_t::CMD_PING, false) >= 0);
+  CHECK_EQ(link.got_n, 1);
+  CHECK_EQ(calls, 0);
+  vmcu.e12_run();
+  CHECK_EQ(calls, 1);
+  CHECK(last_err == e12_err_t::ERR_NONE);
+  CHECK(!last_has_packet);
+
+  // refused by the bus
+  link.fail_writes = true;
+  CHECK(send_async(&vmcu, e12_cmd_t::CMD_TIME, true) >= 0);
+  CHECK_EQ(calls, 1);
+  link.fail_writes = false;
+  vmcu.e12_run();
+  CHECK_EQ(calls, 2);
+  CHECK(last_err == e12_err_t::ERR_BUS);
+  CHECK_EQ(vmcu.get_pending_count(), 0);
+
+  // answered by the node
+  link.reset();
+  CHECK(send_async(&vmcu, e12_cmd_t::CMD_TIME, true) >= 0);
+  CHECK_EQ(link.got_n, 1);
+  link.reply(0);
+  vmcu.notify_rx();
+  vmcu.e12_run();
+  CHECK_EQ(calls, 3);
+  CHECK(last_err == e12_err_t::ERR_NONE);
+  CHECK(last_has_packet);
+
+  CHECK_EQ(calls_in_send, 0);
+  TEST_DONE();
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Split I2C reads: the onwire head first, then exactly head.len - 4
+// bytes, instead of clocking a full e12_onwire_t per frame.
+
+#include "e12_fake_node.h"
+#include "e12_test.h"
+#include "e12_test_vmcu.h"
+
+// a node frame longer than the VMCU read chunk
+static int stage_ping(e12_fake_node* link, uint8_t seq) {
+  e12_packet_t* p = link->node.get_request(e12_cmd_t::CMD_PING);
+  p->msg.head.seq = seq;
+  memset(p->msg.data, 'x', 40);
+  p->msg.data[40] = 0;
+  p->msg.head.len = sizeof(e12_header_t) + 41;
+  int before = link->staged_len;
+  link->stage(p);
+  return link->staged_len - before;
+}
+
+int main() {
+  e12_fake_node link;
+  e12_test_vmcu vmcu;
+  CHECK_EQ(vmcu.begin(&link), 0);
+
+  // head, then the rest: two transactions, frame bytes only
+  int len = stage_ping(&link, 7);
+  e12_packet_t* p = vmcu.read();
+  CHECK(p != NULL);
+  if (p) {
+    CHECK_EQ(p->msg.head.seq, 7);
+    CHECK(p->msg.head.cmd == e12_cmd_t::CMD_PING);
+    CHECK_EQ(strlen(p->msg.data), 40);
+  }
+  CHECK_EQ(link.requests, 2);
+  CHECK_EQ(link.clocked, len);
+
+  // an idle node reads as 0xFF, one 4 byte transaction
+  link.reset();
+  CHECK(vmcu.read() == NULL);
+  CHECK_EQ(link.requests, 1);
+  CHECK_EQ(link.clocked, sizeof(e12_onwire_head_t));
+
+  // out of step: a full read resyncs on the next frame
+  link.reset();
+  const uint8_t junk[4] = {0x12, 0x34, 0x56, 0x78};
+  memcpy(link.staged, junk, sizeof(junk));
+  link.staged_len = sizeof(junk);
+  stage_ping(&link, 8);
+  p = vmcu.read();
+  CHECK(p != NULL);
+  if (p) CHECK_EQ(p->msg.head.seq, 8);
+  CHECK_EQ(link.requests, 2);
+  CHECK_EQ(link.clocked, sizeof(e12_onwire_head_t) + sizeof(e12_onwire_t));
+
+  // frames back to back, each read takes exactly one
+  link.reset();
+  int total = stage_ping(&link, 9) + stage_ping(&link, 10);
+  p = vmcu.read();
+  CHECK(p != NULL && p->msg.head.seq == 9);
+  p = vmcu.read();
+  CHECK(p != NULL && p->msg.head.seq == 10);
+  CHECK_EQ(link.clocked, total);
+
+  // split reads off: one full transaction per frame
+  link.reset();
+  vmcu.set_split_read(false);
+  stage_ping(&link, 11);
+  p = vmcu.read();
+  CHECK(p != NULL && p->msg.head.seq == 11);
+  CHECK_EQ(link.requests, 1);
+  CHECK_EQ(link.clocked, sizeof(e12_onwire_t));
+
+  TEST_DONE();
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Pending table: requests are tracked by seq until their response, a
+// e12_static builds the same frames as e12::encode() in every integrity
+// mode, writes them with Derived::write_frame() and tracks requests.
+
+#include <e12_static.h>
+#include <posix_e12_protocol.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+class static_vmcu : public e12_static<static_vmcu, e12_posix> {
+ public:
+  uint8_t frame[E12_MAX_PKT_SIZE];
+  uint8_t len;
+  int writes;
+
+  static_vmcu() : e12_static(1, 2), len(0), writes(0) {}
+
+  int write_frame(const uint8_t* buf, uint8_t n) {
+    memcpy(frame, buf, n);
+    len = n;
+    writes++;
+    return 0;
+  }
+};
+
+static e12_packet_t packet(uint8_t seq, uint8_t payload, bool request) {
+  e12_packet_t p;
+  memset(&p, 0, sizeof(p));
+  p.msg.head.seq = seq;
+  p.msg.head.cmd = e12_cmd_t::CMD_STATE;
+  p.msg.head.RESP_EXPECTED = request;
+  p.msg.head.IS_RESPONSE = !request;
+  p.msg.head.len = sizeof(e12_header_t) + payload;
+  for (uint8_t i = 0; i < payload; i++) p.msg.data[i] = i * 37 + seq;
+  return p;
+}
+
+int main() {
+  const e12_integrity_t modes[] = {e12_integrity_t::INTEGRITY_XOR,
+                                   e12_integrity_t::INTEGRITY_CRC16,
+                                   e12_integrity_t::INTEGRITY_CRC32};
+  const uint8_t payloads[] = {0, 1, 7, 64};
+  e12_posix ref(1, 2);
+  static_vmcu s;
+  uint8_t seq = 1;
+
+  for (e12_integrity_t mode : modes) {
+    ref.set_integrity(mode);
+    s.set_integrity(mode);
+    for (uint8_t payload : payloads) {
+      e12_packet_t p = packet(seq++, payload, false);
+      e12_onwire_t* want = ref.encode(&p);
+      CHECK(want != NULL);
+      int writes = s.writes;
+      CHECK_EQ(s.send(&p), want->head.len);
+      CHECK_EQ(s.writes, writes + 1);
+      CHECK_EQ(s.len, want->head.len);
+      CHECK(!memcmp(s.frame, want->buf, want->head.len));
+    }
+    // the largest packet that fits with this trailer
+    uint8_t max = E12_MAX_FRAME_LEN - sizeof(e12_onwire_head_t) -
+                  sizeof(e12_header_t) - e12::get_trailer_len(mode);
+    e12_packet_t p = packet(seq++, max, false);
+    e12_onwire_t* want = ref.encode(&p);
+    CHECK(want != NULL);
+    CHECK_EQ(s.send(&p), want->head.len);
+    CHECK(!memcmp(s.frame, want->buf, want->head.len));
+    // and one byte more does not
+    p.msg.head.len++;
+    CHECK(ref.encode(&p) == NULL);
+    CHECK(s.send(&p) < 0);
+  }
+
+  // responses are not tracked, requests are
+  CHECK_EQ(s.get_pending_count(), 0);
+  e12_packet_t r = packet(99, 4, true);
+  CHECK(s.send(&r) > 0);
+  CHECK_EQ(s.get_pending_count(), 1);
+  CHECK(s.get_pending(99) != NULL);
+
+  TEST_DONE();
+}
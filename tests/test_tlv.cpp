@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// e12_tlv fields read back as written, malformed ones stop the reader.
+// A binary state sent as CMD_STATE is restored by the peer, and one that
+// leaves no room for the trailer is not sent at all.
+
+#include <posix_e12_protocol.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+#define KEY_COUNT 1
+#define KEY_OFFSET 2
+#define KEY_TEMP 3
+#define KEY_ON 4
+#define KEY_NAME 5
+
+static void varints() {
+  const uint32_t v[] = {0, 127, 128, 16383, 16384, 0xFFFFFFFF};
+  const uint8_t n[] = {1, 1, 2, 2, 3, 5};
+  uint8_t buf[5];
+  for (uint8_t i = 0; i < sizeof(v) / sizeof(v[0]); i++) {
+    uint32_t r = 0;
+    CHECK_EQ(e12_varint_len(v[i]), n[i]);
+    CHECK_EQ(e12_put_varint(buf, v[i]), n[i]);
+    CHECK_EQ(e12_get_varint(buf, n[i], &r), n[i]);
+    CHECK_EQ(r, v[i]);
+    // cut short
+    CHECK_EQ(e12_get_varint(buf, n[i] - 1, &r), 0);
+  }
+  // more than 5 bytes is not a uint32_t
+  const uint8_t too_long[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x01};
+  uint32_t r;
+  CHECK_EQ(e12_get_varint(too_long, sizeof(too_long), &r), 0);
+
+  CHECK_EQ(e12_zigzag(0), 0);
+  CHECK_EQ(e12_zigzag(-1), 1);
+  CHECK_EQ(e12_zigzag(1), 2);
+  CHECK_EQ(e12_zigzag(-64), 127);
+  const int32_t s[] = {0, -1, 1, 1000, -1000, INT32_MAX, INT32_MIN};
+  for (uint8_t i = 0; i < sizeof(s) / sizeof(s[0]); i++) {
+    CHECK_EQ(e12_unzigzag(e12_zigzag(s[i])), s[i]);
+  }
+}
+
+static void fields() {
+  uint8_t buf[32];
+  memset(buf, 0, sizeof(buf));
+  e12_tlv_writer w(buf, sizeof(buf));
+  CHECK(w.put_uint(KEY_COUNT, 300));
+  CHECK(w.put_int(KEY_OFFSET, -2));
+  CHECK(w.put_float(KEY_TEMP, 21.5f));
+  CHECK(w.put_bool(KEY_ON, true));
+  CHECK(w.put_str(KEY_NAME, "e12"));
+  CHECK(w.ok());
+  CHECK_EQ(w.len(), 3 + 2 + 5 + 1 + 5);
+
+  // zero padding after the fields ends them
+  e12_tlv_reader r(buf, sizeof(buf));
+  CHECK(r.next());
+  CHECK_EQ(r.key(), KEY_COUNT);
+  CHECK(r.type() == e12_tlv_type_t::TLV_UINT);
+  CHECK_EQ(r.get_uint(), 300);
+  CHECK(r.get_float() == 300.0f);
+  CHECK(r.next());
+  CHECK_EQ(r.key(), KEY_OFFSET);
+  CHECK_EQ(r.get_int(), -2);
+  CHECK(r.next());
+  CHECK_EQ(r.key(), KEY_TEMP);
+  CHECK(r.get_float() == 21.5f);
+  CHECK_EQ(r.get_int(), 21);
+  CHECK(r.next());
+  CHECK_EQ(r.key(), KEY_ON);
+  CHECK(r.get_bool());
+  CHECK_EQ(r.get_uint(), 1);
+  CHECK(r.next());
+  CHECK_EQ(r.key(), KEY_NAME);
+  char name[8];
+  CHECK(r.get_str(name, sizeof(name)));
+  CHECK(strcmp(name, "e12") == 0);
+  CHECK(!r.get_str(name, 3));
+  CHECK(strcmp(name, "e1") == 0);
+  CHECK(!r.next());
+  CHECK(r.ok());
+  CHECK_EQ(r.pos(), sizeof(buf));
+
+  // a field that does not fit is dropped, and every one after it
+  e12_tlv_writer small(buf, 4);
+  CHECK(small.put_uint(KEY_COUNT, 1));
+  CHECK(!small.put_float(KEY_TEMP, 1.0f));
+  CHECK(!small.put_bool(KEY_ON, false));
+  CHECK(!small.ok());
+  CHECK_EQ(small.len(), 2);
+  e12_tlv_writer keys(buf, sizeof(buf));
+  CHECK(!keys.put_uint(E12_TLV_MAX_KEY + 1, 1));
+  CHECK(!keys.ok());
+
+  // a bytes field longer than the buffer, an unknown type
+  const uint8_t bad_len[] = {(uint8_t)e12_tlv_type_t::TLV_BYTES << 5 | 1, 4,
+                             'a', 'b'};
+  e12_tlv_reader r1(bad_len, sizeof(bad_len));
+  CHECK(!r1.next());
+  CHECK(!r1.ok());
+  const uint8_t bad_type[] = {7 << 5 | 1, 0};
+  e12_tlv_reader r2(bad_type, sizeof(bad_type));
+  CHECK(!r2.next());
+  CHECK(!r2.ok());
+}
+
+class state_vmcu : public e12_posix {
+ public:
+  uint32_t count;
+  float temp;
+  bool on;
+  uint8_t pad;  ///< bytes of a KEY_NAME field padding the state
+  int restored;
+
+  state_vmcu()
+      : e12_posix(1, 2), count(0), temp(0), on(false), pad(0), restored(0) {}
+
+  int on_get_state_bin(e12_tlv_writer* w, void* ctx) override {
+    uint8_t name[E12_MAX_DATA_PAYLOAD];
+    memset(name, 'x', sizeof(name));
+    w->put_uint(KEY_COUNT, count);
+    w->put_float(KEY_TEMP, temp);
+    w->put_bool(KEY_ON, on);
+    if (pad) w->put_bytes(KEY_NAME, name, pad);
+    return 0;
+  }
+
+  int on_restore_state_bin(e12_tlv_reader* r) override {
+    while (r->next()) {
+      switch (r->key()) {
+        case KEY_COUNT:
+          count = r->get_uint();
+          break;
+        case KEY_TEMP:
+          temp = r->get_float();
+          break;
+        case KEY_ON:
+          on = r->get_bool();
+          break;
+        default:
+          break;
+      }
+    }
+    if (!r->ok()) return -1;
+    restored++;
+    return 0;
+  }
+};
+
+static void state_bin() {
+  e12_loopback_transport la, lb;
+  la.connect(&lb);
+  state_vmcu vmcu, node;
+  CHECK_EQ(vmcu.begin(&la), 0);
+  CHECK_EQ(node.begin(&lb), 0);
+  vmcu.set_integrity(e12_integrity_t::INTEGRITY_CRC32);
+  node.set_integrity(e12_integrity_t::INTEGRITY_CRC32);
+
+  vmcu.count = 1234;
+  vmcu.temp = -3.25f;
+  vmcu.on = true;
+  e12_packet_t* p = vmcu.get_request(e12_cmd_t::CMD_STATE, true, (void*)1);
+  CHECK(p != NULL);
+  CHECK(!((e12_data_t*)p->msg.data)->IS_JSON);
+  CHECK(vmcu.send(p) > 0);
+  p = node.read();
+  CHECK(p != NULL);
+  CHECK_EQ(node.on_receive(p), 0);
+  CHECK_EQ(node.restored, 1);
+  CHECK_EQ(node.count, 1234);
+  CHECK(node.temp == -3.25f);
+  CHECK(node.on);
+
+  // the fields fill the data, no room left for the CRC-32
+  uint8_t room = E12_MAX_DATA_PAYLOAD - sizeof(e12_header_t) -
+                 offsetof(e12_data_t, data);
+  vmcu.pad = room - (3 + 5 + 1) - 2;
+  CHECK(vmcu.get_request(e12_cmd_t::CMD_STATE, true, (void*)1) == NULL);
+  vmcu.pad -= E12_CRC32_LEN;
+  p = vmcu.get_request(e12_cmd_t::CMD_STATE, true, (void*)1);
+  CHECK(p != NULL);
+  CHECK(vmcu.send(p) > 0);
+  p = node.read();
+  CHECK(p != NULL);
+  CHECK_EQ(node.on_receive(p), 0);
+  CHECK_EQ(node.restored, 2);
+
+  // the XOR checksum has no trailer, the full state fits
+  vmcu.set_integrity(e12_integrity_t::INTEGRITY_XOR);
+  node.set_integrity(e12_integrity_t::INTEGRITY_XOR);
+  vmcu.pad += E12_CRC32_LEN;
+  vmcu.count = 5;
+  p = vmcu.get_request(e12_cmd_t::CMD_STATE, true, (void*)1);
+  CHECK(p != NULL);
+  CHECK(vmcu.send(p) > 0);
+  p = node.read();
+  CHECK(p != NULL);
+  CHECK_EQ(node.on_receive(p), 0);
+  CHECK_EQ(node.restored, 3);
+  CHECK_EQ(node.count, 5);
+}
+
+int main() {
+  varints();
+  fields();
+  state_bin();
+
+  TEST_DONE();
+}
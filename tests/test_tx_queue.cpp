@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Requests queued while the e12 node sleeps: their timeout starts when
+// the queue is written, not when they were queued.
+
+#include "e12_fake_node.h"
+#include "e12_test.h"
+#include "e12_test_vmcu.h"
+
+static int done;
+static e12_err_t last_err;
+
+static void on_done(uint8_t seq, e12_err_t err, e12_packet_t* p, void* ctx) {
+  done++;
+  last_err = err;
+}
+
+static void wake(e12_test_vmcu* vmcu) {
+  e12_packet_t awake;
+  memset(&awake, 0, sizeof(awake));
+  awake.msg.head.cmd = e12_cmd_t::CMD_NODE_AWAKE;
+  awake.msg.head.len = sizeof(e12_header_t);
+  vmcu->on_receive(&awake);
+}
+
+int main() {
+  e12_fake_node link;
+  e12_test_vmcu vmcu;
+  CHECK_EQ(vmcu.begin(&link), 0);
+  vmcu.set_configured(true);
+  vmcu.set_response_cb(on_done);
+  const uint32_t timeout = 5000;
+  vmcu.set_timeout(timeout);
+
+  // queued during a long sleep, nothing expires before it is written
+  vmcu.set_node_status(e12_node_op_status_t::STATUS_SLEEP, 60000);
+  CHECK(vmcu.send(vmcu.get_request(e12_cmd_t::CMD_TIME)) > 0);
+  CHECK_EQ(link.got_n, 0);
+  CHECK_EQ(vmcu.get_pending_count(), 1);
+  e12_stub_ms += 60000;
+  CHECK_EQ(vmcu.expire_pending(), 0);
+  CHECK_EQ(done, 0);
+
+  // written on wake up, the full timeout counts from there
+  wake(&vmcu);
+  CHECK_EQ(link.got_n, 1);
+  CHECK_EQ(vmcu.get_tx_queued(), 0);
+  e12_stub_ms += timeout - 1;
+  CHECK_EQ(vmcu.expire_pending(), 0);
+  e12_stub_ms += 1;
+  CHECK_EQ(vmcu.expire_pending(), 1);
+  CHECK_EQ(done, 1);
+  CHECK(last_err == e12_err_t::ERR_TIMEOUT);
+
+  // answered after the wake up completes normally
+  link.reset();
+  done = 0;
+  vmcu.set_node_status(e12_node_op_status_t::STATUS_SLEEP, 60000);
+  CHECK(vmcu.send(vmcu.get_request(e12_cmd_t::CMD_TIME)) > 0);
+  e12_stub_ms += 60000;
+  wake(&vmcu);
+  CHECK_EQ(link.got_n, 1);
+  link.reply(0);
+  vmcu.notify_rx();
+  vmcu.e12_run();
+  CHECK_EQ(done, 1);
+  CHECK(last_err == e12_err_t::ERR_NONE);
+  CHECK_EQ(vmcu.get_pending_count(), 0);
+
+  TEST_DONE();
+}
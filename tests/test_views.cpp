@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2023 e12.io
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Typed views: bounds checks, requests written in place, payloads read
+// straight from the decode buffer, and only head.len bytes copied.
+
+#include <posix_e12_protocol.h>
+#include <string.h>
+
+#include "e12_test.h"
+
+static e12_packet_t* last;
+
+static bool keep(e12_packet_t* p, void* ctx) {
+  last = p;
+  return true;
+}
+
+static void check_bounds() {
+  e12_packet_t p;
+  memset(&p, 0, sizeof(p));
+
+  CHECK(!e12_view<e12_log_evt_t>(0).valid());
+  CHECK(e12_view<e12_log_evt_t>(0).reserve() == 0);
+
+  p.msg.head.len = sizeof(e12_header_t);
+  CHECK(!e12_view<e12_log_evt_t>(&p).valid());
+  CHECK(e12_view<e12_log_evt_t>(&p).get() == 0);
+
+  p.msg.head.len = sizeof(e12_header_t) + sizeof(e12_log_evt_t) - 1;
+  CHECK(!e12_view<e12_log_evt_t>(&p).valid());
+
+  e12_log_evt_t* evt = e12_view<e12_log_evt_t>(&p).reserve();
+  CHECK(evt == (e12_log_evt_t*)p.msg.data);
+  CHECK_EQ(p.msg.head.len, sizeof(e12_header_t) + sizeof(e12_log_evt_t));
+  CHECK(e12_view<e12_log_evt_t>(&p).get() == evt);
+
+  p.msg.head.len = sizeof(e12_packet_t) + 1;
+  CHECK(!e12_view<e12_log_evt_t>(&p).valid());
+}
+
+int main() {
+  e12_posix tx(1, 2), rx(1, 2);
+  check_bounds();
+
+  // e12_get_packet() clears the header only
+  e12_packet_t* p = tx.e12_get_packet();
+  memset(p->msg.data, 0x5A, 8);
+  p = tx.e12_get_packet();
+  CHECK_EQ(p->msg.head.len, 0);
+  CHECK_EQ((uint8_t)p->msg.data[7], 0x5A);
+
+  // written in place with a NULL payload
+  p = tx.get_request(e12_cmd_t::CMD_LOG, true, NULL);
+  e12_log_evt_t* evt = e12_view<e12_log_evt_t>(p).get();
+  CHECK(evt != 0);
+  CHECK_EQ(evt->i_data, 0);
+  evt->i_data = -42;
+  evt->f_data = 1.5f;
+  e12_onwire_t* w = tx.encode(p);
+  CHECK(w != 0);
+  last = 0;
+  CHECK_EQ(rx.decode(w->buf, w->head.len, keep, NULL), w->head.len);
+  CHECK(last != 0);
+
+  // read straight from the decode buffer
+  e12_log_evt_t* got = e12_view<e12_log_evt_t>(last).get();
+  CHECK(got != 0);
+  CHECK((uint8_t*)got == (uint8_t*)last->msg.data);
+  CHECK_EQ(got->i_data, -42);
+  CHECK(got->f_data == 1.5f);
+
+  // get_message() copies head.len bytes and no more
+  e12_packet_t copy;
+  memset(&copy, 0xAA, sizeof(copy));
+  CHECK(rx.get_message(&copy));
+  CHECK(memcmp(&copy, last, last->msg.head.len) == 0);
+  CHECK_EQ(copy.buf[last->msg.head.len], 0xAA);
+  CHECK_EQ(copy.buf[sizeof(copy) - 1], 0xAA);
+
+  // a payload passed in is copied once
+  e12_log_evt_t mine;
+  memset(&mine, 0, sizeof(mine));
+  mine.i_data = 7;
+  p = tx.get_request(e12_cmd_t::CMD_LOG, true, &mine);
+  CHECK_EQ(e12_view<e12_log_evt_t>(p)->i_data, 7);
+  CHECK_EQ(p->msg.head.len, sizeof(e12_header_t) + sizeof(e12_log_evt_t));
+
+  TEST_DONE();
+}